@@ -254,6 +254,35 @@ void Display_paintbrush(short x,short y,byte color)
   }
 }
 
+/// Draw the pixels of a brush line which are not @p transp_color,
+/// one run at a time (see Display_span()).
+/// @param x, y   position in the image of the first pixel
+/// @param width  number of pixels of the line
+/// @param line   brush pixels, used as mask
+/// @param transp_color value of the pixels of @p line to skip
+/// @param use_line_colors draw with the colors of @p line instead of @p color
+/// @param color  color to draw with
+static void Display_brush_line(short x, short y, short width, const byte * line, byte transp_color, int use_line_colors, byte color)
+{
+  short start;
+  short end = 0;
+
+  while (end < width)
+  {
+    for (start = end; start < width && line[start] == transp_color; start++)
+      ;
+    for (end = start; end < width && line[end] != transp_color; end++)
+      ;
+    if (end > start)
+    {
+      if (use_line_colors)
+        Display_span(x + start, y, end - start, line + start);
+      else
+        Display_span_color(x + start, y, end - start, color);
+    }
+  }
+}
+
 /// Draw the paintbrush in the image buffer
 void Draw_paintbrush(short x,short y,byte color)
   // x,y: position du centre du pinceau
@@ -541,21 +570,10 @@ void Draw_paintbrush(short x,short y,byte color)
       }
       else
       {
-        if (Shade_table==Shade_table_left)
-          for (y_pos=start_y,counter_y=start_y_counter;counter_y<end_counter_y;y_pos++,counter_y++)
-            for (x_pos=start_x,counter_x=start_x_counter;counter_x<end_counter_x;x_pos++,counter_x++)
-            {
-              temp_color=Read_pixel_from_brush(counter_x,counter_y);
-              if (temp_color!=Back_color)
-                Display_pixel(x_pos,y_pos,temp_color);
-            }
-        else
-          for (y_pos=start_y,counter_y=start_y_counter;counter_y<end_counter_y;y_pos++,counter_y++)
-            for (x_pos=start_x,counter_x=start_x_counter;counter_x<end_counter_x;x_pos++,counter_x++)
-            {
-              if (Read_pixel_from_brush(counter_x,counter_y)!=Back_color)
-                Display_pixel(x_pos,y_pos,color);
-            }
+        for (y_pos=start_y,counter_y=start_y_counter;counter_y<end_counter_y;y_pos++,counter_y++)
+          Display_brush_line(start_x, y_pos, width,
+                             Brush + counter_y * Brush_width + start_x_counter,
+                             Back_color, Shade_table==Shade_table_left, color);
       }
       Update_part_of_screen(start_x,start_y,width,height);
       break;
@@ -613,11 +631,9 @@ void Draw_paintbrush(short x,short y,byte color)
       else
       {
         for (y_pos=start_y,counter_y=start_y_counter;counter_y<end_counter_y;y_pos++,counter_y++)
-          for (x_pos=start_x,counter_x=start_x_counter;counter_x<end_counter_x;x_pos++,counter_x++)
-          {
-            if (Read_pixel_from_brush(counter_x,counter_y)!=Back_color)
-              Display_pixel(x_pos,y_pos,color);
-          }
+          Display_brush_line(start_x, y_pos, width,
+                             Brush + counter_y * Brush_width + start_x_counter,
+                             Back_color, 0, color);
         Update_part_of_screen(start_x,start_y,width,height);
       }
       break;
@@ -677,11 +693,9 @@ void Draw_paintbrush(short x,short y,byte color)
       else
       {
         for (y_pos=start_y,counter_y=start_y_counter;counter_y<end_counter_y;y_pos++,counter_y++)
-          for (x_pos=start_x,counter_x=start_x_counter;counter_x<end_counter_x;x_pos++,counter_x++)
-          {
-            if (Paintbrush_sprite[(MAX_PAINTBRUSH_SIZE*counter_y)+counter_x] != 0)
-              Display_pixel(x_pos,y_pos,color);
-          }
+          Display_brush_line(start_x, y_pos, width,
+                             Paintbrush_sprite + MAX_PAINTBRUSH_SIZE*counter_y + start_x_counter,
+                             0, 0, color);
         Update_part_of_screen(start_x,start_y,width,height);
       }
   }
@@ -989,6 +989,7 @@ void Button_Settings(int btn)
   {"          --- Editing  ---",0,NULL,0,0,0,NULL},
   {"Adjust brush pick:",1,&(selected_config.Adjust_brush_pick),0,1,0,Lookup_YesNo},
   {"Undo pages:",1,&(selected_config.Max_undo_pages),1,99,5,NULL},
+  {"Undo memory (Mb):",2,&(selected_config.Max_undo_memory),0,65535,5,NULL},
   {"Vertices per polygon:",4,&(selected_config.Nb_max_vertices_per_polygon),2,16384,5,NULL},
   {"Fast zoom:",1,&(selected_config.Fast_zoom),0,1,0,Lookup_YesNo},
   {"Clear with stencil:",1,&(selected_config.Clear_with_stencil),0,1,0,Lookup_YesNo},
@@ -996,7 +997,6 @@ void Button_Settings(int btn)
   {"Auto count colors:",1,&(selected_config.Auto_nb_used),0,1,0,Lookup_YesNo},
   {"Right click colorpick:",1,&(selected_config.Right_click_colorpick),0,1,0,Lookup_YesNo},
   {"Multi shortcuts:",1,&(selected_config.Allow_multi_shortcuts),0,1,0,Lookup_YesNo},
-  {"",0,NULL,0,0,0,NULL},
 
   {"      --- File selector  ---",0,NULL,0,0,0,NULL},
   {"Show in fileselector",0,NULL,0,0,0,NULL},
@@ -1203,7 +1203,9 @@ void Button_Settings(int btn)
   Display_cursor();
 
   // On vérifie qu'on peut bien allouer le nombre de pages Undo.
-  Set_number_of_backups(Config.Max_undo_pages);
+  // (With a memory budget, the history is trimmed on next backup)
+  if (Config.Max_undo_memory == 0)
+    Set_number_of_backups(Config.Max_undo_pages);
 }
 
 // Data for skin selector
@@ -5343,6 +5345,7 @@ void Button_Text(int btn)
         Colorize_mode=1;
         Colorize_current_mode=3;
         Effect_function=Effect_alpha_colorize;
+        Update_pixel_renderer();
 
         Draw_menu_button(BUTTON_EFFECTS,BUTTON_PRESSED);
       }
@@ -5481,7 +5484,7 @@ void Store_brush(int index)
           Brush_height>BRUSH_CONTAINER_PREVIEW_HEIGHT)
       {
         // Scale
-        Rescale(Brush_original_pixels, Brush_width, Brush_height, (byte *)(Brush_container[index].Thumbnail), BRUSH_CONTAINER_PREVIEW_WIDTH, BRUSH_CONTAINER_PREVIEW_HEIGHT, 0, 0);
+        Rescale_smooth(Brush_original_pixels, Brush_width, Brush_height, (byte *)(Brush_container[index].Thumbnail), BRUSH_CONTAINER_PREVIEW_WIDTH, BRUSH_CONTAINER_PREVIEW_HEIGHT, Brush_original_palette);
       }
       else
       {
@@ -903,6 +903,7 @@ void Button_Constraint_menu(void)
         }
         for (i = 0; i < 4; i++)
           memcpy(Main.palette + 252 + i, Favorite_GUI_color(i), sizeof(T_Components));
+        Invalidate_best_color_cache();
         // Refresh palette
         Set_palette(Main.palette);
         Compute_optimal_menu_colors(Main.palette);
@@ -1010,6 +1011,7 @@ void Button_Tilemap_menu(void)
 void Button_Stencil_mode(void)
 {
   Stencil_mode=!Stencil_mode;
+  Update_pixel_renderer();
 }
 
 
@@ -1030,6 +1032,7 @@ void Stencil_update_color(byte color)
 void Button_Stencil_menu(void)
 {
   Menu_tag_colors("Stencil",Stencil,&Stencil_mode,1, "STENCIL", SPECIAL_STENCIL_MENU);
+  Update_pixel_renderer();
 }
 
 
@@ -1037,12 +1040,14 @@ void Button_Stencil_menu(void)
 void Button_Mask_mode(void)
 {
   Mask_mode=!Mask_mode;
+  Update_pixel_renderer();
 }
 
 
 void Button_Mask_menu(void)
 {
   Menu_tag_colors("Mask",Mask_table,&Mask_mode,1, "MASK", SPECIAL_MASK_MENU);
+  Update_pixel_renderer();
 }
 
 
@@ -1249,6 +1254,7 @@ void Button_Smooth_mode(void)
     Smear_mode=0;
   }
   Smooth_mode=!Smooth_mode;
+  Update_pixel_renderer();
 }
 
 
@@ -1357,6 +1363,7 @@ void Button_Smear_mode(void)
     Tiling_mode=0;
   }
   Smear_mode=!Smear_mode;
+  Update_pixel_renderer();
 }
 
 // -- Mode Colorize ---------------------------------------------------------
@@ -1403,6 +1410,7 @@ void Button_Colorize_mode(void)
     Tiling_mode=0;
   }
   Colorize_mode=!Colorize_mode;
+  Update_pixel_renderer();
 }
 
 
@@ -1538,6 +1546,7 @@ void Button_Tiling_mode(void)
     Smear_mode=0;
   }
   Tiling_mode=!Tiling_mode;
+  Update_pixel_renderer();
 }
 
 
@@ -1633,6 +1642,7 @@ void Effects_off(void)
   Sieve_mode=0;
   Snap_mode=0;
   Main.tilemap_mode=0;
+  Update_pixel_renderer();
 }
 
 
@@ -1641,6 +1651,7 @@ void Effects_off(void)
 void Button_Sieve_mode(void)
 {
   Sieve_mode=!Sieve_mode;
+  Update_pixel_renderer();
 }
 
 
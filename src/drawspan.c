@@ -0,0 +1,87 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2018 Thomas Bernard
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+#include <string.h>
+#include "drawspan.h"
+
+///
+/// Define a span kernel. The flags are constants, so each kernel only
+/// keeps the code required by its combination of modes, and the replace
+/// and shade effects are computed inline.
+/// @param TESTED  some pixels are excluded by the sieve, stencil or mask
+/// @param EFFECT  one of ::SPAN_EFFECT
+/// @param LAYERED T_Span::screen is the composition of the visible layers
+#define SPAN_KERNEL(name, TESTED, EFFECT, LAYERED) \
+static void name(const T_Span * span) \
+{ \
+  word i; \
+  \
+  if (!TESTED && EFFECT == SPAN_REPLACE) \
+    memcpy(span->layer, span->colors, span->width); \
+  for (i = 0; i < span->width; i++) \
+  { \
+    byte color; \
+    \
+    if (TESTED && !span->drawable[i]) \
+      continue; \
+    if (EFFECT == SPAN_SHADE) \
+      span->layer[i] = span->shade_table[span->feedback[i]]; \
+    else if (EFFECT == SPAN_ANY_EFFECT) \
+      span->layer[i] = span->effect(span->x + i, span->y, span->colors[i]); \
+    else if (TESTED) \
+      span->layer[i] = span->colors[i]; \
+    if (LAYERED && span->depth[i] <= span->current_layer) \
+    { \
+      color = span->layer[i]; \
+      if (color == span->transparent_color) \
+        color = span->images[span->depth[i]].Pixels[span->offset + i]; \
+      span->screen[i] = color; \
+    } \
+  } \
+}
+
+SPAN_KERNEL(Span_direct, 0, SPAN_REPLACE, 0)
+SPAN_KERNEL(Span_direct_tested, 1, SPAN_REPLACE, 0)
+SPAN_KERNEL(Span_direct_shade, 0, SPAN_SHADE, 0)
+SPAN_KERNEL(Span_direct_tested_shade, 1, SPAN_SHADE, 0)
+SPAN_KERNEL(Span_direct_effect, 0, SPAN_ANY_EFFECT, 0)
+SPAN_KERNEL(Span_direct_tested_effect, 1, SPAN_ANY_EFFECT, 0)
+SPAN_KERNEL(Span_layered, 0, SPAN_REPLACE, 1)
+SPAN_KERNEL(Span_layered_tested, 1, SPAN_REPLACE, 1)
+SPAN_KERNEL(Span_layered_shade, 0, SPAN_SHADE, 1)
+SPAN_KERNEL(Span_layered_tested_shade, 1, SPAN_SHADE, 1)
+SPAN_KERNEL(Span_layered_effect, 0, SPAN_ANY_EFFECT, 1)
+SPAN_KERNEL(Span_layered_tested_effect, 1, SPAN_ANY_EFFECT, 1)
+
+/// Span kernels, indexed by [layered][effect][tested]
+static const Func_span_kernel Span_kernels[2][SPAN_EFFECT_COUNT][2] =
+{
+  { { Span_direct, Span_direct_tested },
+    { Span_direct_shade, Span_direct_tested_shade },
+    { Span_direct_effect, Span_direct_tested_effect } },
+  { { Span_layered, Span_layered_tested },
+    { Span_layered_shade, Span_layered_tested_shade },
+    { Span_layered_effect, Span_layered_tested_effect } },
+};
+
+Func_span_kernel Get_span_kernel(int layered, enum SPAN_EFFECT effect, int tested)
+{
+  return Span_kernels[layered != 0][effect][tested != 0];
+}
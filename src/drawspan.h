@@ -0,0 +1,79 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2018 Thomas Bernard
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+//////////////////////////////////////////////////////////////////////////////
+///@file drawspan.h
+/// Kernels which draw a run of pixels of a line in the current layer.
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef DRAWSPAN_H__
+#define DRAWSPAN_H__
+
+#include "struct.h"
+
+/// Maximum number of pixels handled at once by the span kernels
+#define SPAN_CHUNK 256
+
+/// Destination of a span of pixels, see Display_span()
+typedef struct
+{
+  word x;
+  word y;
+  word width;
+  const byte * colors;
+  const byte * drawable; ///< 0 for the pixels excluded by the sieve, stencil or mask, or NULL
+  byte * layer;          ///< first pixel in the current layer
+  byte * screen;         ///< first pixel in ::Main_screen
+  const byte * depth;    ///< first pixel in the depth buffer
+  const T_Image * images; ///< layers of the page, to read the pixels under a transparent one
+  long offset;           ///< position of the first pixel in the layers
+  byte current_layer;
+  byte transparent_color;
+  Func_effect effect;    ///< for ::SPAN_ANY_EFFECT
+  const byte * shade_table; ///< for ::SPAN_SHADE
+  const byte * feedback; ///< for ::SPAN_SHADE: first pixel in ::FX_feedback_screen
+} T_Span;
+
+/// How the span kernels compute the color of each pixel
+enum SPAN_EFFECT
+{
+  SPAN_REPLACE = 0, ///< No effect: the colors are copied
+  SPAN_SHADE,       ///< Same as Effect_shade()
+  SPAN_ANY_EFFECT,  ///< Call T_Span::effect for each pixel
+  SPAN_EFFECT_COUNT
+};
+
+/// Draws a span, see Get_span_kernel()
+typedef void (* Func_span_kernel) (const T_Span * span);
+
+/**
+ * Get the span kernel specialized for a combination of modes.
+ *
+ * The kernel writes the pixels in T_Span::layer and, when layered, in
+ * T_Span::screen, with the same result as drawing them one by one from
+ * left to right.
+ * @param layered T_Span::screen is the composition of the visible layers
+ * @param effect  one of ::SPAN_EFFECT
+ * @param tested  some pixels are excluded, see T_Span::drawable
+ * @return the kernel
+ */
+Func_span_kernel Get_span_kernel(int layered, enum SPAN_EFFECT effect, int tested);
+
+#endif
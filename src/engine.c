@@ -1186,6 +1186,7 @@ void Main_handler(void)
                 break;
               case SPECIAL_EXCLUDE_COLORS_MENU : // Exclude colors menu
                 Menu_tag_colors("Tag colors to exclude",Exclude_color,&temp,1, NULL, SPECIAL_EXCLUDE_COLORS_MENU);
+                Invalidate_best_color_cache();
                 action++;
                 break;
               case SPECIAL_INVERT_SIEVE :
@@ -1508,6 +1509,10 @@ void Main_handler(void)
     }
     else
     {
+      // Nothing happened: good time to write a safety backup, unless
+      // the user is in the middle of drawing something.
+      if (Operation_stack_size==0 && Mouse_K==0)
+        Write_pending_safety_backup();
 #if defined(USE_SDL) || defined(USE_SDL2)
       // Removed all SDL_Delay() timing here: relying on Get_input()
       SDL_Delay(10);
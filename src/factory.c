@@ -203,7 +203,7 @@ const char * Lua_version(void)
 // Updates the screen colors after a running screen has modified the palette.
 void Update_colors_during_script(void)
 {
-  if (Palette_has_changed)
+  if (Palette_has_changed && !Batch_mode)
   {
     Set_palette(Main.palette);
     Compute_optimal_menu_colors(Main.palette);
@@ -288,18 +288,9 @@ int L_GetBrushSize(lua_State* L)
   return 2;
 }
 
-int L_PutBrushPixel(lua_State* L)
+/// Called before the script writes in the brush
+static void Brush_alter(void)
 {
-  int x;
-  int y;
-  uint8_t c;
-  int nb_args=lua_gettop(L);
-  
-  LUA_ARG_LIMIT (3, "putbrushpixel");
-  LUA_ARG_NUMBER(1, "putbrushpixel", x, INT_MIN, INT_MAX);
-  LUA_ARG_NUMBER(2, "putbrushpixel", y, INT_MIN, INT_MAX);
-  LUA_ARG_NUMBER(3, "putbrushpixel", c, INT_MIN, INT_MAX);
-
   if (!Brush_was_altered)
   {
     int i;
@@ -313,6 +304,79 @@ int L_PutBrushPixel(lua_State* L)
     //--
     Brush_was_altered=1;
   }
+}
+
+///
+/// Push a Lua string holding a block of pixels, row after row.
+/// Pixels outside of the source bitmap get the color outside_color.
+static void Push_pixel_block(lua_State* L, const byte * pixels, int pixels_width, int pixels_height, int x, int y, int w, int h, byte outside_color)
+{
+  byte * block;
+  int i;
+  int j;
+
+  block = GFX2_malloc((size_t)w * h + 1); // +1 so a 0x0 block is still allocated
+  if (block == NULL)
+  {
+    luaL_error(L, "Out of memory for a block of %dx%d pixels", w, h);
+    return;
+  }
+  for (j = 0; j < h; j++)
+  {
+    byte * dest = block + (size_t)j * w;
+
+    if (y + j < 0 || y + j >= pixels_height)
+    {
+      memset(dest, outside_color, w);
+      continue;
+    }
+    for (i = 0; i < w; i++)
+    {
+      if (x + i < 0 || x + i >= pixels_width)
+        dest[i] = outside_color;
+      else
+        dest[i] = pixels[(x + i) + (y + j) * pixels_width];
+    }
+  }
+  lua_pushlstring(L, (const char *)block, (size_t)w * h);
+  free(block);
+}
+
+///
+/// This macro reads the x, y, w, h arguments of the block functions.
+/// This macro uses 2 existing symbols: L for the context, and nb_args=lua_gettop(L)
+#define LUA_ARG_BLOCK(func_name, x, y, w, h) \
+do { \
+  LUA_ARG_NUMBER(1, func_name, x, INT_MIN, INT_MAX); \
+  LUA_ARG_NUMBER(2, func_name, y, INT_MIN, INT_MAX); \
+  LUA_ARG_NUMBER(3, func_name, w, 0, 10000); \
+  LUA_ARG_NUMBER(4, func_name, h, 0, 10000); \
+} while(0)
+
+///
+/// This macro reads the string of pixels passed to the "put...block" functions.
+/// It must hold at least w*h bytes.
+#define LUA_ARG_BLOCK_DATA(index, func_name, dest, w, h) \
+do { \
+  size_t length; \
+  LUA_ARG_STRING(index, func_name, dest); \
+  lua_tolstring(L, (index), &length); \
+  if (length < (size_t)(w) * (h)) return luaL_error(L, "%s: Argument %d has %d bytes, %d were expected.", func_name, (index), (int)length, (w) * (h)); \
+} while(0)
+
+int L_PutBrushPixel(lua_State* L)
+{
+  int x;
+  int y;
+  uint8_t c;
+  int nb_args=lua_gettop(L);
+  
+  LUA_ARG_LIMIT (3, "putbrushpixel");
+  LUA_ARG_NUMBER(1, "putbrushpixel", x, INT_MIN, INT_MAX);
+  LUA_ARG_NUMBER(2, "putbrushpixel", y, INT_MIN, INT_MAX);
+  LUA_ARG_NUMBER(3, "putbrushpixel", c, INT_MIN, INT_MAX);
+
+  Brush_alter();
   
   if (x<0 || y<0 || x>=Brush_width || y>=Brush_height)
   ;
@@ -346,6 +410,44 @@ int L_GetBrushPixel(lua_State* L)
   return 1;
 }
 
+int L_PutBrushBlock(lua_State* L)
+{
+  int x;
+  int y;
+  int w;
+  int h;
+  int i;
+  int j;
+  const char * data;
+  int nb_args=lua_gettop(L);
+  
+  LUA_ARG_LIMIT (5, "putbrushblock");
+  LUA_ARG_BLOCK("putbrushblock", x, y, w, h);
+  LUA_ARG_BLOCK_DATA(5, "putbrushblock", data, w, h);
+
+  Brush_alter();
+
+  for (j = Max(0, -y); j < h && y + j < Brush_height; j++)
+    for (i = Max(0, -x); i < w && x + i < Brush_width; i++)
+      Pixel_in_brush(x + i, y + j, (byte)data[i + j * w]);
+  return 0; // no values returned for lua
+}
+
+int L_GetBrushBlock(lua_State* L)
+{
+  int x;
+  int y;
+  int w;
+  int h;
+  int nb_args=lua_gettop(L);
+  
+  LUA_ARG_LIMIT (4, "getbrushblock");
+  LUA_ARG_BLOCK("getbrushblock", x, y, w, h);
+
+  Push_pixel_block(L, Brush, Brush_width, Brush_height, x, y, w, h, Back_color);
+  return 1;
+}
+
 int L_GetBrushBackupPixel(lua_State* L)
 {
   int x;
@@ -493,6 +595,65 @@ int L_PutPicturePixel(lua_State* L)
 }
 
 
+int L_PutPictureBlock(lua_State* L)
+{
+  int x;
+  int y;
+  int w;
+  int h;
+  int i;
+  int j;
+  const char * data;
+  int nb_args=lua_gettop(L);
+  
+  LUA_ARG_LIMIT (5, "putpictureblock");
+  LUA_ARG_BLOCK("putpictureblock", x, y, w, h);
+  LUA_ARG_BLOCK_DATA(5, "putpictureblock", data, w, h);
+  
+  // Pixels outside the image are silently ignored
+  for (j = Max(0, -y); j < h && y + j < Main.image_height; j++)
+    for (i = Max(0, -x); i < w && x + i < Main.image_width; i++)
+      Pixel_in_current_screen(x + i, y + j, (byte)data[i + j * w]);
+  return 0; // no values returned for lua
+}
+
+int L_MapPicture(lua_State* L)
+{
+  byte conversion_table[256];
+  int i;
+  int nb_args=lua_gettop(L);
+  
+  LUA_ARG_LIMIT (1, "mappicture");
+  if (!lua_istable(L, 1))
+    return luaL_error(L, "mappicture: Argument 1 is not a table.");
+  
+  // Colors missing from the table are kept
+  for (i = 0; i < 256; i++)
+  {
+    lua_rawgeti(L, 1, i);
+    if (lua_isnil(L, -1))
+      conversion_table[i] = i;
+    else if (lua_isnumber(L, -1))
+    {
+      double value = lua_tonumber(L, -1);
+
+      if (value < 0 || value > 255)
+        return luaL_error(L, "mappicture: Entry %d of the table was out of range, it had value of %f and should be between 0 and 255.", i, value);
+      conversion_table[i] = (byte)value;
+    }
+    else
+      return luaL_error(L, "mappicture: Entry %d of the table is not a number.", i);
+    lua_pop(L, 1);
+  }
+  Remap_general_lowlevel(conversion_table,
+    Main.backups->Pages->Image[Main.current_layer].Pixels,
+    Main.backups->Pages->Image[Main.current_layer].Pixels,
+    Main.image_width, Main.image_height, Main.image_width);
+  Redraw_layered_image();
+  
+  return 0; // no values returned for lua
+}
+
 int L_PutSparePicturePixel(lua_State* L)
 {
   int x;
@@ -721,6 +882,38 @@ int L_GetLayerPixel(lua_State* L)
   return 1;
 }
 
+int L_GetPictureBlock(lua_State* L)
+{
+  int x;
+  int y;
+  int w;
+  int h;
+  int nb_args=lua_gettop(L);
+  
+  LUA_ARG_LIMIT (4, "getpictureblock");
+  LUA_ARG_BLOCK("getpictureblock", x, y, w, h);
+  
+  // Outside the image: the image's transparent color
+  Push_pixel_block(L, Main_screen, Main.image_width, Main.image_height, x, y, w, h, Main.backups->Pages->Transparent_color);
+  return 1;
+}
+
+int L_GetLayerBlock(lua_State* L)
+{
+  int x;
+  int y;
+  int w;
+  int h;
+  int nb_args=lua_gettop(L);
+  
+  LUA_ARG_LIMIT (4, "getlayerblock");
+  LUA_ARG_BLOCK("getlayerblock", x, y, w, h);
+  
+  // Outside the image: the image's transparent color
+  Push_pixel_block(L, Main.backups->Pages->Image[Main.current_layer].Pixels, Main.image_width, Main.image_height, x, y, w, h, Main.backups->Pages->Transparent_color);
+  return 1;
+}
+
 // Spare
 
 int L_GetSparePictureSize(lua_State* L)
@@ -809,6 +1002,7 @@ int L_SetColor(lua_State* L)
   Main.palette[c].R=Round_palette_component(clamp_byte(r));
   Main.palette[c].G=Round_palette_component(clamp_byte(g));
   Main.palette[c].B=Round_palette_component(clamp_byte(b));
+  Invalidate_best_color_cache();
   // Set_color(c, r, g, b); Not needed. Update screen when script is finished
   Palette_has_changed=1;
   return 0;
@@ -2147,11 +2341,15 @@ DECLARE_UNSAVED(L_DrawDisk)
 DECLARE_UNSAVED(L_DrawFilledRect)
 DECLARE_UNSAVED(L_DrawLine)
 DECLARE_UNSAVED(L_PutPicturePixel)
+DECLARE_UNSAVED(L_PutPictureBlock)
+DECLARE_UNSAVED(L_MapPicture)
 
 /// Bindings for screen-drawing Lua functions, if the current image is backed up.
 void Register_main_writable(lua_State* L)
 {
   lua_register(L,"putpicturepixel",L_PutPicturePixel);
+  lua_register(L,"putpictureblock",L_PutPictureBlock);
+  lua_register(L,"mappicture",L_MapPicture);
   lua_register(L,"drawline",L_DrawLine);
   lua_register(L,"drawfilledrect",L_DrawFilledRect);
   lua_register(L,"drawcircle",L_DrawCircle);
@@ -2163,6 +2361,8 @@ void Register_main_writable(lua_State* L)
 void Register_main_readonly(lua_State* L)
 {
   lua_register(L,"putpicturepixel",L_PutPicturePixel_unsaved);
+  lua_register(L,"putpictureblock",L_PutPictureBlock_unsaved);
+  lua_register(L,"mappicture",L_MapPicture_unsaved);
   lua_register(L,"drawline",L_DrawLine_unsaved);
   lua_register(L,"drawfilledrect",L_DrawFilledRect_unsaved);
   lua_register(L,"drawcircle",L_DrawCircle_unsaved);
@@ -2359,35 +2559,12 @@ void Highlight_script(T_Fileselector *selector, T_List_button *list, const char
 
 static char * Last_run_script = NULL;
 
-// Before: Cursor hidden
-// After: Cursor shown
-void Run_script(const char *script_subdirectory, const char *script_filename)
+/// Create a Lua state with LUA_PATH set and all the GrafX2 functions registered.
+/// @return NULL if out of memory
+static lua_State * Init_script_state(void)
 {
   lua_State* L;
-  const char* message;
-  byte  old_cursor_shape = Cursor_shape;
   char * path;
-  int original_image_width = Main.image_width;
-  int original_image_height = Main.image_height;
-  int original_current_layer = Main.current_layer;
-
-  // Some scripts are slow
-  Cursor_shape = CURSOR_SHAPE_HOURGLASS;
-  Display_cursor();
-  Flush_update();
-  Cursor_is_visible=1;
-
-  free(Last_run_script);
-  if (script_subdirectory && script_subdirectory[0]!='\0')
-    Last_run_script = Filepath_append_to_dir(script_subdirectory, script_filename);
-  else
-    Last_run_script = strdup(script_filename);
-  
-  // This chdir is for the script's sake. Grafx2 itself will (try to)
-  // not rely on what is the system's current directory.
-  path = Extract_path(NULL, Last_run_script);
-  Change_directory(path);
-  free(path);
 
   L = luaL_newstate(); // used to be lua_open() on Lua 5.1, deprecated on 5.2
 
@@ -2395,7 +2572,10 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   /// done once at the start of the program
   path = GFX2_malloc(strlen(Data_directory) + strlen(SCRIPTS_SUBDIRECTORY) + strlen(LUALIB_SUBDIRECTORY) + 5 + 3 * strlen(PATH_SEPARATOR) + 9 + 1);
   if (path == NULL)
-    return;
+  {
+    lua_close(L);
+    return NULL;
+  }
   strcpy(path, Data_directory);
   Append_path(path, SCRIPTS_SUBDIRECTORY, NULL);
   Append_path(path, LUALIB_SUBDIRECTORY, NULL);
@@ -2423,14 +2603,18 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   
   // Drawing
   lua_register(L,"putbrushpixel",L_PutBrushPixel);
+  lua_register(L,"putbrushblock",L_PutBrushBlock);
   lua_register(L,"putsparepicturepixel",L_PutSparePicturePixel);
   Register_main_readonly(L);
 
   // Reading pixels
   lua_register(L,"getbrushpixel",L_GetBrushPixel);
+  lua_register(L,"getbrushblock",L_GetBrushBlock);
   lua_register(L,"getbrushbackuppixel",L_GetBrushBackupPixel);
   lua_register(L,"getpicturepixel",L_GetPicturePixel);
+  lua_register(L,"getpictureblock",L_GetPictureBlock);
   lua_register(L,"getlayerpixel",L_GetLayerPixel);
+  lua_register(L,"getlayerblock",L_GetLayerBlock);
   lua_register(L,"getbackuppixel",L_GetBackupPixel);
   lua_register(L,"getsparelayerpixel",L_GetSpareLayerPixel);
   lua_register(L,"getsparepicturepixel",L_GetSparePicturePixel);
@@ -2508,6 +2692,43 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   //luaopen_debug(L);
   */
 
+  return L;
+}
+
+// Before: Cursor hidden
+// After: Cursor shown
+void Run_script(const char *script_subdirectory, const char *script_filename)
+{
+  lua_State* L;
+  const char* message;
+  byte  old_cursor_shape = Cursor_shape;
+  char * path;
+  int original_image_width = Main.image_width;
+  int original_image_height = Main.image_height;
+  int original_current_layer = Main.current_layer;
+
+  // Some scripts are slow
+  Cursor_shape = CURSOR_SHAPE_HOURGLASS;
+  Display_cursor();
+  Flush_update();
+  Cursor_is_visible=1;
+
+  free(Last_run_script);
+  if (script_subdirectory && script_subdirectory[0]!='\0')
+    Last_run_script = Filepath_append_to_dir(script_subdirectory, script_filename);
+  else
+    Last_run_script = strdup(script_filename);
+  
+  // This chdir is for the script's sake. Grafx2 itself will (try to)
+  // not rely on what is the system's current directory.
+  path = Extract_path(NULL, Last_run_script);
+  Change_directory(path);
+  free(path);
+
+  L = Init_script_state();
+  if (L == NULL)
+    return;
+
   // TODO The script may modify the picture, so we do a backup here.
   // If the script is only touching the brush, this isn't needed...
   // The backup also allows the script to read from it to make something
@@ -2616,6 +2837,124 @@ void Run_script(const char *script_subdirectory, const char *script_filename)
   Display_cursor();
 }
 
+/// Replaces the functions which need user input, in batch mode.
+/// The function name is the upvalue.
+static int L_Unavailable_in_batch(lua_State* L)
+{
+  return luaL_error(L, "%s: not available in batch mode", lua_tostring(L, lua_upvalueindex(1)));
+}
+
+/// Replaces the functions which only refresh the screen, in batch mode.
+static int L_Ignored_in_batch(lua_State* L)
+{
+  (void)L;
+  return 0;
+}
+
+/// messagebox() in batch mode: the message goes to the standard output.
+static int L_MessageBox_batch(lua_State* L)
+{
+  const char * caption;
+  const char * message;
+  int nb_args = lua_gettop (L);
+
+  if (nb_args == 1)
+  {
+    caption = "Script message";
+    LUA_ARG_STRING(1, "messagebox", message);
+  }
+  else if (nb_args == 2)
+  {
+    LUA_ARG_STRING(1, "messagebox", caption);
+    LUA_ARG_STRING(2, "messagebox", message);
+  }
+  else
+  {
+    return luaL_error(L, "messagebox: Needs one or two arguments.");
+  }
+  printf("%s: %s\n", caption, message);
+  return 0;
+}
+
+int Run_script_batch(const char *script_filename)
+{
+  static const char * const unavailable[] = {
+    "inputbox", "selectbox", "waitbreak", "waitinput",
+    "windowopen", "windowclose", "windowdodialog", "windowbutton",
+    "windowrepeatbutton", "windowinput", "windowreadline", "windowprint",
+    "windowslider", "windowmoveslider"
+  };
+  lua_State* L;
+  const char* message;
+  char * path;
+  int i;
+  int error = 0;
+
+  free(Last_run_script);
+  Last_run_script = strdup(script_filename);
+
+  path = Extract_path(NULL, Last_run_script);
+  Change_directory(path);
+  free(path);
+
+  L = Init_script_state();
+  if (L == NULL)
+    return 1;
+
+  for (i = 0; i < (int)(sizeof(unavailable)/sizeof(unavailable[0])); i++)
+  {
+    lua_pushstring(L, unavailable[i]);
+    lua_pushcclosure(L, L_Unavailable_in_batch, 1);
+    lua_setglobal(L, unavailable[i]);
+  }
+  lua_register(L,"messagebox",L_MessageBox_batch);
+  lua_register(L,"statusmessage",L_Ignored_in_batch);
+  lua_register(L,"updatescreen",L_Ignored_in_batch);
+  lua_register(L,"wait",L_Ignored_in_batch);
+
+  Is_backed_up = 0;
+  Main_backup_page = Main.backups->Pages;
+  Main_backup_screen = Main_screen;
+  Backup_the_spare(LAYER_ALL);
+
+  Palette_has_changed=0;
+  Brush_was_altered=0;
+  Original_back_color=Back_color;
+  Original_fore_color=Fore_color;
+
+  Brush_backup=(byte *)GFX2_malloc(((long)Brush_height)*Brush_width);
+  Brush_backup_width = Brush_width;
+  Brush_backup_height = Brush_height;
+  if (Brush_backup == NULL)
+    error = 1;
+  else
+  {
+    memcpy(Brush_backup, Brush, ((long)Brush_height)*Brush_width);
+
+    if (luaL_loadfile(L, Last_run_script) != 0 || lua_pcall(L, 0, 0, 0) != 0)
+    {
+      int stack_size;
+      stack_size= lua_gettop(L);
+      if (stack_size>0 && (message = lua_tostring(L, stack_size))!=NULL)
+        GFX2_Log(GFX2_ERROR, "%s\n", message);
+      else
+        GFX2_Log(GFX2_ERROR, "Unknown error running script %s\n", script_filename);
+      error = 1;
+    }
+  }
+  free(Brush_backup);
+  Brush_backup=NULL;
+  Palette_has_changed=0;
+  if (Is_backed_up)
+    End_of_modification();
+
+  lua_close(L);
+
+  if (Brush_was_altered)
+    memcpy(Brush_original_pixels, Brush, (long)Brush_width*Brush_height);
+  return error;
+}
+
 void Run_numbered_script(byte index)
 {
 
@@ -2932,6 +3271,12 @@ void Button_Brush_Factory(void)
     Verbose_message("Error!", "The brush factory is not available in this build of GrafX2.");
 }
 
+int Run_script_batch(const char *script_filename)
+{
+  GFX2_Log(GFX2_ERROR, "Cannot run %s: scripts are not available in this build of GrafX2.\n", script_filename);
+  return 1;
+}
+
 ///
 /// Returns a string stating the included Lua engine version,
 /// or "Disabled" if Grafx2 is compiled without Lua.
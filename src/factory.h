@@ -15,6 +15,13 @@ extern char * Bound_script[10];
 /// After: Cursor shown
 void Run_numbered_script(byte index);
 
+///
+/// Run a lua script on the main page, without the GUI (batch mode).
+/// The functions which need user input raise an error, and error
+/// messages are written to the standard error.
+/// @return 0 on success
+int Run_script_batch(const char *script_filename);
+
 ///
 /// Returns a string stating the included Lua engine version,
 /// or "Disabled" if Grafx2 is compiled without Lua.
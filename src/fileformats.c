@@ -864,6 +864,7 @@ static void Load_BMP_Pixels(T_IO_Context * context, FILE * file, unsigned int co
   int bits[4];
   int shift[4];
   int i;
+  byte * line = NULL; // one line of pixels for Set_pixel_row()
 
   // compute bit count and shift for masks
   for (i = 0; i < 4; i++)
@@ -884,6 +885,15 @@ static void Load_BMP_Pixels(T_IO_Context * context, FILE * file, unsigned int co
   {
     case 0 :  // BI_RGB : No compression
     case 3 :  // BI_BITFIELDS
+      if (nbbits <= 8)
+      {
+        line = (byte *)malloc(context->Width + 1);
+        if (line == NULL)
+        {
+          File_error = 1;
+          return;
+        }
+      }
       for (y_pos=0; (y_pos < context->Height && !File_error); y_pos++)
       {
         short target_y;
@@ -892,21 +902,19 @@ static void Load_BMP_Pixels(T_IO_Context * context, FILE * file, unsigned int co
         switch (nbbits)
         {
           case 8 :
-            for (x_pos = 0; x_pos < context->Width; x_pos++)
-            {
-              if (!Read_byte(file, &value))
-                File_error = 2;
-              Set_pixel(context, x_pos, target_y, value);
-            }
+            if (!Read_bytes(file, line, context->Width))
+              File_error = 2;
+            Set_pixel_row(context, 0, target_y, context->Width, line);
             break;
           case 4 :
             for (x_pos = 0; x_pos < context->Width; )
             {
               if (!Read_byte(file, &value))
                 File_error = 2;
-              Set_pixel(context, x_pos++, target_y, (value >> 4) & 0x0F);
-              Set_pixel(context, x_pos++, target_y, value & 0x0F);
+              line[x_pos++] = (value >> 4) & 0x0F;
+              line[x_pos++] = value & 0x0F;
             }
+            Set_pixel_row(context, 0, target_y, context->Width, line);
             break;
           case 2:
             for (x_pos = 0; x_pos < context->Width; x_pos++)
@@ -916,9 +924,10 @@ static void Load_BMP_Pixels(T_IO_Context * context, FILE * file, unsigned int co
                 if (!Read_byte(file, &value))
                   File_error = 2;
               }
-              Set_pixel(context, x_pos, target_y, (value >> 6) & 3);
+              line[x_pos] = (value >> 6) & 3;
               value <<= 2;
             }
+            Set_pixel_row(context, 0, target_y, context->Width, line);
             break;
           case 1 :
             for (x_pos = 0; x_pos < context->Width; x_pos++)
@@ -934,9 +943,11 @@ static void Load_BMP_Pixels(T_IO_Context * context, FILE * file, unsigned int co
                   Set_pixel(context, x_pos, target_y, context->Transparent_color);
               }
               else
-                Set_pixel(context, x_pos, target_y, (value >> 7) & 1);
+                line[x_pos] = (value >> 7) & 1;
               value <<= 1;
             }
+            if (!(flags & LOAD_BMP_PIXEL_FLAG_TRANSP_PLANE))
+              Set_pixel_row(context, 0, target_y, context->Width, line);
             break;
           case 24:
             for (x_pos = 0; x_pos < context->Width; x_pos++)
@@ -976,6 +987,7 @@ static void Load_BMP_Pixels(T_IO_Context * context, FILE * file, unsigned int co
         if (((context->Width * nbbits + 7) >> 3) & 3)
           fseek(file, 4 - (((context->Width * nbbits + 7) >> 3) & 3), SEEK_CUR);
       }
+      free(line);
       break;
 
     case 1 : // BI_RLE8 Compression
@@ -1338,11 +1350,11 @@ void Save_BMP(T_IO_Context * context)
 {
   FILE *file;
   T_BMP_Header header;
-  short x_pos;
   short y_pos;
   long line_size;
   word index;
   byte local_palette[256][4]; // R,G,B,0
+  byte * line;
 
 
   File_error=0;
@@ -1412,9 +1424,16 @@ void Save_BMP(T_IO_Context * context)
         // ... Et Bill, il a dit: "OK les gars! Mais seulement si vous rangez
         // les pixels dans l'ordre inverse, mais que sur les Y quand-même
         // parce que faut pas pousser."
+        line = (byte *)calloc(line_size, 1); // padding bytes stay 0
+        if (line == NULL)
+          File_error = 1;
         for (y_pos=context->Height-1; ((y_pos>=0) && (!File_error)); y_pos--)
-          for (x_pos=0; x_pos<line_size; x_pos++)
-                Write_one_byte(file,Get_pixel(context, x_pos,y_pos));
+        {
+          Get_pixel_row(context, 0, y_pos, context->Width, line);
+          if (!Write_bytes(file, line, line_size))
+            File_error = 1;
+        }
+        free(line);
 
         fclose(file);
 
@@ -1885,10 +1904,17 @@ void Test_PCX(T_IO_Context * context, FILE * file)
     byte  byte_mask=(1<<depth)-1;
     byte  reduction_minus_one=reduction-1;
 
-    for (x_pos=0; x_pos<context->Width; x_pos++)
+    byte  pixels[256];
+    short i;
+
+    for (x_pos=0; x_pos<context->Width; x_pos+=i)
     {
-      color=(buffer[x_pos/reduction]>>((reduction_minus_one-(x_pos%reduction))*depth)) & byte_mask;
-      Set_pixel(context, x_pos,y_pos,color);
+      for (i=0; i<256 && x_pos+i<context->Width; i++)
+      {
+        color=(buffer[(x_pos+i)/reduction]>>((reduction_minus_one-((x_pos+i)%reduction))*depth)) & byte_mask;
+        pixels[i]=color;
+      }
+      Set_pixel_row(context, x_pos, y_pos, i, pixels);
     }
   }
 
@@ -2081,22 +2107,27 @@ void Load_PCX(T_IO_Context * context)
                       {
                         for (index=0; index<byte1; index++,position++)
                           if (position<image_size)
-                            Set_pixel(context, position%line_size,
-                                                position/line_size,
-                                                byte2);
+                          {
+                            buffer[position%line_size]=byte2;
+                            if (position%line_size == line_size-1)
+                              Set_pixel_row(context, 0, position/line_size, line_size, buffer);
+                          }
                           else
                             File_error=2;
                       }
                     }
                     else
                     {
-                      Set_pixel(context, position%line_size,
-                                          position/line_size,
-                                          byte1);
+                      buffer[position%line_size]=byte1;
+                      if (position%line_size == line_size-1)
+                        Set_pixel_row(context, 0, position/line_size, line_size, buffer);
                       position++;
                     }
                   }
                 }
+                // Incomplete last line
+                if (position%line_size != 0)
+                  Set_pixel_row(context, 0, position/line_size, position%line_size, buffer);
               }
               else                 // couleurs rangées par plans
               {
@@ -2141,8 +2172,7 @@ void Load_PCX(T_IO_Context * context)
                 if ((width_read=Read_bytes(file,buffer,line_size)))
                 {
                   if (PCX_header.Plane==1)
-                    for (x_pos=0; x_pos<context->Width;x_pos++)
-                      Set_pixel(context, x_pos,y_pos,buffer[x_pos]);
+                    Set_pixel_row(context, 0, y_pos, line_size, buffer);
                   else
                   {
                     if (PCX_header.Depth==1)
@@ -2257,6 +2287,7 @@ void Save_PCX(T_IO_Context * context)
   byte  counter;
   byte  last_pixel;
   byte  pixel_read;
+  byte * line;
 
 
 
@@ -2305,23 +2336,27 @@ void Save_PCX(T_IO_Context * context)
         Write_bytes(file,&(PCX_header.Filler),54) )
     {
       line_size=PCX_header.Bytes_per_plane_line*PCX_header.Plane;
+      line=(byte *)calloc(line_size+1, 1); // padding bytes stay 0
+      if (line == NULL)
+        File_error=1;
      
       for (y_pos=0; ((y_pos<context->Height) && (!File_error)); y_pos++)
       {
-        pixel_read=Get_pixel(context, 0,y_pos);
+        Get_pixel_row(context, 0, y_pos, context->Width, line);
+        pixel_read=line[0];
      
         // Compression et écriture de la ligne
         for (x_pos=0; ((x_pos<line_size) && (!File_error)); )
         {
           x_pos++;
           last_pixel=pixel_read;
-          pixel_read=Get_pixel(context, x_pos,y_pos);
+          pixel_read=line[x_pos];
           counter=1;
           while ( (counter<63) && (x_pos<line_size) && (pixel_read==last_pixel) )
           {
             counter++;
             x_pos++;
-            pixel_read=Get_pixel(context, x_pos,y_pos);
+            pixel_read=line[x_pos];
           }
       
           if ( (counter>1) || (last_pixel>=0xC0) )
@@ -2331,6 +2366,8 @@ void Save_PCX(T_IO_Context * context)
         }
       }
       
+      free(line);
+
       // Ecriture de l'octet (12) indiquant que la palette arrive
       if (!File_error)
         Write_one_byte(file,12);
@@ -170,7 +170,9 @@ static void Recount_files(T_Fileselector *list)
   list->Nb_directories=0;
   list->Nb_elements=0;
   
-  for (item = list->First; item != NULL; item = item->Next)
+  // The counts are 16 bits : in a huge directory, only the first
+  // 65535 items (after sorting) can be displayed.
+  for (item = list->First; item != NULL && list->Nb_elements < 0xFFFF; item = item->Next)
   {
     if (item->Type == FSOBJECT_FILE)
       list->Nb_files ++;
@@ -193,7 +195,7 @@ static void Recount_files(T_Fileselector *list)
     if (list->Index)
     {
       // Fill the index
-      for (item = list->First, i=0; item != NULL; item = item->Next, i++)
+      for (item = list->First, i=0; i < list->Nb_elements; item = item->Next, i++)
       {
         list->Index[i] = item;
       }
@@ -657,114 +659,114 @@ static int Windows_Path_Compare(const char * s1, const char * s2)
 #endif
 
 
+/**
+ * Compare two items of a file/directory list.
+ *
+ * Drives go at the top of the list, then directories, then files.
+ * Within the same type, the parent directory always goes first, and the
+ * other items are in alphabetical order.
+ * @return a negative value if item1 should be placed before item2,
+ *         a positive value if it should be placed after, 0 otherwise.
+ */
+static int Compare_list_items(const T_Fileselector_item * item1, const T_Fileselector_item * item2)
+{
+  if (item1->Type != item2->Type)
+    return (int)item2->Type - (int)item1->Type;
+  if (FILENAME_COMPARE(item2->Full_name, PARENT_DIR) == 0)
+    return (FILENAME_COMPARE(item1->Full_name, PARENT_DIR) == 0) ? 0 : 1;
+  if (FILENAME_COMPARE(item1->Full_name, PARENT_DIR) == 0)
+    return -1;
+  // compare unicode file names if they are available
+  if (item1->Unicode_full_name != NULL && item2->Unicode_full_name != NULL)
+    return FILENAME_COMPARE_UNICODE(item1->Unicode_full_name, item2->Unicode_full_name);
+  return FILENAME_COMPARE(item1->Full_name, item2->Full_name);
+}
+
 /**
  * Sort a file/directory list.
  * The sord is done in that order :
  * Directories first, in alphabetical order,
  * then Files, in alphabetical order.
  *
+ * This is a bottom-up merge sort working directly on the linked list :
+ * it is stable, needs no extra memory, and runs in O(n log n) so that
+ * directories with tens of thousands of files are sorted quickly.
+ *
  * List counts and index are updated.
  * @param list the linked list
  */
 void Sort_list_of_files(T_Fileselector *list)
 {
-  byte   list_is_sorted; // Booléen "La liste est triée"
-  byte   need_swap;          // Booléen "Il faut inverser les éléments"
+  T_Fileselector_item * sorted = list->First;
+  T_Fileselector_item * item;
   T_Fileselector_item * prev_item;
-  T_Fileselector_item * current_item;
-  T_Fileselector_item * next_item;
-  T_Fileselector_item * next_to_next_item;
+  unsigned long run_length;
+  unsigned long nb_merges;
 
   // Check there are at least two elements before sorting
-  if (list->First && list->First->Next)
+  if (sorted == NULL || sorted->Next == NULL)
   {
-    do
-    {
-      // Par défaut, on considère que la liste est triée
-      list_is_sorted=1;
-
-      current_item=list->First;
-      next_item=current_item->Next;
+    Recount_files(list);
+    return;
+  }
 
-      while ( (current_item!=NULL) && (next_item!=NULL) )
-      {
-        // On commence par supposer qu'il n'y pas pas besoin d'inversion
-        need_swap=0;
-
-        // Ensuite, on vérifie si les deux éléments sont bien dans l'ordre ou
-        // non:
-
-          // Drives go at the top of the list, and files go after them
-        if ( (int)current_item->Type < (int)next_item->Type )
-          need_swap=1;
-          // If both elements have the same type, compare the file names, if
-		  // current is alphabetically before, we need to swap, unless it is
-          // parent directory, which should always go first
-        else if (current_item->Type == next_item->Type)
-        {
-          if (FILENAME_COMPARE(next_item->Full_name, PARENT_DIR) == 0)
-            need_swap = 1;
-          else if (FILENAME_COMPARE(current_item->Full_name, PARENT_DIR) != 0)
-          {
-            if (current_item->Unicode_full_name != NULL && next_item->Unicode_full_name != NULL)
-            {
-              // compare unicode file names if they are available
-              if (FILENAME_COMPARE_UNICODE(current_item->Unicode_full_name, next_item->Unicode_full_name) > 0)
-                need_swap = 1;
-            }
-            else
-            {
-              if (FILENAME_COMPARE(current_item->Full_name, next_item->Full_name) > 0)
-                need_swap = 1;
-            }
-          }
-        }
+  // Merge runs of 1, 2, 4, ... elements until only one run is left.
+  // Only the Next links are maintained during the passes.
+  for (run_length = 1; ; run_length *= 2)
+  {
+    T_Fileselector_item * remaining = sorted;
+    T_Fileselector_item ** tail = &sorted;
 
+    nb_merges = 0;
+    while (remaining != NULL)
+    {
+      T_Fileselector_item * left = remaining;
+      T_Fileselector_item * right = remaining;
+      unsigned long left_size = 0;
+      unsigned long right_size = run_length;
 
-        if (need_swap)
+      nb_merges++;
+      while (right != NULL && left_size < run_length)
+      {
+        right = right->Next;
+        left_size++;
+      }
+      // Merge the two runs. On equality, the left item goes first so the
+      // sort is stable.
+      while (left_size > 0 || (right_size > 0 && right != NULL))
+      {
+        if (left_size == 0 || (right_size > 0 && right != NULL
+            && Compare_list_items(right, left) < 0))
         {
-          // Si les deux éléments nécessitent d'être inversé:
-
-          // On les inverses:
-
-          // On note avant tout les éléments qui encapsulent nos deux amis
-          prev_item         =current_item->Previous;
-          next_to_next_item=next_item->Next;
-
-          // On permute le chaînage des deux éléments entree eux
-          current_item->Next  =next_to_next_item;
-          current_item->Previous=next_item;
-          next_item->Next  =current_item;
-          next_item->Previous=prev_item;
-
-          // On tente un chaînage des éléments encapsulant les compères:
-          if (prev_item!=NULL)
-            prev_item->Next=next_item;
-          if (next_to_next_item!=NULL)
-            next_to_next_item->Previous=current_item;
-
-          // On fait bien attention à modifier la tête de liste en cas de besoin
-          if (current_item==list->First)
-            list->First=next_item;
-
-          // Ensuite, on se prépare à étudier les éléments précédents:
-          current_item=prev_item;
-
-          // Et on constate que la liste n'était pas encore génialement triée
-          list_is_sorted=0;
+          item = right;
+          right = right->Next;
+          right_size--;
         }
         else
         {
-          // Si les deux éléments sont dans l'ordre:
-
-          // On passe aux suivants
-          current_item=current_item->Next;
-          next_item=next_item->Next;
+          item = left;
+          left = left->Next;
+          left_size--;
         }
+        *tail = item;
+        tail = &item->Next;
       }
+      remaining = right;
     }
-    while (!list_is_sorted);
+    *tail = NULL;
+    if (nb_merges <= 1)
+      break;
   }
+
+  // Rebuild the Previous links
+  prev_item = NULL;
+  for (item = sorted; item != NULL; item = item->Next)
+  {
+    item->Previous = prev_item;
+    prev_item = item;
+  }
+  list->First = sorted;
+
   // Force a recount / re-index
   Recount_files(list);
 }
@@ -2384,7 +2386,10 @@ byte Button_Load_or_Save(T_Selector_settings *settings, byte load, T_IO_Context
         if (context->Type == CONTEXT_PALETTE)
           preview_context.Type = CONTEXT_PREVIEW_PALETTE;
 
-        Load_image(&preview_context);
+        if (load_from_clipboard)
+          Load_image(&preview_context);
+        else
+          Load_image_preview(&preview_context);
         if (load_from_clipboard && (preview_context.File_directory != NULL))
         {
           short pos;
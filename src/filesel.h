@@ -42,6 +42,12 @@ void Free_fileselector_list(T_Fileselector *list);
 
 void Sort_list_of_files(T_Fileselector *list);
 
+///
+/// Checks if a file has the requested file extension.
+/// The extension string can end with a ';' (remainder is ignored).
+/// This function allows wildcard '?', and '*' if it's the only character.
+int Check_extension(const char *filename_ext, const char * filter);
+
 ///
 /// Fast access to a list item.
 /// @param list the linked list
@@ -75,3 +75,88 @@ void Set_GFX2_Surface_pixel(T_GFX2_Surface * surface, int x, int y, byte value)
   }
   surface->pixels[x + surface->w * y] = value;
 }
+
+/// Starting point of a span to fill, see Fill_GFX2_Surface()
+typedef struct
+{
+  int x;
+  int y;
+} T_Fill_seed;
+
+int Fill_GFX2_Surface(T_GFX2_Surface * surface, int x, int y, byte old_color, byte new_color,
+                      int * left, int * top, int * right, int * bottom)
+{
+  T_Fill_seed * stack;
+  size_t capacity = 256;
+  size_t count = 0;
+  int min_x = x, max_x = x, min_y = y, max_y = y;
+
+  stack = GFX2_malloc(capacity * sizeof(T_Fill_seed));
+  if (stack == NULL)
+    return -1;
+  stack[count].x = x;
+  stack[count].y = y;
+  count++;
+
+  while (count > 0)
+  {
+    T_Fill_seed seed = stack[--count];
+    byte * row = surface->pixels + seed.y * surface->w;
+    int x1, x2;
+    int line;
+
+    if (row[seed.x] != old_color)
+      continue; // already filled from another seed
+
+    // Extend the span to the left and to the right, and fill it
+    for (x1 = seed.x; x1 > *left && row[x1 - 1] == old_color; x1--);
+    for (x2 = seed.x; x2 < *right && row[x2 + 1] == old_color; x2++);
+    memset(row + x1, new_color, x2 - x1 + 1);
+
+    if (x1 < min_x) min_x = x1;
+    if (x2 > max_x) max_x = x2;
+    if (seed.y < min_y) min_y = seed.y;
+    if (seed.y > max_y) max_y = seed.y;
+
+    // One seed for each run of old_color, in the lines above and below
+    for (line = seed.y - 1; line <= seed.y + 1; line += 2)
+    {
+      const byte * next_row;
+      int i;
+
+      if (line < *top || line > *bottom)
+        continue;
+      next_row = surface->pixels + line * surface->w;
+      for (i = x1; i <= x2; i++)
+      {
+        if (next_row[i] != old_color)
+          continue;
+        if (count >= capacity)
+        {
+          T_Fill_seed * new_stack = realloc(stack, 2 * capacity * sizeof(T_Fill_seed));
+          if (new_stack == NULL)
+          {
+            GFX2_Log(GFX2_ERROR, "Fill_GFX2_Surface() failed to grow stack to %lu seeds\n", (unsigned long)(2 * capacity));
+            free(stack);
+            return -1;
+          }
+          stack = new_stack;
+          capacity *= 2;
+        }
+        stack[count].x = i;
+        stack[count].y = line;
+        count++;
+        // skip the rest of the run
+        while (i < x2 && next_row[i + 1] == old_color)
+          i++;
+      }
+    }
+  }
+  free(stack);
+
+  *left = min_x;
+  *right = max_x;
+  *top = min_y;
+  *bottom = max_y;
+  return 0;
+}
@@ -68,4 +68,21 @@ byte Get_GFX2_Surface_pixel(const T_GFX2_Surface * surface, int x, int y);
  */
 void Set_GFX2_Surface_pixel(T_GFX2_Surface * surface, int x, int y, byte value);
 
+/**
+ * Flood fill of a 4-connected area, one horizontal span at a time.
+ *
+ * All pixels of color old_color connected to (x,y) get new_color.
+ * The fill doesn't go outside the rectangle (left,top)-(right,bottom).
+ * @param surface The surface to fill
+ * @param x, y the coordinate of the starting pixel
+ * @param old_color the color of the area to fill
+ * @param new_color the fill color, must be different from old_color
+ * @param left, top, right, bottom limits of the fill, inclusive.
+ *        On return, the bounding box of the filled pixels.
+ * @return 0 for success
+ * @return -1 for memory allocation error, the area is then partially filled
+ */
+int Fill_GFX2_Surface(T_GFX2_Surface * surface, int x, int y, byte old_color, byte new_color,
+                      int * left, int * top, int * right, int * bottom);
+
 #endif
@@ -127,118 +127,153 @@ void Test_GIF(T_IO_Context * context, FILE * file)
 
 typedef struct {
   word nb_bits;        ///< bits for a code
-  word remainder_bits; ///< available bits in @ref last_byte field
-  byte remainder_byte; ///< Remaining bytes in current block
+  word bit_count;      ///< number of valid bits in @ref bit_buffer
+  dword bit_buffer;    ///< bits read but not yet decoded, or encoded but not yet written
+  word block_size;     ///< Number of data bytes in @ref block
+  word block_pos;      ///< Position of the next byte to read in @ref block
+  byte block[256];     ///< Current data sub-block. When saving, the data starts at index 1.
   word current_code;   ///< current code (generally the one just read)
-  byte last_byte;      ///< buffer byte for reading bits for codes
   word pos_X;          ///< Current coordinates
   word pos_Y;
   word interlaced;     ///< interlaced flag
   word pass;           ///< current pass in interlaced decoding
   word stop;           ///< Stop flag (end of picture)
+  byte * line;         ///< Pixels of the current line, sent with Set_pixel_row() or read with Get_pixel_row()
 } T_GIF_context;
 
 
 /// Reads the next code (GIF.nb_bits bits)
+///
+/// A whole data sub-block is read at once, and its bytes are fed into a
+/// bit accumulator.
 static word GIF_get_next_code(FILE * GIF_file, T_GIF_context * gif)
 {
-  word nb_bits_to_process = gif->nb_bits;
-  word nb_bits_processed = 0;
-  word current_nb_bits;
-
-  gif->current_code = 0;
-
-  while (nb_bits_to_process)
+  while (gif->bit_count < gif->nb_bits)
   {
-    if (gif->remainder_bits == 0) // Il ne reste plus de bits...
+    if (gif->block_pos >= gif->block_size)
     {
-      // Lire l'octet suivant:
+      byte size;
 
-      // Si on a atteint la fin du bloc de Raster Data
-      if (gif->remainder_byte == 0)
+      // Lire l'octet nous donnant la taille du bloc de Raster Data suivant
+      if(Read_byte(GIF_file, &size)!=1)
       {
-        // Lire l'octet nous donnant la taille du bloc de Raster Data suivant
-        if(Read_byte(GIF_file, &gif->remainder_byte)!=1)
-        {
-          File_error=2;
-          return 0;
-        }
-        if (gif->remainder_byte == 0) // still nothing ? That is the end data block
-        {
-          File_error = 2;
-          GFX2_Log(GFX2_WARNING, "GIF 0 sized data block\n");
-          return gif->current_code;
-        }
+        File_error=2;
+        return 0;
+      }
+      if (size == 0) // still nothing ? That is the end data block
+      {
+        File_error = 2;
+        GFX2_Log(GFX2_WARNING, "GIF 0 sized data block\n");
+        gif->current_code = (word)gif->bit_buffer;
+        return gif->current_code;
       }
-      if(Read_byte(GIF_file,&gif->last_byte)!=1)
+      // A truncated file gives a shorter block
+      gif->block_size = (word)fread(gif->block, 1, size, GIF_file);
+      gif->block_pos = 0;
+      if (gif->block_size == 0)
       {
         File_error = 2;
         GFX2_Log(GFX2_ERROR, "GIF failed to load data byte\n");
         return 0;
       }
-      gif->remainder_byte--;
-      gif->remainder_bits=8;
     }
-
-    current_nb_bits=(nb_bits_to_process<=gif->remainder_bits)?nb_bits_to_process:gif->remainder_bits;
-
-    gif->current_code |= (gif->last_byte & ((1<<current_nb_bits)-1))<<nb_bits_processed;
-    gif->last_byte >>= current_nb_bits;
-    nb_bits_processed += current_nb_bits;
-    nb_bits_to_process -= current_nb_bits;
-    gif->remainder_bits -= current_nb_bits;
+    gif->bit_buffer |= (dword)gif->block[gif->block_pos++] << gif->bit_count;
+    gif->bit_count += 8;
   }
 
+  gif->current_code = (word)(gif->bit_buffer & ((1 << gif->nb_bits) - 1));
+  gif->bit_buffer >>= gif->nb_bits;
+  gif->bit_count -= gif->nb_bits;
   return gif->current_code;
 }
 
-/// Put a new pixel
-static void GIF_new_pixel(T_IO_Context * context, T_GIF_context * gif, T_GIF_IDB *idb, int is_transparent, byte color)
+/// Send the first @p width pixels of the current line to the image.
+/// Transparent pixels are skipped, so the previous frame shows through.
+static void GIF_flush_line(T_IO_Context * context, T_GIF_context * gif, T_GIF_IDB *idb, int is_transparent, word width)
 {
-  if (!is_transparent || color!=context->Transparent_color)
-    Set_pixel(context, idb->Pos_X+gif->pos_X, idb->Pos_Y+gif->pos_Y,color);
+  word x, start;
 
-  gif->pos_X++;
-
-  if (gif->pos_X >= idb->Image_width)
+  if (!is_transparent)
+  {
+    Set_pixel_row(context, idb->Pos_X, idb->Pos_Y+gif->pos_Y, width, gif->line);
+    return;
+  }
+  for (x = 0; x < width; )
   {
-    gif->pos_X=0;
+    while (x < width && gif->line[x] == context->Transparent_color)
+      x++;
+    start = x;
+    while (x < width && gif->line[x] != context->Transparent_color)
+      x++;
+    if (x > start)
+      Set_pixel_row(context, idb->Pos_X+start, idb->Pos_Y+gif->pos_Y, x-start, gif->line+start);
+  }
+}
+
+/// Send the completed line to the image and go to the next one
+static void GIF_next_line(T_IO_Context * context, T_GIF_context * gif, T_GIF_IDB *idb, int is_transparent)
+{
+  GIF_flush_line(context, gif, idb, is_transparent, gif->pos_X);
+  gif->pos_X=0;
 
-    if (!gif->interlaced)
+  if (!gif->interlaced)
+  {
+    gif->pos_Y++;
+    if (gif->pos_Y >= idb->Image_height)
+      gif->stop = 1;
+  }
+  else
+  {
+    switch (gif->pass)
     {
-      gif->pos_Y++;
-      if (gif->pos_Y >= idb->Image_height)
-        gif->stop = 1;
+      case 0 :
+      case 1 : gif->pos_Y+=8;
+               break;
+      case 2 : gif->pos_Y+=4;
+               break;
+      default: gif->pos_Y+=2;
     }
-    else
+
+    if (gif->pos_Y >= idb->Image_height)
     {
-      switch (gif->pass)
+      switch(++(gif->pass))
       {
-        case 0 :
-        case 1 : gif->pos_Y+=8;
-                 break;
-        case 2 : gif->pos_Y+=4;
-                 break;
-        default: gif->pos_Y+=2;
-      }
-
-      if (gif->pos_Y >= idb->Image_height)
-      {
-        switch(++(gif->pass))
-        {
-        case 1 : gif->pos_Y=4;
-                 break;
-        case 2 : gif->pos_Y=2;
-                 break;
-        case 3 : gif->pos_Y=1;
-                 break;
-        case 4 : gif->stop = 1;
-        }
+      case 1 : gif->pos_Y=4;
+               break;
+      case 2 : gif->pos_Y=2;
+               break;
+      case 3 : gif->pos_Y=1;
+               break;
+      case 4 : gif->stop = 1;
       }
     }
   }
 }
 
+/// Put new pixels in the current line.
+///
+/// The pixels can already be at their place in GIF.line, in which case
+/// they are not copied.
+static void GIF_new_pixels(T_IO_Context * context, T_GIF_context * gif, T_GIF_IDB *idb, int is_transparent, const byte * pixels, word count)
+{
+  while (count > 0 && !gif->stop)
+  {
+    word n = idb->Image_width - gif->pos_X;
+
+    if (n > count)
+      n = count;
+    else if (n == 0)
+      n = 1;  // zero width image : each pixel ends a line
+    if (pixels != gif->line + gif->pos_X)
+      memcpy(gif->line + gif->pos_X, pixels, n);
+    gif->pos_X += n;
+    pixels += n;
+    count -= n;
+    if (gif->pos_X >= idb->Image_width)
+      GIF_next_line(context, gif, idb, is_transparent);
+  }
+}
+
 
 /// Load GIF file
 void Load_GIF(T_IO_Context * context)
@@ -247,12 +282,12 @@ void Load_GIF(T_IO_Context * context)
   int image_mode = -1;
   char signature[6];
 
-  word * alphabet_stack;     // Pile de décodage d'une chaîne
+  byte * alphabet_string;  // Buffer where a string is decoded when it doesn't fit in the line
   word * alphabet_prefix;  // Table des préfixes des codes
-  word * alphabet_suffix;  // Table des suffixes des codes
+  byte * alphabet_suffix;  // Table des suffixes des codes
+  word * alphabet_length;  // Length of the string of each code
   word   alphabet_free;     // Position libre dans l'alphabet
   word   alphabet_max;      // Nombre d'entrées possibles dans l'alphabet
-  word   alphabet_stack_pos; // Position dans la pile de décodage d'un chaîne
 
   T_GIF_context GIF;
   T_GIF_LSDB LSDB;
@@ -298,9 +333,11 @@ void Load_GIF(T_IO_Context * context)
     {
 
       // Allocation de mémoire pour les tables & piles de traitement:
-      alphabet_stack  = (word *)GFX2_malloc(4096*sizeof(word));
+      alphabet_string = (byte *)GFX2_malloc(4096);
       alphabet_prefix = (word *)GFX2_malloc(4096*sizeof(word));
-      alphabet_suffix = (word *)GFX2_malloc(4096*sizeof(word));
+      alphabet_suffix = (byte *)GFX2_malloc(4096);
+      alphabet_length = (word *)GFX2_malloc(4096*sizeof(word));
+      GIF.line = (byte *)GFX2_malloc(65536);
 
       if (Read_word_le(GIF_file,&(LSDB.Width))
       && Read_word_le(GIF_file,&(LSDB.Height))
@@ -349,7 +386,8 @@ void Load_GIF(T_IO_Context * context)
         }
 
         // On lit un indicateur de block
-        Read_byte(GIF_file,&block_identifier);
+        if (!Read_byte(GIF_file,&block_identifier))
+          File_error=2;
         while (block_identifier!=0x3B && !File_error)
         {
           switch (block_identifier)
@@ -627,6 +665,12 @@ void Load_GIF(T_IO_Context * context)
                 File_error=0;
                 if (!Read_byte(GIF_file,&(initial_nb_bits)))
                   File_error=1;
+                else if (initial_nb_bits > 8)
+                {
+                  GFX2_Log(GFX2_ERROR, "Load_GIF() Invalid LZW minimum code size %u\n", initial_nb_bits);
+                  File_error=1;
+                  initial_nb_bits = 8;
+                }
 
                 value_clr    =(1<<initial_nb_bits)+0;
                 value_eof    =(1<<initial_nb_bits)+1;
@@ -646,10 +690,12 @@ void Load_GIF(T_IO_Context * context)
 
                 GIF.pos_X=0;
                 GIF.pos_Y=0;
-                alphabet_stack_pos=0;
-                GIF.last_byte    =0;
-                GIF.remainder_bits    =0;
-                GIF.remainder_byte    =0;
+                GIF.bit_buffer   =0;
+                GIF.bit_count    =0;
+                GIF.block_size   =0;
+                GIF.block_pos    =0;
+                for (color_index = 0; color_index < value_clr; color_index++)
+                  alphabet_length[color_index] = 1;
 
                 while ( (GIF_get_next_code(GIF_file, &GIF)!=value_eof) && (!File_error) )
                 {
@@ -661,33 +707,47 @@ void Load_GIF(T_IO_Context * context)
                   }
                   else if (GIF.current_code != value_clr)
                   {
+                    word length;
+                    byte * string;
+                    byte * p;
+
                     byte_read = GIF.current_code;
                     if (alphabet_free == GIF.current_code)
                     {
+                      // the string of the previous code, followed by its first character
                       GIF.current_code=old_code;
-                      alphabet_stack[alphabet_stack_pos++]=special_case;
+                      length = alphabet_length[old_code] + 1;
                     }
+                    else
+                      length = alphabet_length[GIF.current_code];
+
+                    // The string is written backwards from its last character.
+                    // When it fits, it is decoded straight into the line.
+                    if (GIF.pos_X + length <= IDB.Image_width)
+                      string = GIF.line + GIF.pos_X;
+                    else
+                      string = alphabet_string;
+                    p = string + length;
+                    if (byte_read != GIF.current_code)
+                      *--p = (byte)special_case;
 
                     while (GIF.current_code > value_clr)
                     {
-                      if (GIF.current_code >= 4096)
-                      {
-                        GFX2_Log(GFX2_ERROR, "Load_GIF() GIF.current_code = %u >= 4096\n", GIF.current_code);
-                        File_error = 2;
-                        break;
-                      }
-                      alphabet_stack[alphabet_stack_pos++] = alphabet_suffix[GIF.current_code];
+                      *--p = alphabet_suffix[GIF.current_code];
                       GIF.current_code = alphabet_prefix[GIF.current_code];
                     }
 
-                    special_case = alphabet_stack[alphabet_stack_pos++] = GIF.current_code;
+                    special_case = *--p = (byte)GIF.current_code;
 
-                    do
-                      GIF_new_pixel(context, &GIF, &IDB, is_transparent, alphabet_stack[--alphabet_stack_pos]);
-                    while (alphabet_stack_pos!=0);
+                    GIF_new_pixels(context, &GIF, &IDB, is_transparent, string, length);
 
-                    alphabet_prefix[alphabet_free  ]=old_code;
-                    alphabet_suffix[alphabet_free++]=GIF.current_code;
+                    // The alphabet is full : keep it until the next clear code
+                    if (alphabet_free < 4096)
+                    {
+                      alphabet_prefix[alphabet_free]=old_code;
+                      alphabet_suffix[alphabet_free]=(byte)GIF.current_code;
+                      alphabet_length[alphabet_free++]=alphabet_length[old_code] + 1;
+                    }
                     old_code=byte_read;
 
                     if (alphabet_free>alphabet_max)
@@ -710,10 +770,17 @@ void Load_GIF(T_IO_Context * context)
                       break;
                     }
                     old_code      = GIF.current_code;
-                    GIF_new_pixel(context, &GIF, &IDB, is_transparent, GIF.current_code);
+                    {
+                      byte pixel = (byte)GIF.current_code;
+                      GIF_new_pixels(context, &GIF, &IDB, is_transparent, &pixel, 1);
+                    }
                   }
                 }
 
+                // Truncated data : keep what was decoded of the last line
+                if (GIF.pos_X > 0)
+                  GIF_flush_line(context, &GIF, &IDB, is_transparent, GIF.pos_X);
+
                 if (File_error == 2 && GIF.pos_X == 0 && GIF.pos_Y == IDB.Image_height)
                   File_error=0;
 
@@ -753,10 +820,14 @@ void Load_GIF(T_IO_Context * context)
       early_exit:
 
       // Libération de la mémoire utilisée par les tables & piles de traitement:
+      free(alphabet_length);
       free(alphabet_suffix);
       free(alphabet_prefix);
-      free(alphabet_stack);
-      alphabet_suffix = alphabet_prefix = alphabet_stack = NULL;
+      free(alphabet_string);
+      alphabet_length = alphabet_prefix = NULL;
+      alphabet_suffix = alphabet_string = NULL;
+      free(GIF.line);
+      GIF.line = NULL;
     } // Le fichier contenait au moins la signature GIF87a ou GIF89a
     else
       File_error=1;
@@ -772,50 +843,35 @@ void Load_GIF(T_IO_Context * context)
 // -- Sauver un fichier au format GIF ---------------------------------------
 
 /// Flush the buffer
-static void GIF_empty_buffer(FILE * file, T_GIF_context *gif, byte * GIF_buffer)
+static void GIF_empty_buffer(FILE * file, T_GIF_context *gif)
 {
-  if (gif->remainder_byte)
+  if (gif->block_size)
   {
-    GIF_buffer[0] = gif->remainder_byte;
+    gif->block[0] = (byte)gif->block_size;
 
-    if (!Write_bytes(file, GIF_buffer, (size_t)gif->remainder_byte + 1))
+    if (!Write_bytes(file, gif->block, (size_t)gif->block_size + 1))
       File_error = 1;
 
-    gif->remainder_byte = 0;
+    gif->block_size = 0;
   }
 }
 
 /// Write a code (GIF_nb_bits bits)
-static void GIF_set_code(FILE * GIF_file, T_GIF_context * gif, byte * GIF_buffer, word Code)
+static void GIF_set_code(FILE * GIF_file, T_GIF_context * gif, word Code)
 {
-  word nb_bits_to_process = gif->nb_bits;
-  word nb_bits_processed  =0;
-  word current_nb_bits;
+  gif->bit_buffer |= (dword)Code << gif->bit_count;
+  gif->bit_count += gif->nb_bits;
 
-  while (nb_bits_to_process)
+  while (gif->bit_count >= 8)
   {
-    current_nb_bits = (nb_bits_to_process <= (8-gif->remainder_bits)) ?
-                          nb_bits_to_process: (8-gif->remainder_bits);
-
-    gif->last_byte |= (Code & ((1<<current_nb_bits)-1))<<gif->remainder_bits;
-    Code>>=current_nb_bits;
-    gif->remainder_bits    +=current_nb_bits;
-    nb_bits_processed  +=current_nb_bits;
-    nb_bits_to_process-=current_nb_bits;
-
-    if (gif->remainder_bits==8) // Il ne reste plus de bits à coder sur l'octet courant
-    {
-      // Ecrire l'octet à balancer:
-      GIF_buffer[++(gif->remainder_byte)] = gif->last_byte;
-
-      // Si on a atteint la fin du bloc de Raster Data
-      if (gif->remainder_byte==255)
-        // On doit vider le buffer qui est maintenant plein
-        GIF_empty_buffer(GIF_file, gif, GIF_buffer);
-
-      gif->last_byte=0;
-      gif->remainder_bits=0;
-    }
+    gif->block[++(gif->block_size)] = (byte)gif->bit_buffer;
+    gif->bit_buffer >>= 8;
+    gif->bit_count -= 8;
+
+    // Si on a atteint la fin du bloc de Raster Data
+    if (gif->block_size == 255)
+      // On doit vider le buffer qui est maintenant plein
+      GIF_empty_buffer(GIF_file, gif);
   }
 }
 
@@ -825,7 +881,9 @@ static byte GIF_next_pixel(T_IO_Context *context, T_GIF_context *gif, T_GIF_IDB
 {
   byte temp;
 
-  temp = Get_pixel(context, gif->pos_X, gif->pos_Y);
+  if (gif->pos_X == idb->Pos_X)
+    Get_pixel_row(context, idb->Pos_X, gif->pos_Y, idb->Image_width, gif->line);
+  temp = gif->line[gif->pos_X - idb->Pos_X];
 
   if (++gif->pos_X >= (idb->Image_width + idb->Pos_X))
   {
@@ -837,21 +895,27 @@ static byte GIF_next_pixel(T_IO_Context *context, T_GIF_context *gif, T_GIF_IDB
   return temp;
 }
 
+/// Number of entries of the hash table of the LZW encoder (a power of 2)
+#define GIF_HASH_SIZE 8192
+#define GIF_INVALID_CODE (65535)
+
+/// Slot of the (prefix, suffix) key in the hash table of the LZW encoder
+static dword GIF_hash(dword key)
+{
+  return ((key * 2654435761u) >> 19) & (GIF_HASH_SIZE - 1);
+}
+
 
 /// Save a GIF file
 void Save_GIF(T_IO_Context * context)
 {
   FILE * GIF_file;
-  byte GIF_buffer[256];   // buffer d'écriture de bloc de données compilées
 
-  word * alphabet_prefix;  // Table des préfixes des codes
-  word * alphabet_suffix;  // Table des suffixes des codes
-  word * alphabet_daughter;    // Table des chaînes filles (plus longues)
-  word * alphabet_sister;    // Table des chaînes soeurs (même longueur)
+  dword * alphabet_key;    // Hash table : (prefix << 8 | suffix) of the strings
+  word * alphabet_code;    // Hash table : codes of the strings
   word   alphabet_free;     // Position libre dans l'alphabet
   word   alphabet_max;      // Nombre d'entrées possibles dans l'alphabet
-  word   start;            // Code précédent (sert au linkage des chaînes)
-  int    descend;          // Booléen "On vient de descendre"
+  dword  key;              // (current_string, current_char) pair to look for
 
   T_GIF_context GIF;
   T_GIF_LSDB LSDB;
@@ -861,7 +925,7 @@ void Save_GIF(T_IO_Context * context)
   byte block_identifier;  // Code indicateur du type de bloc en cours
   word current_string;   // Code de la chaîne en cours de traitement
   byte current_char;         // Caractère à coder
-  word index;            // index de recherche de chaîne
+  dword index;           // index de recherche de chaîne
   int current_layer;
 
   word clear;   // LZW clear code
@@ -879,10 +943,9 @@ void Save_GIF(T_IO_Context * context)
       // La signature du fichier a été correctement écrite.
 
       // Allocation de mémoire pour les tables
-      alphabet_prefix = (word *)GFX2_malloc(4096*sizeof(word));
-      alphabet_suffix = (word *)GFX2_malloc(4096*sizeof(word));
-      alphabet_daughter = (word *)GFX2_malloc(4096*sizeof(word));
-      alphabet_sister = (word *)GFX2_malloc(4096*sizeof(word));
+      alphabet_key = (dword *)GFX2_malloc(GIF_HASH_SIZE*sizeof(dword));
+      alphabet_code = (word *)GFX2_malloc(GIF_HASH_SIZE*sizeof(word));
+      GIF.line = (byte *)GFX2_malloc(65536);
 
       // On initialise le LSDB du fichier
       if (Config.Screen_size_in_GIF)
@@ -1136,9 +1199,9 @@ void Save_GIF(T_IO_Context * context)
               // look for the maximum pixel value
               // to decide how many bit per pixel are needed.
               for(GIF.pos_Y = IDB.Pos_Y; GIF.pos_Y < IDB.Image_height + IDB.Pos_Y; GIF.pos_Y++) {
-                for(GIF.pos_X = IDB.Pos_X; GIF.pos_X < IDB.Image_width + IDB.Pos_X; GIF.pos_X++) {
-                  temp=Get_pixel(context, GIF.pos_X, GIF.pos_Y);
-                  if(temp > max) max = temp;
+                Get_pixel_row(context, IDB.Pos_X, GIF.pos_Y, IDB.Image_width, GIF.line);
+                for(GIF.pos_X = 0; GIF.pos_X < IDB.Image_width; GIF.pos_X++) {
+                  if(GIF.line[GIF.pos_X] > max) max = GIF.line[GIF.pos_X];
                 }
               }
               IDB.Nb_bits_pixel=2;  // Find the minimum bpp value to fit all pixels
@@ -1168,12 +1231,10 @@ void Save_GIF(T_IO_Context * context)
 
                 GIF.pos_X=IDB.Pos_X;
                 GIF.pos_Y=IDB.Pos_Y;
-                GIF.last_byte=0;
-                GIF.remainder_bits=0;
-                GIF.remainder_byte=0;
+                GIF.bit_buffer=0;
+                GIF.bit_count=0;
+                GIF.block_size=0;
 
-#define GIF_INVALID_CODE (65535)
-                index=GIF_INVALID_CODE;
                 File_error=0;
                 GIF.stop=0;
 
@@ -1181,73 +1242,50 @@ void Save_GIF(T_IO_Context * context)
                 alphabet_free=clear + 2;  // 258 for 8bpp
                 GIF.nb_bits  =IDB.Nb_bits_pixel + 1; // 9 for 8 bpp
                 alphabet_max =clear+clear-1;  // 511 for 8bpp
-                GIF_set_code(GIF_file, &GIF, GIF_buffer, clear);  //256 for 8bpp
-                for (start=0;start<4096;start++)
-                {
-                  alphabet_daughter[start] = GIF_INVALID_CODE;
-                  alphabet_sister[start] = GIF_INVALID_CODE;
-                }
+                GIF_set_code(GIF_file, &GIF, clear);  //256 for 8bpp
+                memset(alphabet_code, 0xff, GIF_HASH_SIZE*sizeof(word));
 
                 ////////////////////////////////////////////// COMPRESSION LZW //
 
-                start=current_string=GIF_next_pixel(context, &GIF, &IDB);
-                descend=1;
+                current_string=GIF_next_pixel(context, &GIF, &IDB);
 
                 while ((!GIF.stop) && (!File_error))
                 {
                   current_char=GIF_next_pixel(context, &GIF, &IDB);
 
                   // look for (current_string,current_char) in the alphabet
-                  while ( (index != GIF_INVALID_CODE) &&
-                          ( (current_string!=alphabet_prefix[index]) ||
-                            (current_char      !=alphabet_suffix[index]) ) )
-                  {
-                    descend=0;
-                    start=index;
-                    index=alphabet_sister[index];
-                  }
+                  key = ((dword)current_string << 8) | current_char;
+                  index = GIF_hash(key);
+                  while (alphabet_code[index] != GIF_INVALID_CODE && alphabet_key[index] != key)
+                    index = (index + 1) & (GIF_HASH_SIZE - 1);
 
-                  if (index != GIF_INVALID_CODE)
+                  if (alphabet_code[index] != GIF_INVALID_CODE)
                   {
-                    // (current_string,current_char) == (alphabet_prefix,alphabet_suffix)[index]
                     // We have found (current_string,current_char) in the alphabet
                     // at the index position. So go on and prepare for then next character
-
-                    descend=1;
-                    start=current_string=index;
-                    index=alphabet_daughter[index];
+                    current_string=alphabet_code[index];
                   }
                   else
                   {
                     // (current_string,current_char) was not found in the alphabet
                     // so write current_string to the Gif stream
-                    GIF_set_code(GIF_file, &GIF, GIF_buffer, current_string);
+                    GIF_set_code(GIF_file, &GIF, current_string);
 
                     if(alphabet_free < 4096) {
-                      // link current_string and the new one
-                      if (descend)
-                        alphabet_daughter[start]=alphabet_free;
-                      else
-                        alphabet_sister[start]=alphabet_free;
-
                       // add (current_string,current_char) to the alphabet
-                      alphabet_prefix[alphabet_free]=current_string;
-                      alphabet_suffix[alphabet_free]=current_char;
+                      alphabet_key[index]=key;
+                      alphabet_code[index]=alphabet_free;
                       alphabet_free++;
                     }
 
                     if (alphabet_free >= 4096)
                     {
                       // clear alphabet
-                      GIF_set_code(GIF_file, &GIF, GIF_buffer, clear);    // 256 for 8bpp
+                      GIF_set_code(GIF_file, &GIF, clear);    // 256 for 8bpp
                       alphabet_free=clear+2;  // 258 for 8bpp
                       GIF.nb_bits  =IDB.Nb_bits_pixel + 1;  // 9 for 8bpp
                       alphabet_max =clear+clear-1;    // 511 for 8bpp
-                      for (start=0;start<4096;start++)
-                      {
-                        alphabet_daughter[start] = GIF_INVALID_CODE;
-                        alphabet_sister[start] = GIF_INVALID_CODE;
-                      }
+                      memset(alphabet_code, 0xff, GIF_HASH_SIZE*sizeof(word));
                     }
                     else if (alphabet_free>alphabet_max+1)
                     {
@@ -1258,16 +1296,14 @@ void Save_GIF(T_IO_Context * context)
                     }
 
                     // initialize current_string as the string "current_char"
-                    index=alphabet_daughter[current_char];
-                    start=current_string=current_char;
-                    descend=1;
+                    current_string=current_char;
                   }
                 }
 
                 if (!File_error)
                 {
                   // Write the last code (before EOF)
-                  GIF_set_code(GIF_file, &GIF, GIF_buffer, current_string);
+                  GIF_set_code(GIF_file, &GIF, current_string);
 
                   // we need to update alphabet_free / GIF.nb_bits here because
                   // the decoder will update them after each code,
@@ -1284,15 +1320,15 @@ void Save_GIF(T_IO_Context * context)
                     }
                   }
 
-                  GIF_set_code(GIF_file, &GIF, GIF_buffer, eof);  // 257 for 8bpp    // Code de End d'image
-                  if (GIF.remainder_bits!=0)
+                  GIF_set_code(GIF_file, &GIF, eof);  // 257 for 8bpp    // Code de End d'image
+                  if (GIF.bit_count!=0)
                   {
                     // Write last byte (this is an incomplete byte)
-                    GIF_buffer[++GIF.remainder_byte]=GIF.last_byte;
-                    GIF.last_byte=0;
-                    GIF.remainder_bits=0;
+                    GIF.block[++GIF.block_size]=(byte)GIF.bit_buffer;
+                    GIF.bit_buffer=0;
+                    GIF.bit_count=0;
                   }
-                  GIF_empty_buffer(GIF_file, &GIF, GIF_buffer); // On envoie les dernières données du buffer GIF dans le buffer KM
+                  GIF_empty_buffer(GIF_file, &GIF); // On envoie les dernières données du buffer GIF dans le buffer KM
 
                   // On écrit un \0
                   if (! Write_byte(GIF_file,'\x00'))
@@ -1356,10 +1392,10 @@ void Save_GIF(T_IO_Context * context)
         File_error=1;
 
       // Libération de la mémoire utilisée par les tables
-      free(alphabet_sister);
-      free(alphabet_daughter);
-      free(alphabet_suffix);
-      free(alphabet_prefix);
+      free(GIF.line);
+      GIF.line = NULL;
+      free(alphabet_code);
+      free(alphabet_key);
 
     } // On a pu écrire la signature du fichier
     else
@@ -639,6 +639,8 @@ GFX2_GLOBAL byte Selected_circle_ellipse_mode;
 GFX2_GLOBAL byte First_color_in_palette;
 /// Boolean, true if Grafx2 was run with a command-line argument to set a resolution on startup (overrides config)
 GFX2_GLOBAL byte Resolution_in_command_line;
+/// Boolean, true when the program runs from the command line without opening a window (-batch, -convert, -script)
+GFX2_GLOBAL byte Batch_mode;
 
 // - Graphic
 
@@ -53,6 +53,8 @@
 #include "input.h"
 #include "brush.h"
 #include "tiles.h"
+#include "gfx2surface.h"
+#include "drawspan.h"
 #if defined(USE_SDL) || defined(USE_SDL2)
 #include "sdlscreen.h"
 #endif
@@ -277,6 +279,63 @@ void Update_part_of_screen(short x, short y, short width, short height)
   }
 }
 
+/**
+ * Redraw a part of the magnifier from the (unzoomed) image.
+ *
+ * This is shared by all pixel ratios: each image line is zoomed once,
+ * directly into the screen surface, and this screen line is then copied
+ * to the following ones.
+ *
+ * @param x_pos left of the area on screen, in menu pixels
+ * @param y_pos top of the area on screen, in menu pixels. It must be the
+ *        top of a zoomed image line.
+ * @param x_offset X position in the image of the first pixel
+ * @param y_offset Y position in the image of the first pixel
+ * @param width width of the area, in image pixels
+ * @param end_y_pos bottom of the area on screen (excluded), in menu pixels
+ * @param image_width width of the image
+ */
+void Display_magnifier_area(word x_pos, word y_pos, word x_offset, word y_offset, word width, word end_y_pos, word image_width)
+{
+  const byte * src = Main_screen + y_offset * image_width + x_offset;
+  int line_width = width * Main.magnifier_factor * Pixel_width;
+  int nb_lines = Main.magnifier_factor * Pixel_height;
+  int end_y = end_y_pos * Pixel_height;
+  int y;
+
+  for (y = y_pos * Pixel_height; y < end_y; y += nb_lines)
+  {
+    byte * first_line = Get_Screen_pixel_ptr(x_pos * Pixel_width, y);
+    int i;
+
+    Zoom_a_line((byte *)src, first_line, Main.magnifier_factor * Pixel_width, width);
+    for (i = 1; i < nb_lines && y + i < end_y; i++)
+      memcpy(Get_Screen_pixel_ptr(x_pos * Pixel_width, y + i), first_line, line_width);
+    src += image_width;
+  }
+  Redraw_grid(x_pos, y_pos, width * Main.magnifier_factor, end_y_pos - y_pos);
+  Update_rect(x_pos, y_pos, width * Main.magnifier_factor, end_y_pos - y_pos);
+}
+
+/// Redraw the whole magnifier. This is the ::Display_zoomed_screen of all pixel ratios.
+static void Display_part_of_screen_scaled(
+        word width, // width non zoomée
+        word height, // height zoomée
+        word image_width, byte * buffer)
+{
+  (void)buffer; // unused, the lines are zoomed on screen
+  Display_magnifier_area(Main.X_zoom, 0, Main.magnifier_offset_X, Main.magnifier_offset_Y,
+                         width, height, image_width);
+}
+
+/// Restore the magnifier under the brush. This is the ::Clear_brush_scaled of all pixel ratios.
+static void Clear_brush_scaled_magnifier(word x_pos, word y_pos, word x_offset, word y_offset,
+        word width, word end_y_pos, byte transp_color, word image_width, byte * buffer)
+{
+  (void)transp_color; // unused
+  (void)buffer; // unused
+  Display_magnifier_area(x_pos, y_pos, x_offset, y_offset, width, end_y_pos, image_width);
+}
 
 
 void Transform_point(short x, short y, float cos_a, float sin_a,
@@ -435,10 +494,10 @@ try_again:
             Display_line = Display_line_on_screen_##x ; \
             Display_line_fast = Display_line_on_screen_fast_##x ; \
             Read_line = Read_line_screen_##x ; \
-            Display_zoomed_screen = Display_part_of_screen_scaled_##x ; \
+            Display_zoomed_screen = Display_part_of_screen_scaled ; \
             Display_brush_color_zoom = Display_brush_color_zoom_##x ; \
             Display_brush_mono_zoom = Display_brush_mono_zoom_##x ; \
-            Clear_brush_scaled = Clear_brush_scaled_##x ; \
+            Clear_brush_scaled = Clear_brush_scaled_magnifier ; \
             Display_brush = Display_brush_##x ;
 			SETPIXEL(simple)
         break;
@@ -733,6 +792,7 @@ void Get_colors_from_brush(void)
           Main.palette[image_color].R=Brush_original_palette[color].R;
           Main.palette[image_color].G=Brush_original_palette[color].G;
           Main.palette[image_color].B=Brush_original_palette[color].B;
+          Invalidate_best_color_cache();
 
           image_color++;
           break;
@@ -772,183 +832,32 @@ void Fill(short * top_reached  , short * bottom_reached,
 // tous les effets.
 //   Cette fonction ne doit pas être directement appelée.
 //
+//   The work is done span by span directly in the layer's pixels, by
+// Fill_GFX2_Surface().
+//
 {
-  short x_pos;   // Abscisse de balayage du segment, utilisée lors de l'"affichage"
-  short line;   // Ordonnée de la ligne en cours de traitement
-  short start_x; // Abscisse de départ du segment traité
-  short end_x;   // Abscisse de fin du segment traité
-  int   changes_made;    // Booléen "On a fait une modif dans le dernier passage"
-  int   can_propagate; // Booléen "On peut propager la couleur dans le segment"
-  short current_limit_bottom;  // Intervalle vertical restreint
-  short current_limit_top;
-  int   line_is_modified;       // Booléen "On a fait une modif dans la ligne"
-
-  changes_made=1;
-  current_limit_top=Paintbrush_Y;
-  current_limit_bottom =Min(Paintbrush_Y+1,Limit_bottom);
-  *left_reached=Paintbrush_X;
-  *right_reached=Paintbrush_X+1;
-  Pixel_in_current_layer(Paintbrush_X,Paintbrush_Y,2);
-
-  while (changes_made)
-  {
-    changes_made=0;
-
-    for (line=current_limit_top;line<=current_limit_bottom;line++)
-    {
-      line_is_modified=0;
-      // On va traiter le cas de la ligne n° line.
-
-      // On commence le traitement à la gauche de l'écran
-      start_x=Limit_left;
-
-      // Pour chaque segment de couleur 1 que peut contenir la ligne
-      while (start_x<=Limit_right)
-      {
-        // On cherche son début
-        while((start_x<=Limit_right) &&
-                (Read_pixel_from_current_layer(start_x,line)!=1))
-             start_x++;
-
-        if (start_x<=Limit_right)
-        {
-          // Un segment de couleur 1 existe et commence à la position start_x.
-          // On va donc en chercher la fin.
-          for (end_x=start_x+1;(end_x<=Limit_right) &&
-               (Read_pixel_from_current_layer(end_x,line)==1);end_x++);
-
-          //   On sait qu'il existe un segment de couleur 1 qui commence en
-          // start_x et qui se termine en end_x-1.
-
-          //   On va maintenant regarder si une couleur sur la périphérie
-          // permet de colorier ce segment avec la couleur 2.
-
-          can_propagate=(
-            // Test de la présence d'un point à gauche du segment
-            ((start_x>Limit_left) &&
-             (Read_pixel_from_current_layer(start_x-1,line)==2)) ||
-            // Test de la présence d'un point à droite du segment
-            ((end_x-1<Limit_right) &&
-             (Read_pixel_from_current_layer(end_x    ,line)==2))
-                               );
-
-          // Test de la présence d'un point en haut du segment
-          if (!can_propagate && (line>Limit_top))
-            for (x_pos=start_x;x_pos<end_x;x_pos++)
-              if (Read_pixel_from_current_layer(x_pos,line-1)==2)
-              {
-                can_propagate=1;
-                break;
-              }
-
-          if (can_propagate)
-          {
-            if (start_x<*left_reached)
-              *left_reached=start_x;
-            if (end_x>*right_reached)
-              *right_reached=end_x;
-            // On remplit le segment de start_x à end_x-1.
-            for (x_pos=start_x;x_pos<end_x;x_pos++)
-              Pixel_in_current_layer(x_pos,line,2);
-            // On vient d'effectuer des modifications.
-            changes_made=1;
-            line_is_modified=1;
-          }
-
-          start_x=end_x+1;
-        }
-      }
-
-      // Si on est en bas, et qu'on peut se propager vers le bas...
-      if ( (line==current_limit_bottom) &&
-           (line_is_modified) &&
-           (current_limit_bottom<Limit_bottom) )
-        current_limit_bottom++; // On descend cette limite vers le bas
-    }
-
-    // Pour le prochain balayage vers le haut, on va se permettre d'aller
-    // voir une ligne plus haut.
-    // Si on ne le fait pas, et que la première ligne (current_limit_top)
-    // n'était pas modifiée, alors cette limite ne serait pas remontée, donc
-    // le filler ne progresserait pas vers le haut.
-    if (current_limit_top>Limit_top)
-      current_limit_top--;
-
-    for (line=current_limit_bottom;line>=current_limit_top;line--)
-    {
-      line_is_modified=0;
-      // On va traiter le cas de la ligne n° line.
-
-      // On commence le traitement à la gauche de l'écran
-      start_x=Limit_left;
-
-      // Pour chaque segment de couleur 1 que peut contenir la ligne
-      while (start_x<=Limit_right)
-      {
-        // On cherche son début
-        for (;(start_x<=Limit_right) &&
-             (Read_pixel_from_current_layer(start_x,line)!=1);start_x++);
-
-        if (start_x<=Limit_right)
-        {
-          // Un segment de couleur 1 existe et commence à la position start_x.
-          // On va donc en chercher la fin.
-          for (end_x=start_x+1;(end_x<=Limit_right) &&
-               (Read_pixel_from_current_layer(end_x,line)==1);end_x++);
-
-          //   On sait qu'il existe un segment de couleur 1 qui commence en
-          // start_x et qui se termine en end_x-1.
-
-          //   On va maintenant regarder si une couleur sur la périphérie
-          // permet de colorier ce segment avec la couleur 2.
-
-          can_propagate=(
-            // Test de la présence d'un point à gauche du segment
-            ((start_x>Limit_left) &&
-             (Read_pixel_from_current_layer(start_x-1,line)==2)) ||
-            // Test de la présence d'un point à droite du segment
-            ((end_x-1<Limit_right) &&
-             (Read_pixel_from_current_layer(end_x    ,line)==2))
-                               );
-
-          // Test de la présence d'un point en bas du segment
-          if (!can_propagate && (line<Limit_bottom))
-            for (x_pos=start_x;x_pos<end_x;x_pos++)
-              if (Read_pixel_from_current_layer(x_pos,line+1)==2)
-              {
-                can_propagate=1;
-                break;
-              }
-
-          if (can_propagate)
-          {
-            if (start_x<*left_reached)
-              *left_reached=start_x;
-            if (end_x>*right_reached)
-              *right_reached=end_x;
-            // On remplit le segment de start_x à end_x-1.
-            for (x_pos=start_x;x_pos<end_x;x_pos++)
-              Pixel_in_current_layer(x_pos,line,2);
-            // On vient d'effectuer des modifications.
-            changes_made=1;
-            line_is_modified=1;
-          }
-
-          start_x=end_x+1;
-        }
-      }
-
-      // Si on est en haut, et qu'on peut se propager vers le haut...
-      if ( (line==current_limit_top) &&
-           (line_is_modified) &&
-           (current_limit_top>Limit_top) )
-        current_limit_top--; // On monte cette limite vers le haut
-    }
-  }
-
-  *top_reached=current_limit_top;
-  *bottom_reached =current_limit_bottom;
-  (*right_reached)--;
+  T_GFX2_Surface layer;
+  int left = Limit_left;
+  int top = Limit_top;
+  int right = Limit_right;
+  int bottom = Limit_bottom;
+
+  layer.pixels = Main.backups->Pages->Image[Main.current_layer].Pixels;
+  layer.w = Main.image_width;
+  layer.h = Main.image_height;
+  if (Fill_GFX2_Surface(&layer, Paintbrush_X, Paintbrush_Y, 1, 2, &left, &top, &right, &bottom) < 0)
+  {
+    Error(0);
+    // The area is partially filled, the bounding box is unknown
+    left = Limit_left;
+    top = Limit_top;
+    right = Limit_right;
+    bottom = Limit_bottom;
+  }
+  *top_reached = top;
+  *bottom_reached = bottom;
+  *left_reached = left;
+  *right_reached = right;
 } // end de la routine de remplissage "Fill"
 
 byte Read_pixel_from_backup_layer(word x,word y)
@@ -1074,6 +983,8 @@ void Fill_general(byte fill_color)
 
     for (y_pos=top_reached;y_pos<=bottom_reached;y_pos++)
     {
+      short run_start = -1;
+
       for (x_pos=left_reached;x_pos<=right_reached;x_pos++)
       {
         byte filled = Read_pixel_from_current_layer(x_pos,y_pos);
@@ -1082,11 +993,19 @@ void Fill_general(byte fill_color)
         Pixel_in_current_screen(x_pos,y_pos,Read_pixel_from_backup_layer(x_pos,y_pos));
 
         if (filled==2)
+        {
+          if (run_start < 0)
+            run_start = x_pos;
+        }
+        else if (run_start >= 0)
         {
           // Update the color according to the fill color and all effects
-          Display_pixel(x_pos,y_pos,fill_color);
+          Display_span_color(run_start,y_pos,x_pos-run_start,fill_color);
+          run_start = -1;
         }
       }
+      if (run_start >= 0)
+        Display_span_color(run_start,y_pos,x_pos-run_start,fill_color);
     }
 
     // Restore original feedback value
@@ -1354,9 +1273,23 @@ void Draw_filled_circle(short center_x,short center_y,long sqradius,byte color)
 
   // Affichage du cercle
   for (y_pos=start_y,y=(long)start_y-center_y;y_pos<=end_y;y_pos++,y++)
-    for (x_pos=start_x,x=(long)start_x-center_x;x_pos<=end_x;x_pos++,x++)
-      if (Pixel_in_circle(x, y, sqradius))
-        Display_pixel(x_pos,y_pos,color);
+    for (x_pos=start_x,x=(long)start_x-center_x;x_pos<=end_x;)
+    {
+      short run_start = x_pos;
+
+      while (x_pos<=end_x && Pixel_in_circle(x, y, sqradius))
+      {
+        x_pos++;
+        x++;
+      }
+      if (x_pos > run_start)
+        Display_span_color(run_start,y_pos,x_pos-run_start,color);
+      else
+      {
+        x_pos++;
+        x++;
+      }
+    }
 
   Update_part_of_screen(start_x,start_y,end_x+1-start_x,end_y+1-start_y);
 }
@@ -1616,9 +1549,23 @@ void Draw_filled_ellipse(short center_x,short center_y,short horizontal_radius,s
 
   // Affichage de l'ellipse
   for (y_pos=start_y,y=start_y-center_y;y_pos<=end_y;y_pos++,y++)
-    for (x_pos=start_x,x=start_x-center_x;x_pos<=end_x;x_pos++,x++)
-      if (Pixel_in_ellipse(x, y, &Ellipse))
-        Display_pixel(x_pos,y_pos,color);
+    for (x_pos=start_x,x=start_x-center_x;x_pos<=end_x;)
+    {
+      short run_start = x_pos;
+
+      while (x_pos<=end_x && Pixel_in_ellipse(x, y, &Ellipse))
+      {
+        x_pos++;
+        x++;
+      }
+      if (x_pos > run_start)
+        Display_span_color(run_start,y_pos,x_pos-run_start,color);
+      else
+      {
+        x_pos++;
+        x++;
+      }
+    }
   Update_part_of_screen(center_x-horizontal_radius,center_y-vertical_radius,2*horizontal_radius+1,2*vertical_radius+1);
 }
 
@@ -1948,7 +1895,6 @@ void Draw_empty_rectangle(short start_x,short start_y,short end_x,short end_y,by
 void Draw_filled_rectangle(short start_x,short start_y,short end_x,short end_y,byte color)
 {
   short temp;
-  short x_pos;
   short y_pos;
 
 
@@ -1973,11 +1919,10 @@ void Draw_filled_rectangle(short start_x,short start_y,short end_x,short end_y,b
     end_y=Limit_bottom;
 
   // On trace le rectangle:
-  for (y_pos=start_y;y_pos<=end_y;y_pos++)
-    for (x_pos=start_x;x_pos<=end_x;x_pos++)
-      // Display_pixel traite chaque pixel avec tous les effets ! (smear, ...)
-      // Donc on ne peut pas otimiser en traçant ligne par ligne avec memset :(
-      Display_pixel(x_pos,y_pos,color);
+  // Display_span_color() traite chaque pixel avec tous les effets ! (smear, ...)
+  if (start_x<=end_x)
+    for (y_pos=start_y;y_pos<=end_y;y_pos++)
+      Display_span_color(start_x,y_pos,end_x-start_x+1,color);
   Update_part_of_screen(start_x,start_y,end_x-start_x,end_y-start_y);
 
 }
@@ -2988,6 +2933,173 @@ void Display_pixel(word x,word y,byte color)
   }
 }
 
+static void Pixel_in_screen_direct_with_opt_preview(word x, word y, byte color, int preview);
+static void Pixel_in_screen_layered_with_opt_preview(word x,word y,byte color, int preview);
+
+/// Show a part of a line of ::Main_screen in the normal (not zoomed) view
+static void Preview_span(word x, word y, word width)
+{
+  if (y < Main.offset_Y || y >= Main.offset_Y + Menu_Y)
+    return;
+  if (x < Main.offset_X)
+  {
+    if (x + width <= Main.offset_X)
+      return;
+    width -= Main.offset_X - x;
+    x = Main.offset_X;
+  }
+  if (x - Main.offset_X >= Screen_width)
+    return;
+  if (x - Main.offset_X + width > Screen_width)
+    width = Screen_width - (x - Main.offset_X);
+  Display_line(x - Main.offset_X, y - Main.offset_Y, width,
+               Main_screen + x + y * Main.image_width);
+}
+
+/// Span kernel for the current modes, chosen by Update_pixel_renderer().
+/// NULL when the pixels must go through Display_pixel().
+static Func_span_kernel Span_kernel = NULL;
+/// The current layer is composed with the other visible ones in ::Main_screen
+static int Span_layered = 0;
+/// The sieve, stencil or mask excludes some pixels
+static int Span_tested = 0;
+
+///
+/// Evaluate the sieve, stencil and mask tests for each pixel of a span.
+///
+/// The tests only depend on the pixel itself, so they can be done before
+/// any pixel of the span is drawn.
+/// @return the number of pixels which can be drawn
+static word Span_tests(const T_Span * span, byte * drawable)
+{
+  word i;
+  word count = 0;
+
+  memset(drawable, 1, span->width);
+  if (Sieve_mode)
+  {
+    int sieve_x = span->x % Sieve_width;
+    int sieve_y = span->y % Sieve_height;
+
+    for (i = 0; i < span->width; i++)
+    {
+      if (!Sieve[sieve_x][sieve_y])
+        drawable[i] = 0;
+      if (++sieve_x == Sieve_width)
+        sieve_x = 0;
+    }
+  }
+  if (Stencil_mode)
+    for (i = 0; i < span->width; i++)
+      if (Stencil[span->layer[i]])
+        drawable[i] = 0;
+  if (Mask_mode)
+    for (i = 0; i < span->width; i++)
+      if (Mask_table[Read_pixel_from_spare_screen(span->x + i, span->y)])
+        drawable[i] = 0;
+  for (i = 0; i < span->width; i++)
+    count += drawable[i];
+  return count;
+}
+
+///
+/// Draw consecutive pixels of a line, with the same result as calling
+/// Display_pixel() on each of them from left to right.
+///
+/// The sieve, stencil and mask tests and the effect are applied along the
+/// run by a kernel specialized for the active modes (see ::Span_kernel),
+/// and the pixels are written directly in the current layer, ::Main_screen
+/// and the screen. The tilemap and the constrained image modes (ZX, C64,
+/// HGR...) go through Display_pixel().
+/// @param x      X position of the first pixel in the image
+/// @param y      Y position of the line in the image
+/// @param width  number of pixels
+/// @param colors color of each pixel
+void Display_span(word x, word y, word width, const byte * colors)
+{
+  T_Span span;
+  byte drawable[SPAN_CHUNK];
+  int layered = Span_layered;
+  int tested = Span_tested;
+  word i;
+
+  if (Main.tilemap_mode || Span_kernel == NULL)
+  {
+    for (i = 0; i < width; i++)
+      Display_pixel(x + i, y, colors[i]);
+    return;
+  }
+
+  span.y = y;
+  span.images = Main.backups->Pages->Image;
+  span.current_layer = Main.current_layer;
+  span.transparent_color = Main.backups->Pages->Transparent_color;
+  span.effect = Effect_function;
+  span.shade_table = Shade_table;
+  while (width > 0)
+  {
+    word first = 0; // range of pixels which were drawn
+    word last;
+
+    span.x = x;
+    span.width = width < SPAN_CHUNK ? width : SPAN_CHUNK;
+    span.colors = colors;
+    span.offset = x + (long)y * Main.image_width;
+    span.layer = span.images[Main.current_layer].Pixels + span.offset;
+    span.screen = Main_screen + span.offset;
+    span.depth = layered ? Main_visible_image_depth_buffer.Image + span.offset : NULL;
+    span.feedback = FX_feedback_screen + span.offset;
+    span.drawable = NULL;
+    last = span.width - 1;
+    if (!tested || Span_tests(&span, drawable) > 0)
+    {
+      if (tested)
+      {
+        span.drawable = drawable;
+        while (!drawable[first])
+          first++;
+        while (!drawable[last])
+          last--;
+      }
+      Span_kernel(&span);
+
+      if (Pixel_preview == Pixel_preview_normal)
+        Preview_span(x + first, y, last - first + 1);
+      else
+      {
+        for (i = first; i <= last; i++)
+        {
+          if (tested && !drawable[i])
+            continue;
+          if (!layered)
+            Pixel_preview(x + i, y, span.layer[i]);
+          else if (span.depth[i] <= Main.current_layer)
+            Pixel_preview(x + i, y, span.screen[i]);
+        }
+      }
+    }
+    x += span.width;
+    colors += span.width;
+    width -= span.width;
+  }
+}
+
+/// Draw consecutive pixels of a line in the same color, see Display_span()
+void Display_span_color(word x, word y, word width, byte color)
+{
+  byte colors[256];
+  word count;
+
+  memset(colors, color, sizeof(colors));
+  while (width > 0)
+  {
+    count = width < sizeof(colors) ? width : sizeof(colors);
+    Display_span(x, y, count, colors);
+    x += count;
+    width -= count;
+  }
+}
+
 
 
 // -- Calcul des différents effets -------------------------------------------
@@ -3967,4 +4079,24 @@ void Update_pixel_renderer(void)
     else
       Pixel_in_current_screen_with_opt_preview = Pixel_in_screen_layered_with_opt_preview;
   }
+
+  // Kernel used by Display_span(): only the direct and layered renderers
+  // write the current layer and Main_screen without touching other pixels.
+  // This must be called again when the effect, sieve, stencil or mask
+  // mode changes.
+  if (Pixel_in_current_screen_with_opt_preview == Pixel_in_screen_direct_with_opt_preview
+   || Pixel_in_current_screen_with_opt_preview == Pixel_in_screen_layered_with_opt_preview)
+  {
+    enum SPAN_EFFECT effect = SPAN_ANY_EFFECT;
+
+    if (Effect_function == No_effect)
+      effect = SPAN_REPLACE;
+    else if (Effect_function == Effect_shade)
+      effect = SPAN_SHADE;
+    Span_layered = (Pixel_in_current_screen_with_opt_preview == Pixel_in_screen_layered_with_opt_preview);
+    Span_tested = (Sieve_mode || Stencil_mode || Mask_mode);
+    Span_kernel = Get_span_kernel(Span_layered, effect, Span_tested);
+  }
+  else
+    Span_kernel = NULL;
 }
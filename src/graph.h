@@ -48,6 +48,8 @@ void Display_foreback(void);
 
 
 void Display_pixel(word x,word y,byte color);
+void Display_span(word x, word y, word width, const byte * colors);
+void Display_span_color(word x, word y, word width, byte color);
 
 void Display_paintbrush(short x,short y,byte color);
 void Draw_paintbrush(short x,short y,byte color);
@@ -131,6 +133,8 @@ void Update_part_of_screen(short x, short y, short width, short height);
 
 void Redraw_grid(short x, short y, unsigned short w, unsigned short h);
 
+void Display_magnifier_area(word x_pos, word y_pos, word x_offset, word y_offset, word width, word end_y_pos, word image_width);
+
 void Pixel_in_spare(word x,word y, byte color);
 void Pixel_in_current_layer(word x,word y, byte color);
 void Pixel_in_layer(int layer, word x,word y, byte color);
@@ -150,7 +154,9 @@ extern Func_pixel_opt_preview Pixel_in_current_screen_with_opt_preview;
 
 /// Update the pixel functions according to the current Image_mode.
 /// Sets ::Pixel_in_current_screen and ::Pixel_in_current_screen_with_preview
-/// through ::Pixel_in_current_screen_with_opt_preview
+/// through ::Pixel_in_current_screen_with_opt_preview.
+/// Also chooses the kernel of Display_span(), so it must be called again
+/// when the effect, sieve, stencil or mask mode changes.
 void Update_pixel_renderer(void);
 
 void Update_color_hgr_pixel(word x, word y, int preview);
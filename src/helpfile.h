@@ -2675,6 +2675,14 @@ static const T_Help_table helptable_settings_details[] =
   HELP_TEXT ("'undoing'.")
   HELP_TEXT ("Values are between 1 and 99.")
   HELP_TEXT ("")
+  HELP_BOLD ("  Undo memory")
+  HELP_TEXT ("Memory used by the Undo history of each")
+  HELP_TEXT ("picture (main and spare), in megabytes.")
+  HELP_TEXT ("When set, the oldest pages are")
+  HELP_TEXT ("forgotten only when this budget is exceeded,")
+  HELP_TEXT ("and 'Undo pages' is ignored. 0 means the")
+  HELP_TEXT ("number of Undo pages is the limit.")
+  HELP_TEXT ("")
   HELP_BOLD ("  Vertices per polygon")
   HELP_TEXT ("Maximum number of vertices used in filled")
   HELP_TEXT ("polygons and polyforms, and lasso. Possible")
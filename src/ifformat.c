@@ -284,9 +284,17 @@ void Draw_IFF_line(T_IO_Context *context, const byte * buffer, short y_pos, shor
       Set_pixel_24b(context, x_pos,y_pos, rgb, rgb >> 8, rgb >> 16);  // R is 8 LSB, etc.
     }
   }
-  else for (x_pos=0; x_pos<context->Width; x_pos++)
+  else
   {
-    Set_pixel(context, x_pos, y_pos, Get_IFF_color(buffer, x_pos,real_line_size, bitplanes));
+    byte pixels[256];
+    short i;
+
+    for (x_pos=0; x_pos<context->Width; x_pos+=i)
+    {
+      for (i=0; i<256 && x_pos+i<context->Width; i++)
+        pixels[i] = Get_IFF_color(buffer, x_pos+i,real_line_size, bitplanes);
+      Set_pixel_row(context, x_pos, y_pos, i, pixels);
+    }
   }
 }
 
@@ -396,14 +404,20 @@ static void PBM_Decode(T_IO_Context * context, FILE * file, byte compression, wo
       for (y_pos=0; ((y_pos<height) && (!File_error)); y_pos++)
       {
         if (Read_bytes(file,line_buffer,real_line_size))
-          for (x_pos=0; x_pos<width; x_pos++)
-            Set_pixel(context, x_pos,y_pos,line_buffer[x_pos]);
+          Set_pixel_row(context, 0, y_pos, width, line_buffer);
         else
           File_error=26;
       }
       free(line_buffer);
       break;
     case 1: // Compressed
+      // a run can go up to 128 bytes past the end of the line
+      line_buffer=(byte *)malloc(real_line_size+128);
+      if (line_buffer == NULL)
+      {
+        File_error=1;
+        break;
+      }
       for (y_pos=0; ((y_pos<height) && (!File_error)); y_pos++)
       {
         for (x_pos=0; ((x_pos<real_line_size) && (!File_error)); )
@@ -422,7 +436,7 @@ static void PBM_Decode(T_IO_Context * context, FILE * file, byte compression, wo
               break;
             }
             do {
-              Set_pixel(context, x_pos++,y_pos,color);
+              line_buffer[x_pos++]=color;
             }
             while(temp_byte++ != 0);
           }
@@ -434,11 +448,13 @@ static void PBM_Decode(T_IO_Context * context, FILE * file, byte compression, wo
                 File_error=29;
                 break;
               }
-              Set_pixel(context, x_pos++,y_pos,color);
+              line_buffer[x_pos++]=color;
             }
             while(temp_byte-- > 0);
         }
+        Set_pixel_row(context, 0, y_pos, (x_pos < width) ? x_pos : width, line_buffer);
       }
+      free(line_buffer);
       break;
     default:
       GFX2_Log(GFX2_ERROR, "PBM only supports compression type 0 and 1 (not %d)\n", compression);
@@ -2180,6 +2196,7 @@ void Save_IFF(T_IO_Context * context)
     if (context->Format == FORMAT_LBM)
     {
       byte * buffer;
+      byte * pixels; // one line of the image
       short line_size; // Size of line in bytes
       short plane_line_size;  // Size of line in bytes for 1 plane
       short real_line_size; // Size of line in pixels
@@ -2190,6 +2207,9 @@ void Save_IFF(T_IO_Context * context)
       plane_line_size = real_line_size >> 3;  // 8bits per byte
       line_size = plane_line_size * header.BitPlanes;
       buffer=(byte *)malloc(line_size);
+      pixels=(byte *)malloc(context->Width);
+      if (buffer == NULL || pixels == NULL)
+        File_error = 1;
       
       // Start encoding
       PackBits_pack_init(&pb_data, IFF_file);
@@ -2197,8 +2217,9 @@ void Save_IFF(T_IO_Context * context)
       {
         // Dispatch the pixel into planes
         memset(buffer,0,line_size);
+        Get_pixel_row(context, 0, y_pos, context->Width, pixels);
         for (x_pos=0; x_pos<context->Width; x_pos++)
-          Set_IFF_color(buffer, x_pos, Get_pixel(context, x_pos,y_pos), real_line_size, header.BitPlanes);
+          Set_IFF_color(buffer, x_pos, pixels[x_pos], real_line_size, header.BitPlanes);
           
         if (context->Width&1) // odd width fix
           Set_IFF_color(buffer, x_pos, 0, real_line_size, header.BitPlanes);
@@ -2232,23 +2253,29 @@ void Save_IFF(T_IO_Context * context)
         }
       }
       free(buffer);
+      free(pixels);
     }
     else // PBM = chunky 8bpp
     {
       T_PackBits_data pb_data;
+      byte * pixels; // one line of the image
 
+      pixels=(byte *)malloc(context->Width);
+      if (pixels == NULL)
+        File_error = 1;
       PackBits_pack_init(&pb_data, IFF_file);
       for (y_pos=0; ((y_pos<context->Height) && (!File_error)); y_pos++)
       {
+        Get_pixel_row(context, 0, y_pos, context->Width, pixels);
         for (x_pos=0; ((x_pos<context->Width) && (!File_error)); x_pos++)
         {
-          if (PackBits_pack_add(&pb_data, Get_pixel(context, x_pos, y_pos)) < 0)
+          if (PackBits_pack_add(&pb_data, pixels[x_pos]) < 0)
             File_error = 1;
         }
   
         if (context->Width & 1) // odd width fix
         {
-          if (PackBits_pack_add(&pb_data, Get_pixel(context, context->Width - 1, y_pos)) < 0)
+          if (PackBits_pack_add(&pb_data, pixels[context->Width - 1]) < 0)
             File_error = 1;
         }
           
@@ -2258,6 +2285,7 @@ void Save_IFF(T_IO_Context * context)
             File_error = 1;
         }
       }
+      free(pixels);
     }
     // Now update FORM and BODY size
     if (!File_error)
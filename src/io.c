@@ -591,6 +591,24 @@ unsigned long File_length(const char * fname)
 #endif
 }
 
+qword File_modification_time(const char * fname)
+{
+#if defined(WIN32)
+  WIN32_FILE_ATTRIBUTE_DATA infos;
+  if (GetFileAttributesExA(fname, GetFileExInfoStandard, &infos))
+  {
+    return ((qword)infos.ftLastWriteTime.dwHighDateTime << 32) + (qword)infos.ftLastWriteTime.dwLowDateTime;
+  }
+  else
+    return 0;
+#else
+  struct stat infos_fichier;
+  if (stat(fname,&infos_fichier))
+    return 0;
+  return (qword)infos_fichier.st_mtime;
+#endif
+}
+
 unsigned long File_length_file(FILE * file)
 {
 #if defined(WIN32)
@@ -1125,6 +1143,15 @@ int Remove_path(const char * path)
 #endif
 }
 
+int Rename_path(const char * old_path, const char * new_path)
+{
+#if defined(WIN32)
+  return (MoveFileExA(old_path, new_path, MOVEFILE_REPLACE_EXISTING) ? 0 : -1);
+#else
+  return rename(old_path, new_path);
+#endif
+}
+
 ///
 /// Remove the directory
 int Remove_directory(const char * path)
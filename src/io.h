@@ -130,6 +130,10 @@ int Position_last_dot_unicode(const word * fname);
 /// Size of a file, in bytes. Returns 0 in case of error.
 unsigned long File_length(const char *fname);
 
+/// Last modification time of a file, in a platform-specific unit which is
+/// only meant to be compared. Returns 0 in case of error.
+qword File_modification_time(const char *fname);
+
 /// Returns true if a file passed as a parameter exists in the current directory.
 int File_exists(const char * fname);
 
@@ -199,6 +203,11 @@ int Change_directory(const char * path);
 /// Remove the file
 int Remove_path(const char * path);
 
+///
+/// Rename a file, replacing the destination if it exists.
+/// return 0 for success, -1 in case of error
+int Rename_path(const char * old_path, const char * new_path);
+
 ///
 /// Remove the directory
 int Remove_directory(const char * path);
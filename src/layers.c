@@ -42,12 +42,15 @@
 void Layer_activate(int layer, short side)
 {
   dword old_layers;
+  dword changed_layers;
+  int old_current_layer;
 
   if (layer >= Main.backups->Pages->Nb_layers)
     return;
   
   // Keep a copy of which layers were visible
   old_layers = Main.layers_visible;
+  old_current_layer = Main.current_layer;
   
   if (Main.backups->Pages->Image_mode != IMAGE_MODE_ANIMATION)
   {
@@ -96,7 +99,14 @@ void Layer_activate(int layer, short side)
 
   Hide_cursor();
   if (Main.layers_visible != old_layers)
-    Redraw_layered_image();
+  {
+    // Only the pixels of the layers which appeared or disappeared can change,
+    // and the depth buffer where the current layer has changed.
+    changed_layers = Main.layers_visible ^ old_layers;
+    if (Main.current_layer != old_current_layer)
+      changed_layers |= (1<<Main.current_layer) | (1<<old_current_layer);
+    Redraw_layered_image_for_layers(changed_layers);
+  }
   else
     Update_depth_buffer(); // Only need the depth buffer
   //Download_infos_page_main(Main.backups->Pages);
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <string.h>
 #ifndef _MSC_VER
+#include <strings.h>
 #include <unistd.h>
 #endif
 #if defined(WIN32)
@@ -175,6 +176,153 @@ unsigned int Nb_known_formats(void)
   return sizeof(File_formats)/sizeof(File_formats[0]);
 }
 
+unsigned long Format_tests_count = 0;
+
+/// Number of bytes read from the start of a file to look for a signature
+#define FORMAT_HEADER_SIZE 16
+
+/// Magic numbers found at the beginning of files.
+///
+/// A file matching one of these is first checked by the Test function of the
+/// corresponding format, before trying the formats matching its extension
+/// and finally all the other ones.
+/// Several entries can refer to the same format.
+static const struct
+{
+  enum FILE_FORMATS Identifier; ///< Format whose Test function is tried first
+  byte Offset;                  ///< Position of the signature in the file
+  byte Size;                    ///< Length of the signature in bytes
+  const char * Signature;       ///< Expected bytes
+} File_signatures[] = {
+  {FORMAT_GIF,  0, 4, "GIF8"},
+  {FORMAT_PNG,  0, 4, "\x89PNG"},
+  {FORMAT_BMP,  0, 2, "BM"},
+  {FORMAT_PCX,  0, 1, "\x0a"},
+  {FORMAT_PKM,  0, 3, "PKM"},
+  {FORMAT_LBM,  0, 4, "FORM"},
+  {FORMAT_PBM,  0, 4, "FORM"},
+  {FORMAT_ACBM, 0, 4, "FORM"},
+  {FORMAT_GPL,  0, 12, "GIMP Palette"},
+  {FORMAT_ICO,  0, 4, "\0\0\1\0"},
+  {FORMAT_ICO,  0, 4, "\0\0\2\0"},
+  {FORMAT_INFO, 0, 2, "\xe3\x10"},
+  {FORMAT_FLI,  4, 2, "\x11\xaf"},
+  {FORMAT_FLI,  4, 2, "\x12\xaf"},
+  {FORMAT_TIFF, 0, 4, "II*\0"},
+  {FORMAT_TIFF, 0, 4, "MM\0*"},
+  {FORMAT_GRB,  0, 8, "HPHP48-R"},
+};
+
+/// Checks if the first bytes of a file match a signature of the format
+static int Signature_matches(enum FILE_FORMATS format, const byte * header, size_t header_size)
+{
+  unsigned int i;
+
+  for (i = 0; i < sizeof(File_signatures)/sizeof(File_signatures[0]); i++)
+  {
+    if (File_signatures[i].Identifier != format)
+      continue;
+    if ((size_t)File_signatures[i].Offset + File_signatures[i].Size > header_size)
+      continue;
+    if (memcmp(header + File_signatures[i].Offset, File_signatures[i].Signature, File_signatures[i].Size) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+/// Checks if the file name extension is one of the format's extensions
+int Extension_matches(const T_Format * format, const char * extension)
+{
+  const char * filter = format->Extensions;
+
+  if (extension == NULL)
+    return 0;
+  while (*filter != '\0')
+  {
+    if (Check_extension(extension, filter))
+      return 1;
+    while (*filter != '\0' && *filter != ';')
+      filter++;
+    if (*filter == ';')
+      filter++;
+  }
+  return 0;
+}
+
+///
+/// Finds the format of a file by calling the Test functions.
+///
+/// The beginning of the file is read once and compared against the known
+/// signatures. The matching formats are tested first, then the formats
+/// whose extensions match the file name, and finally all the remaining
+/// formats. In each pass, the formats are tried in the order of
+/// ::FILE_FORMATS, like the Test loop used before: it decides which format
+/// wins when several Test functions accept the same file.
+/// @param context the IO context, with the file name set
+/// @param f the file, opened for reading
+/// @param already_tested index in File_formats of a format that was already tested, or -1
+/// @return the format of the file, or NULL if none was found (File_error is then set)
+static const T_Format * Detect_format(T_IO_Context * context, FILE * f, int already_tested)
+{
+  byte header[FORMAT_HEADER_SIZE];
+  byte tested[sizeof(File_formats)/sizeof(File_formats[0])];
+  unsigned int order[sizeof(File_formats)/sizeof(File_formats[0])];
+  unsigned int nb_formats = 0;
+  size_t header_size;
+  const char * extension;
+  unsigned int index;
+  int id;
+  int pass;
+
+  // indexes in File_formats, sorted by format identifier
+  for (id = 0; id <= FORMAT_CLIPBOARD; id++)
+    for (index = 0; index < Nb_known_formats(); index++)
+      if ((int)File_formats[index].Identifier == id)
+        order[nb_formats++] = index;
+
+  memset(tested, 0, sizeof(tested));
+  if (already_tested >= 0 && (unsigned int)already_tested < Nb_known_formats())
+    tested[already_tested] = 1;
+
+  fseek(f, 0, SEEK_SET);
+  header_size = fread(header, 1, sizeof(header), f);
+  extension = strrchr(context->File_name, '.');
+  if (extension != NULL)
+    extension++;
+
+  File_error = 1;
+  // pass 0 : signature, pass 1 : extension, pass 2 : all others
+  for (pass = 0; pass < 3; pass++)
+  {
+    unsigned int i;
+
+    for (i = 0; i < nb_formats; i++)
+    {
+      const T_Format * format = &(File_formats[order[i]]);
+
+      index = order[i];
+      if (format->Test == NULL || tested[index])
+        continue;
+      if (pass == 0 && !Signature_matches(format->Identifier, header, header_size))
+        continue;
+      if (pass == 1 && !Extension_matches(format, extension))
+        continue;
+
+      tested[index] = 1;
+      fseek(f, 0, SEEK_SET); // rewind
+      Format_tests_count++;
+      format->Test(context, f);
+      if (File_error == 0)
+      {
+        GFX2_Log(GFX2_DEBUG, "Detect_format() %s : %s (pass %d, %lu tests so far)\n",
+                 context->File_name, format->Label, pass, Format_tests_count);
+        return format;
+      }
+    }
+  }
+  return NULL;
+}
+
 /// Set the color of a pixel (on load)
 void Set_pixel(T_IO_Context *context, short x_pos, short y_pos, byte color)
 {
@@ -242,6 +390,60 @@ void Set_pixel(T_IO_Context *context, short x_pos, short y_pos, byte color)
 
 }
 
+/// Set the colors of consecutive pixels of a line (on load)
+void Set_pixel_row(T_IO_Context *context, short x_pos, short y_pos, short width, const byte * colors)
+{
+  short i;
+
+  // Clipping
+  if (y_pos>=context->Height || x_pos>=context->Width || width<=0)
+    return;
+  if (x_pos+width > context->Width)
+    width = context->Width - x_pos;
+
+  switch (context->Type)
+  {
+    case CONTEXT_MAIN_IMAGE:
+      if (Main.backups->Pages->Image_mode == IMAGE_MODE_ANIMATION
+       || Main.backups->Pages->Image_mode == IMAGE_MODE_LAYERED)
+      {
+        // The screen is redrawn after loading : only the layer needs the pixels
+        memcpy(Main.backups->Pages->Image[Main.current_layer].Pixels + y_pos * Main.image_width + x_pos, colors, width);
+      }
+      else
+      {
+        // Constrained modes may have to modify other pixels
+        for (i = 0; i < width; i++)
+          Pixel_in_current_screen(x_pos + i, y_pos, colors[i]);
+      }
+      break;
+
+    case CONTEXT_BRUSH:
+      memcpy(context->Buffer_image + y_pos * context->Pitch + x_pos, colors, width);
+      break;
+
+    case CONTEXT_PREVIEW:
+      // Only one pixel every Preview_factor_X on one line every Preview_factor_Y
+      if ((y_pos % context->Preview_factor_Y) != 0)
+        break;
+      for (i = (context->Preview_factor_X - x_pos % context->Preview_factor_X) % context->Preview_factor_X; i < width; i += context->Preview_factor_X)
+        Set_pixel(context, x_pos + i, y_pos, colors[i]);
+      break;
+
+    case CONTEXT_SURFACE:
+      if (x_pos<0 || y_pos<0 || y_pos>=context->Surface->h || x_pos>=context->Surface->w)
+        break;
+      if (x_pos+width > context->Surface->w)
+        width = context->Surface->w - x_pos;
+      memcpy(context->Surface->pixels + y_pos * context->Surface->w + x_pos, colors, width);
+      break;
+
+    case CONTEXT_PALETTE:
+    case CONTEXT_PREVIEW_PALETTE:
+      break;
+  }
+}
+
 void Fill_canvas(T_IO_Context *context, byte color)
 {
   switch (context->Type)
@@ -372,12 +574,69 @@ enum IMAGE_MODES Get_image_mode(T_IO_Context *context)
   return IMAGE_MODE_LAYERED;
 }
 
+/// Displays the informations about a file in the file selector (dimensions,
+/// file size, format), and clears the area of the preview.
+static void Display_preview_infos(T_IO_Context *context)
+{
+  char  str[10];
+
+  // Affichage des données "Image size:"
+  memcpy(str, "VERY BIG!", 10); // default string
+  if (context->Original_width != 0)
+  {
+    if (context->Original_width < 10000 && context->Original_height < 10000)
+      snprintf(str, sizeof(str), "%4hux%4hu", context->Original_width, context->Original_height);
+  }
+  else if ((context->Width<10000) && (context->Height<10000))
+  {
+    snprintf(str, sizeof(str), "%4hux%4hu", context->Width, context->Height);
+  }
+  Print_in_window(101,59,str,MC_Black,MC_Light);
+  snprintf(str, sizeof(str), "%2dbpp", context->bpp);
+  Print_in_window(181,59,str,MC_Black,MC_Light);
+
+  // Affichage de la taille du fichier
+  if (context->Preview_file_size<1048576)
+  {
+    // Le fichier fait moins d'un Mega, on affiche sa taille direct
+    Num2str(context->Preview_file_size,str,7);
+  }
+  else if (((context->Preview_file_size+512)/1024)<100000)
+  {
+    // Le fichier fait plus d'un Mega, on peut afficher sa taille en Ko
+    Num2str((context->Preview_file_size+512)/1024,str,5);
+    strcpy(str+5,"KB");
+  }
+  else
+  {
+    // Le fichier fait plus de 100 Mega octets (cas très rare :))
+    memcpy(str,"LARGE!!",8);
+  }
+  Print_in_window(236,59,str,MC_Black,MC_Light);
+
+  // Affichage du vrai format
+  Print_in_window( 59,59,Get_fileformat(context->Preview_format)->Label,MC_Black,MC_Light);
+
+  // On efface le commentaire précédent
+  Window_rectangle(45,70,32*8,8,MC_Light);
+
+  context->Preview_pos_X=Window_pos_X+183*Menu_factor_X;
+  context->Preview_pos_Y=Window_pos_Y+ 95*Menu_factor_Y;
+
+  // On nettoie la zone où va s'afficher la preview:
+  Window_rectangle(183,95,PREVIEW_WIDTH,PREVIEW_HEIGHT,MC_Light);
+
+  // Un update pour couvrir les 4 zones: 3 libellés plus le commentaire
+  Update_window_area(45,48,256,30);
+  // Zone de preview
+  Update_window_area(183,95,PREVIEW_WIDTH,PREVIEW_HEIGHT);
+}
+
 ///
 /// Generic allocation and similar stuff, done at beginning of image load,
 /// as soon as size is known.
 void Pre_load(T_IO_Context *context, short width, short height, long file_size, int format, enum PIXEL_RATIO ratio, byte bpp)
 {
-  char  str[10];
   byte truecolor;
 
   if (width < 0 || width > 9999 || height < 0 || height > 9999)
@@ -408,45 +667,8 @@ void Pre_load(T_IO_Context *context, short width, short height, long file_size,
       if (!context->Preview_bitmap)
         File_error=1;
 
-      // Affichage des données "Image size:"
-      memcpy(str, "VERY BIG!", 10); // default string
-      if (context->Original_width != 0)
-      {
-        if (context->Original_width < 10000 && context->Original_height < 10000)
-          snprintf(str, sizeof(str), "%4hux%4hu", context->Original_width, context->Original_height);
-      }
-      else if ((width<10000) && (height<10000))
-      {
-        snprintf(str, sizeof(str), "%4hux%4hu", width, height);
-      }
-      Print_in_window(101,59,str,MC_Black,MC_Light);
-      snprintf(str, sizeof(str), "%2dbpp", bpp);
-      Print_in_window(181,59,str,MC_Black,MC_Light);
-
-      // Affichage de la taille du fichier
-      if (file_size<1048576)
-      {
-        // Le fichier fait moins d'un Mega, on affiche sa taille direct
-        Num2str(file_size,str,7);
-      }
-      else if (((file_size+512)/1024)<100000)
-      {
-        // Le fichier fait plus d'un Mega, on peut afficher sa taille en Ko
-        Num2str((file_size+512)/1024,str,5);
-        strcpy(str+5,"KB");
-      }
-      else
-      {
-        // Le fichier fait plus de 100 Mega octets (cas très rare :))
-        memcpy(str,"LARGE!!",8);
-      }
-      Print_in_window(236,59,str,MC_Black,MC_Light);
-
-      // Affichage du vrai format
-      Print_in_window( 59,59,Get_fileformat(format)->Label,MC_Black,MC_Light);
-
-      // On efface le commentaire précédent
-      Window_rectangle(45,70,32*8,8,MC_Light);
+      context->Preview_file_size=file_size;
+      context->Preview_format=format;
 
       // Calcul des données nécessaires à l'affichage de la preview:
       if (ratio == PIXEL_WIDE &&
@@ -470,16 +692,7 @@ void Pre_load(T_IO_Context *context, short width, short height, long file_size,
           context->Preview_factor_X=context->Preview_factor_Y;
       }
 
-      context->Preview_pos_X=Window_pos_X+183*Menu_factor_X;
-      context->Preview_pos_Y=Window_pos_Y+ 95*Menu_factor_Y;
-
-      // On nettoie la zone où va s'afficher la preview:
-      Window_rectangle(183,95,PREVIEW_WIDTH,PREVIEW_HEIGHT,MC_Light);
-
-      // Un update pour couvrir les 4 zones: 3 libellés plus le commentaire
-      Update_window_area(45,48,256,30);
-      // Zone de preview
-      Update_window_area(183,95,PREVIEW_WIDTH,PREVIEW_HEIGHT);
+      Display_preview_infos(context);
       break;
 
     // Other loading
@@ -576,12 +789,100 @@ void Pre_load(T_IO_Context *context, short width, short height, long file_size,
   }
 }
 
+/// Displays the preview of a picture or palette in the file selector,
+/// after adapting its palette to show the GUI.
+static void Display_preview_image(T_IO_Context *context)
+{
+  // Try to adapt the palette to accomodate the GUI.
+  int c;
+  int count_unused;
+  byte unused_color[4];
+
+  if (context->Type == CONTEXT_PREVIEW && context->bpp > 8)
+    Set_palette_fake_24b(context->Palette);
+
+  count_unused=0;
+  // Try find 4 unused colors and insert good colors there
+  for (c=255; c>=0 && count_unused<4; c--)
+  {
+    if (!context->Preview_usage[c])
+    {
+      unused_color[count_unused]=c;
+      count_unused++;
+    }
+  }
+  // Found! replace them with some favorites
+  if (count_unused==4)
+  {
+    int gui_index;
+    for (gui_index=0; gui_index<4; gui_index++)
+    {
+      context->Palette[unused_color[gui_index]]=*Favorite_GUI_color(gui_index);
+    }
+  }
+  // All preview display is here
+
+  // Update palette and screen first
+  Compute_optimal_menu_colors(context->Palette);
+  Remap_screen_after_menu_colors_change();
+  Set_palette(context->Palette);
+
+  // Display palette preview
+  if (Get_fileformat(context->Format)->Palette_only
+      || context->Type == CONTEXT_PREVIEW_PALETTE)
+  {
+    short index;
+
+    if (context->Type == CONTEXT_PREVIEW || context->Type == CONTEXT_PREVIEW_PALETTE)
+      for (index=0; index<256; index++)
+        Window_rectangle(183+(index/16)*7,95+(index&15)*5,5,5,index);
+
+  }
+  // Display normal image
+  else if (context->Preview_bitmap)
+  {
+    int x_pos,y_pos;
+    int width,height;
+    width=context->Width/context->Preview_factor_X;
+    height=context->Height/context->Preview_factor_Y;
+    if (context->Ratio == PIXEL_WIDE &&
+        Pixel_ratio != PIXEL_WIDE &&
+        Pixel_ratio != PIXEL_WIDE2)
+      width*=2;
+    else if (context->Ratio == PIXEL_TALL &&
+        Pixel_ratio != PIXEL_TALL &&
+        Pixel_ratio != PIXEL_TALL2 &&
+        Pixel_ratio != PIXEL_TALL3)
+      height*=2;
+
+    for (y_pos=0; y_pos<height;y_pos++)
+      for (x_pos=0; x_pos<width;x_pos++)
+      {
+        byte color=context->Preview_bitmap[x_pos+y_pos*PREVIEW_WIDTH*Menu_factor_X];
+
+        // Skip transparent if image has transparent background.
+        if (color == context->Transparent_color && context->Background_transparent)
+          color=MC_Window;
+
+        Pixel(context->Preview_pos_X+x_pos,
+              context->Preview_pos_Y+y_pos,
+              color);
+      }
+  }
+  // Refresh modified part
+  Update_window_area(183,95,PREVIEW_WIDTH,PREVIEW_HEIGHT);
+
+  // Preview comment
+  Print_in_window(45,70,context->Comment,MC_Black,MC_Light);
+  //Update_window_area(45,70,32*8,8);
+
+}
+
 /////////////////////////////////////////////////////////////////////////////
 
 // -- Charger n'importe connu quel type de fichier d'image (ou palette) -----
 void Load_image(T_IO_Context *context)
 {
-  unsigned int index; // index de balayage des formats
   const T_Format *format = &(File_formats[FORMAT_ALL_FILES+1]); // Format du fichier à charger
   int i;
   byte old_cursor_shape;
@@ -624,27 +925,21 @@ void Load_image(T_IO_Context *context)
     {
       format = Get_fileformat(context->Format);
       if (format->Test)
+      {
+        Format_tests_count++;
         format->Test(context, f);
+      }
     }
 
     if (File_error)
     {
       //  Sinon, on va devoir scanner les différents formats qu'on connait pour
       // savoir à quel format est le fichier:
-      for (index=0; index < Nb_known_formats(); index++)
-      {
-        format = Get_fileformat(index);
-        // Loadable format
-        if (format->Test == NULL)
-          continue;
+      const T_Format * detected;
 
-        fseek(f, 0, SEEK_SET); // rewind
-        // On appelle le testeur du format:
-        format->Test(context, f);
-        // On s'arrête si le fichier est au bon format:
-        if (File_error==0)
-          break;
-      }
+      detected = Detect_format(context, f, context->Format > FORMAT_ALL_FILES ? (int)(format - File_formats) : -1);
+      if (detected != NULL)
+        format = detected;
     }
     fclose(f);
 
@@ -805,6 +1100,7 @@ void Load_image(T_IO_Context *context)
       // Copy the loaded palette
       memcpy(Main.palette, context->Palette, sizeof(T_Palette));
       memcpy(Main.backups->Pages->Palette, context->Palette, sizeof(T_Palette));
+      Invalidate_best_color_cache();
 
       // For formats that handle more than just the palette:
       // Transfer the data to main image.
@@ -899,6 +1195,7 @@ void Load_image(T_IO_Context *context)
       // Copy the loaded palette
       memcpy(Main.palette, context->Palette, sizeof(T_Palette));
       memcpy(Main.backups->Pages->Palette, context->Palette, sizeof(T_Palette));
+      Invalidate_best_color_cache();
     }
   }
   else if (context->Type == CONTEXT_BRUSH && File_error==0)
@@ -929,95 +1226,222 @@ void Load_image(T_IO_Context *context)
     /*&& !context->Buffer_image_24b*/
     /*&& !Get_fileformat(context->Format)->Palette_only*/)
   {
+    Display_preview_image(context);
+  }
+
+}
 
-    // Try to adapt the palette to accomodate the GUI.
-    int c;
-    int count_unused;
-    byte unused_color[4];
 
-    if (context->Type == CONTEXT_PREVIEW && context->bpp > 8)
-      Set_palette_fake_24b(context->Palette);
+// -- Cache of the last previews of the file selector ----------------------
 
-    count_unused=0;
-    // Try find 4 unused colors and insert good colors there
-    for (c=255; c>=0 && count_unused<4; c--)
+/// Number of previews kept by Load_image_preview()
+#define PREVIEW_CACHE_SIZE 32
+
+/// A preview kept in memory, with everything needed to display it again.
+typedef struct
+{
+  char * Full_name;         ///< NULL for an unused entry
+  unsigned long File_size;
+  qword Time;               ///< Modification time of the file
+  dword Last_use;           ///< To find the least recently used entry
+  enum CONTEXT_TYPE Type;
+  // The preview also depends on these settings
+  byte Menu_factor_X;
+  byte Menu_factor_Y;
+  byte Maximize_preview;
+  int Pixel_ratio;
+  // Copy of the loaded context
+  byte Format;
+  int Preview_format;
+  T_Palette Palette;
+  short Width;
+  short Height;
+  short Original_width;
+  short Original_height;
+  char Comment[COMMENT_SIZE+1];
+  byte Background_transparent;
+  byte Transparent_color;
+  byte bpp;
+  enum PIXEL_RATIO Ratio;
+  short Preview_factor_X;
+  short Preview_factor_Y;
+  byte * Preview_bitmap;
+  byte Preview_usage[256];
+} T_Preview_cache_entry;
+
+static T_Preview_cache_entry Preview_cache[PREVIEW_CACHE_SIZE];
+static dword Preview_cache_clock = 0;
+
+/// Size of a preview bitmap, as allocated by Pre_load()
+#define PREVIEW_BITMAP_SIZE (PREVIEW_WIDTH*PREVIEW_HEIGHT*Menu_factor_X*Menu_factor_Y)
+
+void Load_image_preview(T_IO_Context *context)
+{
+  T_Preview_cache_entry * entry = NULL;
+  char * full_name;
+  unsigned long file_size;
+  qword time;
+  int i;
+
+  full_name = Filepath_append_to_dir(context->File_directory, context->File_name);
+  if (full_name == NULL)
+  {
+    Load_image(context);
+    return;
+  }
+  file_size = File_length(full_name);
+  time = File_modification_time(full_name);
+
+  for (i = 0; i < PREVIEW_CACHE_SIZE && time != 0; i++)
+  {
+    T_Preview_cache_entry * cached = Preview_cache + i;
+
+    if (cached->Full_name != NULL
+      && cached->File_size == file_size
+      && cached->Time == time
+      && cached->Type == context->Type
+      && cached->Menu_factor_X == Menu_factor_X
+      && cached->Menu_factor_Y == Menu_factor_Y
+      && cached->Maximize_preview == Config.Maximize_preview
+      && cached->Pixel_ratio == Pixel_ratio
+      && !strcmp(cached->Full_name, full_name))
     {
-      if (!context->Preview_usage[c])
-      {
-        unused_color[count_unused]=c;
-        count_unused++;
-      }
+      entry = cached;
+      break;
     }
-    // Found! replace them with some favorites
-    if (count_unused==4)
+  }
+  if (entry != NULL)
+  {
+    // Display the preview again, without reading the file
+    context->Format = entry->Format;
+    context->Preview_format = entry->Preview_format;
+    context->Preview_file_size = entry->File_size;
+    memcpy(context->Palette, entry->Palette, sizeof(T_Palette));
+    context->Width = entry->Width;
+    context->Height = entry->Height;
+    context->Original_width = entry->Original_width;
+    context->Original_height = entry->Original_height;
+    strcpy(context->Comment, entry->Comment);
+    context->Background_transparent = entry->Background_transparent;
+    context->Transparent_color = entry->Transparent_color;
+    context->bpp = entry->bpp;
+    context->Ratio = entry->Ratio;
+    context->Preview_factor_X = entry->Preview_factor_X;
+    context->Preview_factor_Y = entry->Preview_factor_Y;
+    memcpy(context->Preview_usage, entry->Preview_usage, sizeof(context->Preview_usage));
+    free(context->Preview_bitmap);
+    context->Preview_bitmap = NULL;
+    if (entry->Preview_bitmap != NULL)
     {
-      int gui_index;
-      for (gui_index=0; gui_index<4; gui_index++)
+      context->Preview_bitmap = GFX2_malloc(PREVIEW_BITMAP_SIZE);
+      if (context->Preview_bitmap == NULL)
       {
-        context->Palette[unused_color[gui_index]]=*Favorite_GUI_color(gui_index);
+        free(full_name);
+        Load_image(context);
+        return;
       }
+      memcpy(context->Preview_bitmap, entry->Preview_bitmap, PREVIEW_BITMAP_SIZE);
     }
-    // All preview display is here
+    File_error = 0;
+    entry->Last_use = ++Preview_cache_clock;
+    free(full_name);
+    // Pre_load() isn't called when loading palettes
+    if (context->Preview_bitmap != NULL)
+      Display_preview_infos(context);
+    Display_preview_image(context);
+    return;
+  }
 
-    // Update palette and screen first
-    Compute_optimal_menu_colors(context->Palette);
-    Remap_screen_after_menu_colors_change();
-    Set_palette(context->Palette);
+  Load_image(context);
+  if (File_error != 0 || time == 0)
+  {
+    free(full_name);
+    return;
+  }
 
-    // Display palette preview
-    if (Get_fileformat(context->Format)->Palette_only
-        || context->Type == CONTEXT_PREVIEW_PALETTE)
+  // Keep the preview, in place of the least recently used one
+  entry = Preview_cache;
+  for (i = 1; i < PREVIEW_CACHE_SIZE && entry->Full_name != NULL; i++)
+  {
+    if (Preview_cache[i].Full_name == NULL || Preview_cache[i].Last_use < entry->Last_use)
+      entry = Preview_cache + i;
+  }
+  free(entry->Full_name);
+  free(entry->Preview_bitmap);
+  entry->Preview_bitmap = NULL;
+  if (context->Preview_bitmap != NULL)
+  {
+    entry->Preview_bitmap = GFX2_malloc(PREVIEW_BITMAP_SIZE);
+    if (entry->Preview_bitmap == NULL)
     {
-      short index;
-
-      if (context->Type == CONTEXT_PREVIEW || context->Type == CONTEXT_PREVIEW_PALETTE)
-        for (index=0; index<256; index++)
-          Window_rectangle(183+(index/16)*7,95+(index&15)*5,5,5,index);
-
+      entry->Full_name = NULL;
+      free(full_name);
+      return;
     }
-    // Display normal image
-    else if (context->Preview_bitmap)
-    {
-      int x_pos,y_pos;
-      int width,height;
-      width=context->Width/context->Preview_factor_X;
-      height=context->Height/context->Preview_factor_Y;
-      if (context->Ratio == PIXEL_WIDE &&
-          Pixel_ratio != PIXEL_WIDE &&
-          Pixel_ratio != PIXEL_WIDE2)
-        width*=2;
-      else if (context->Ratio == PIXEL_TALL &&
-          Pixel_ratio != PIXEL_TALL &&
-          Pixel_ratio != PIXEL_TALL2 &&
-          Pixel_ratio != PIXEL_TALL3)
-        height*=2;
-
-      for (y_pos=0; y_pos<height;y_pos++)
-        for (x_pos=0; x_pos<width;x_pos++)
-        {
-          byte color=context->Preview_bitmap[x_pos+y_pos*PREVIEW_WIDTH*Menu_factor_X];
+    memcpy(entry->Preview_bitmap, context->Preview_bitmap, PREVIEW_BITMAP_SIZE);
+  }
+  entry->Full_name = full_name;
+  entry->File_size = file_size;
+  entry->Time = time;
+  entry->Last_use = ++Preview_cache_clock;
+  entry->Type = context->Type;
+  entry->Menu_factor_X = Menu_factor_X;
+  entry->Menu_factor_Y = Menu_factor_Y;
+  entry->Maximize_preview = Config.Maximize_preview;
+  entry->Pixel_ratio = Pixel_ratio;
+  entry->Format = context->Format;
+  entry->Preview_format = context->Preview_format;
+  memcpy(entry->Palette, context->Palette, sizeof(T_Palette));
+  entry->Width = context->Width;
+  entry->Height = context->Height;
+  entry->Original_width = context->Original_width;
+  entry->Original_height = context->Original_height;
+  strcpy(entry->Comment, context->Comment);
+  entry->Background_transparent = context->Background_transparent;
+  entry->Transparent_color = context->Transparent_color;
+  entry->bpp = context->bpp;
+  entry->Ratio = context->Ratio;
+  entry->Preview_factor_X = context->Preview_factor_X;
+  entry->Preview_factor_Y = context->Preview_factor_Y;
+  memcpy(entry->Preview_usage, context->Preview_usage, sizeof(entry->Preview_usage));
+}
 
-          // Skip transparent if image has transparent background.
-          if (color == context->Transparent_color && context->Background_transparent)
-            color=MC_Window;
+void Free_preview_cache(void)
+{
+  int i;
 
-          Pixel(context->Preview_pos_X+x_pos,
-                context->Preview_pos_Y+y_pos,
-                color);
-        }
-    }
-    // Refresh modified part
-    Update_window_area(183,95,PREVIEW_WIDTH,PREVIEW_HEIGHT);
+  for (i = 0; i < PREVIEW_CACHE_SIZE; i++)
+  {
+    free(Preview_cache[i].Full_name);
+    Preview_cache[i].Full_name = NULL;
+    free(Preview_cache[i].Preview_bitmap);
+    Preview_cache[i].Preview_bitmap = NULL;
+  }
+}
 
-    // Preview comment
-    Print_in_window(45,70,context->Comment,MC_Black,MC_Light);
-    //Update_window_area(45,70,32*8,8);
+/// Drops the cached preview of a file which has been written.
+/// (Its size and modification time, in seconds, may not have changed)
+static void Forget_preview(const T_IO_Context *context)
+{
+  char * full_name;
+  int i;
 
+  full_name = Filepath_append_to_dir(context->File_directory, context->File_name);
+  if (full_name == NULL)
+    return;
+  for (i = 0; i < PREVIEW_CACHE_SIZE; i++)
+  {
+    if (Preview_cache[i].Full_name != NULL && !strcmp(Preview_cache[i].Full_name, full_name))
+    {
+      free(Preview_cache[i].Full_name);
+      Preview_cache[i].Full_name = NULL;
+      free(Preview_cache[i].Preview_bitmap);
+      Preview_cache[i].Preview_bitmap = NULL;
+    }
   }
-
+  free(full_name);
 }
 
-
 // -- Sauver n'importe quel type connu de fichier d'image (ou palette) ------
 void Save_image(T_IO_Context *context)
 {
@@ -1111,6 +1535,7 @@ void Save_image(T_IO_Context *context)
   {
     if (format->Save)
       format->Save(context);
+    Forget_preview(context);
   }
 
   if (File_error)
@@ -1826,12 +2251,44 @@ const T_Format * Get_fileformat(byte format)
   return safe_default;
 }
 
+const T_Format * Get_fileformat_by_name(const char * name)
+{
+  unsigned int i;
+
+  // Labels and default extensions first, so "iff" is LBM rather than PBM
+  for (i=0; i < Nb_known_formats(); i++)
+  {
+    const char * label = File_formats[i].Label;
+
+    if (File_formats[i].Save == NULL || File_formats[i].Palette_only)
+      continue;
+    while (*label == ' ')
+      label++;
+    if (!strcasecmp(label, name) || !strcasecmp(File_formats[i].Default_extension, name))
+      return &(File_formats[i]);
+  }
+  for (i=0; i < Nb_known_formats(); i++)
+  {
+    if (File_formats[i].Save == NULL || File_formats[i].Palette_only)
+      continue;
+    if (Extension_matches(&(File_formats[i]), name))
+      return &(File_formats[i]);
+  }
+  return NULL;
+}
+
 /// Query the color of a pixel (to save)
 byte Get_pixel(T_IO_Context *context, short x, short y)
 {
   return *(context->Target_address + y*context->Pitch + x);
 }
 
+/// Copy the colors of consecutive pixels of a line (to save)
+void Get_pixel_row(T_IO_Context *context, short x, short y, short width, byte * colors)
+{
+  memcpy(colors, context->Target_address + y*context->Pitch + x, width);
+}
+
 /// Cleans up resources
 void Destroy_context(T_IO_Context *context)
 {
@@ -2194,8 +2651,6 @@ if (Create_lock_file(Config_directory))
 void Rotate_safety_backups(void)
 {
   dword now;
-  T_IO_Context context;
-  char file_name[12+1];
 
   if (!Safety_backup_active)
     return;
@@ -2211,39 +2666,76 @@ void Rotate_safety_backups(void)
       (Main.edits_since_safety_backup > 1 &&
       now > Main.time_of_safety_backup + Max_interval_for_safety_backup))
   {
-    char * deleted_file;
-    size_t len = strlen(Config_directory) + strlen(BACKUP_FILE_EXTENSION) + 1 + 6 + 1;
-
-    deleted_file = GFX2_malloc(len);
-    if (deleted_file == NULL)
-      return;
-    // Clear a previous save (rotating saves)
-    snprintf(deleted_file, len, "%s%c%6.6d" BACKUP_FILE_EXTENSION,
-      Config_directory,
-      Main.safety_backup_prefix,
-      (dword)(Main.safety_number + 1000000l - Rotation_safety_backup) % (dword)1000000l);
-    Remove_path(deleted_file); // no matter if fail
-    free(deleted_file);
-
     // Reset counters
     Main.edits_since_safety_backup=0;
     Main.time_of_safety_backup=now;
 
-    // Create a new file name and save
-    sprintf(file_name, "%c%6.6d" BACKUP_FILE_EXTENSION,
-      Main.safety_backup_prefix,
-      (int)Main.safety_number);
-    Init_context_backup_image(&context, file_name, Config_directory);
-    context.Format=FORMAT_GIF;
-    // Provide original file data, to store as a GIF Application Extension
-    context.Original_file_name = strdup(Main.backups->Pages->Filename);
-    context.Original_file_directory = strdup(Main.backups->Pages->File_directory);
-
-    Save_image(&context);
-    Destroy_context(&context);
+    // The file is written by Write_pending_safety_backup(), once the user
+    // pauses, so that saving a large image doesn't interrupt a drawing.
+    Main.safety_backup_pending=1;
+  }
+}
 
-    Main.safety_number++;
+void Write_pending_safety_backup(void)
+{
+  T_IO_Context context;
+  char file_name[12+1];
+  char temp_name[12+1];
+  char * full_name;
+  char * temp_full_name;
+  size_t len;
+
+  if (!Safety_backup_active || !Main.safety_backup_pending)
+    return;
+  Main.safety_backup_pending=0;
+
+  len = strlen(Config_directory) + strlen(BACKUP_FILE_EXTENSION) + 1 + 6 + 1;
+  full_name = GFX2_malloc(len);
+  temp_full_name = GFX2_malloc(len);
+  if (full_name == NULL || temp_full_name == NULL)
+  {
+    free(full_name);
+    free(temp_full_name);
+    return;
   }
+  // Clear a previous save (rotating saves)
+  snprintf(full_name, len, "%s%c%6.6d" BACKUP_FILE_EXTENSION,
+    Config_directory,
+    Main.safety_backup_prefix,
+    (dword)(Main.safety_number + 1000000l - Rotation_safety_backup) % (dword)1000000l);
+  Remove_path(full_name); // no matter if fail
+
+  // Create a new file name and save.
+  // The image is written under a temporary name which Check_recovery()
+  // ignores, then renamed, so an interrupted save never leaves a
+  // truncated backup behind.
+  sprintf(file_name, "%c%6.6d" BACKUP_FILE_EXTENSION,
+    Main.safety_backup_prefix,
+    (int)Main.safety_number);
+  sprintf(temp_name, "~%c" BACKUP_FILE_EXTENSION, Main.safety_backup_prefix);
+  snprintf(full_name, len, "%s%s", Config_directory, file_name);
+  snprintf(temp_full_name, len, "%s%s", Config_directory, temp_name);
+
+  Init_context_backup_image(&context, temp_name, Config_directory);
+  context.Format=FORMAT_GIF;
+  // Provide original file data, to store as a GIF Application Extension
+  context.Original_file_name = strdup(Main.backups->Pages->Filename);
+  context.Original_file_directory = strdup(Main.backups->Pages->File_directory);
+
+  Save_image(&context);
+  Destroy_context(&context);
+
+  if (File_error == 0)
+  {
+    if (Rename_path(temp_full_name, full_name) != 0)
+      GFX2_Log(GFX2_WARNING, "Failed to rename %s to %s\n", temp_full_name, full_name);
+  }
+  else
+    Remove_path(temp_full_name);
+  free(temp_full_name);
+  free(full_name);
+
+  Main.safety_number++;
 }
 
 /// Remove safety backups. Need to call on normal program exit.
@@ -2255,6 +2747,10 @@ void Delete_safety_backups(void)
   if (!Safety_backup_active)
     return;
 
+  // Cancel the backups which were not written yet
+  Main.safety_backup_pending = 0;
+  Spare.safety_backup_pending = 0;
+
   Backups_main = NULL;
   Backups_spare = NULL;
 
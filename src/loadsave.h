@@ -106,6 +106,8 @@ typedef struct
   short Preview_pos_Y;
   byte *Preview_bitmap;
   byte  Preview_usage[256];
+  long  Preview_file_size;
+  int   Preview_format; ///< Format displayed in the preview, can differ from Format
   
   // Internal: returned surface for Surface case
   T_GFX2_Surface * Surface;
@@ -151,18 +153,34 @@ void Load_image(T_IO_Context *context);
 /// High-level picture saving function.
 void Save_image(T_IO_Context *context);
 
+///
+/// Preview of a file in the file selector: same as Load_image(), but
+/// the last previews are kept in memory, so a file which didn't change
+/// since it was previewed is displayed again without loading it.
+void Load_image_preview(T_IO_Context *context);
+
+/// Frees the previews kept by Load_image_preview().
+void Free_preview_cache(void);
+
 ///
 /// Checks if there are any pending safety backups, and then opens them.
 /// Returns 0 if there were none
 /// Returns non-zero if some backups were loaded.
 int Check_recovery(void);
 
-/// Makes a safety backup periodically.
+/// Schedules a safety backup periodically.
 void Rotate_safety_backups(void);
 
+/// Writes the scheduled safety backup, if any. Call when the user is idle.
+void Write_pending_safety_backup(void);
+
 /// Remove safety backups. Need to call on normal program exit.
 void Delete_safety_backups(void);
 
+/// Tells if the safety backup system is active: then this instance of the
+/// program owns the files in the configuration directory.
+extern byte Safety_backup_active;
+
 /// Data for an image file format.
 typedef struct {
   enum FILE_FORMATS Identifier; ///< Identifier for this format
@@ -202,11 +220,24 @@ extern enum PIXEL_RATIO Ratio_of_loaded_image;
 
 const T_Format * Get_fileformat(byte format);
 
+///
+/// Find the format which saves pictures, from its label or one of its
+/// file extensions (for example "png" or "lbm").
+/// @return NULL if no such format exists
+const T_Format * Get_fileformat_by_name(const char * name);
+
+///
+/// Checks if a file extension (without the dot) is one of the format's extensions.
+int Extension_matches(const T_Format * format, const char * extension);
+
 // -- File formats
 
 /// Total number of known file formats
 unsigned int Nb_known_formats(void);
 
+/// Number of format Test functions called by Load_image(), to measure the cost of format detection
+extern unsigned long Format_tests_count;
+
 // Internal use
 
 /// Generic allocation and similar stuff, done at beginning of image load, as soon as size is known.
@@ -216,8 +247,12 @@ void Fill_canvas(T_IO_Context *context, byte color);
 
 /// Query the color of a pixel (to save)
 byte Get_pixel(T_IO_Context *context, short x, short y);
+/// Query the colors of @p width consecutive pixels of a line (to save)
+void Get_pixel_row(T_IO_Context *context, short x, short y, short width, byte * colors);
 /// Set the color of a pixel (on load)
 void Set_pixel(T_IO_Context *context, short x, short y, byte c);
+/// Set the colors of @p width consecutive pixels of a line (on load)
+void Set_pixel_row(T_IO_Context *context, short x, short y, short width, const byte * colors);
 /// Set the color of a 24bit pixel (on load)
 void Set_pixel_24b(T_IO_Context *context, short x, short y, byte r, byte g, byte b);
 /// Function to call when need to switch layers.
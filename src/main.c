@@ -67,6 +67,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _MSC_VER
+#include <strings.h>
+#endif
 #include <signal.h>
 #ifndef _MSC_VER
 #include <unistd.h>
@@ -76,6 +79,12 @@
 #define snprintf _snprintf
 #endif
 #endif
+#if defined(__unix__) || defined(__macosx__)
+/// The batch mode can spread the pictures over several processes
+#define BATCH_CAN_FORK
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
 #if defined(USE_SDL) || defined(USE_SDL2)
 #include <SDL.h>
 #include <SDL_image.h>
@@ -151,6 +160,30 @@ extern char Program_version[]; // generated in pversion.c
 static int setsize_width;
 static int setsize_height;
 
+/// Format name given with -convert, NULL to keep the format of each picture
+static const char * batch_format;
+/// Full path of the script given with -script
+static char * batch_script;
+/// Full path of the directory given with -output
+static char * batch_output;
+/// Full path of all the pictures and directories given on the command line
+static char ** batch_files;
+static int batch_files_count;
+/// Number of processes given with -jobs, 0 for one per processor
+static int batch_jobs = 1;
+
+/// A picture to process in batch mode
+typedef struct
+{
+  char * full_path; ///< Absolute path of the picture
+  size_t relative;  ///< Offset in full_path of the part kept under the -output directory
+} T_Batch_item;
+
+/// All the pictures to process, after the directories are scanned
+static T_Batch_item * batch_items;
+static int batch_items_count;
+static int batch_items_size;
+
 #if (defined(USE_SDL) || defined(USE_SDL2)) && defined(USE_JOYSTICK)
 /// Pointer to the current joystick controller.
 static SDL_Joystick* Joystick;
@@ -167,7 +200,8 @@ void Display_syntax(void)
   int mode_index, i;
   char modes[1024*2];
   const char * syntax =
-    "Syntax: grafx2 [<arguments>] [<picture1>] [<picture2>]\n\n"
+    "Syntax: grafx2 [<arguments>] [<picture1>] [<picture2>]\n"
+    "        grafx2 -batch [<arguments>] <picture1> [<picture2> ...]\n\n"
     "<arguments> can be:\n"
     "\t-? -h -H -help     for this help screen\n"
     "\t-verbose           to increase log verbosity\n"
@@ -183,8 +217,17 @@ void Display_syntax(void)
     "\t-skin <filename>   to use an alternate file with the menu graphics\n"
     "\t-mode <videomode>  to set a video mode\n"
     "\t-size <resolution> to set the image size\n"
+    "\t-batch             to process the pictures without opening a window\n"
+    "\t-convert <format>  to save the pictures in another format (implies -batch)\n"
+    "\t-script <file.lua> to run a script on each picture (implies -batch)\n"
+    "\t-output <dir>      to save the processed pictures there (implies -batch)\n"
+    "\t-jobs n            to process n pictures at once (0=one per processor)\n"
+    "-batch alone only checks that the pictures can be loaded. With -script they\n"
+    "are saved in place, unless -convert or -output is given. The exit status\n"
+    "is 1 if any picture failed.\n"
+    "Directories are searched for pictures, including their subdirectories.\n"
     "Arguments can be prefixed either by / - or --\n"
-    "They can also be abbreviated.\n\n";
+    "They can also be abbreviated, except the batch mode ones.\n\n";
   fputs(syntax, stdout);
 
   i = snprintf(modes, sizeof(modes), "Available video modes:\n\n");
@@ -220,6 +263,8 @@ void Error_function(int error_code, const char *filename, int line_number, const
 
   if (error_code==0)
   {
+    if (Batch_mode)
+      return; // No screen to flash: the message above is enough
     // L'erreur 0 n'est pas une vraie erreur, elle fait seulement un flash rouge de l'écran pour dire qu'il y a un problème.
     // Toutes les autres erreurs déclenchent toujours une sortie en catastrophe du programme !
     memcpy(backup_palette, Get_current_palette(), sizeof(T_Palette));
@@ -313,6 +358,11 @@ enum CMD_PARAMS
     CMDPARAM_SKIN,
     CMDPARAM_SIZE,
     CMDPARAM_VERBOSE,
+    CMDPARAM_BATCH,
+    CMDPARAM_CONVERT,
+    CMDPARAM_SCRIPT,
+    CMDPARAM_OUTPUT,
+    CMDPARAM_JOBS,
 };
 
 struct {
@@ -337,6 +387,11 @@ struct {
     {"skin", CMDPARAM_SKIN},
     {"size", CMDPARAM_SIZE},
     {"verbose", CMDPARAM_VERBOSE},
+    {"batch", CMDPARAM_BATCH},
+    {"convert", CMDPARAM_CONVERT},
+    {"script", CMDPARAM_SCRIPT},
+    {"output", CMDPARAM_OUTPUT},
+    {"jobs", CMDPARAM_JOBS},
 };
 
 #define ARRAY_SIZE(x) (int)(sizeof(x) / sizeof(x[0]))
@@ -351,6 +406,8 @@ struct {
  * @param videomode_arg pointer to receive the -mode argument
  * @param pixel_ratio pointer to receive the pixel ratio requested
  * @return the number of file to open (0, 1 or 2)
+ *
+ * All the files are also kept in batch_files[] for the batch mode.
  */
 int Analyze_command_line(int argc, char * argv[], char * filenames[], char * directories[], const char ** videomode_arg, int * pixel_ratio)
 {
@@ -362,6 +419,11 @@ int Analyze_command_line(int argc, char * argv[], char * filenames[], char * dir
   file_in_command_line = 0;
   Resolution_in_command_line = 0;
 
+  batch_files = (char **)GFX2_malloc(argc * sizeof(char *));
+  if (batch_files == NULL)
+    Error(ERROR_MEMORY);
+  batch_files_count = 0;
+
   Current_resolution = Config.Default_resolution;
 
   for (index = 1; index<argc; index++)
@@ -397,7 +459,9 @@ int Analyze_command_line(int argc, char * argv[], char * filenames[], char * dir
           paramtype = cmdparams[tmpi].id;
           break;
         }
-        else if (strstr(cmdparams[tmpi].param, s))
+        // The batch options can't be abbreviated, so the existing
+        // abbreviations (like -v for -verbose) keep their meaning
+        else if (cmdparams[tmpi].id < CMDPARAM_BATCH && strstr(cmdparams[tmpi].param, s))
         {
           param_matches++;
           param_match = cmdparams[tmpi].id;
@@ -532,17 +596,77 @@ int Analyze_command_line(int argc, char * argv[], char * filenames[], char * dir
       case CMDPARAM_VERBOSE:
         GFX2_verbosity_level++;
         break;
+      case CMDPARAM_BATCH:
+        Batch_mode = 1;
+        break;
+      case CMDPARAM_CONVERT:
+        index++;
+        if (index<argc)
+        {
+          batch_format = argv[index];
+          Batch_mode = 1;
+        }
+        else
+        {
+          Error(ERROR_COMMAND_LINE);
+          exit(0);
+        }
+        break;
+      case CMDPARAM_SCRIPT:
+        index++;
+        if (index<argc && File_exists(argv[index]))
+        {
+          batch_script = Realpath(argv[index], NULL);
+          Batch_mode = 1;
+        }
+        else
+        {
+          Error(ERROR_COMMAND_LINE);
+          exit(0);
+        }
+        break;
+      case CMDPARAM_OUTPUT:
+        index++;
+        if (index<argc && Directory_exists(argv[index]))
+        {
+          batch_output = Realpath(argv[index], NULL);
+          Batch_mode = 1;
+        }
+        else
+        {
+          Error(ERROR_COMMAND_LINE);
+          exit(0);
+        }
+        break;
+      case CMDPARAM_JOBS:
+        index++;
+        if (index<argc)
+        {
+          batch_jobs = atoi(argv[index]);
+          if (batch_jobs < 0 || batch_jobs > 256)
+          {
+            Error(ERROR_COMMAND_LINE);
+            exit(0);
+          }
+        }
+        else
+        {
+          Error(ERROR_COMMAND_LINE);
+          exit(0);
+        }
+        break;
       default:
         // Si ce n'est pas un paramètre, c'est le nom du fichier à ouvrir
-        if (file_in_command_line > 1)
+        if (!File_exists(argv[index]))
         {
-          // Il y a déjà 2 noms de fichiers et on vient d'en trouver un 3ème
           Error(ERROR_COMMAND_LINE);
           exit(0);
         }
-        else if (File_exists(argv[index]))
+        batch_files[batch_files_count++] = Realpath(argv[index], NULL);
+        // Only the first two files are opened in the main and spare pages
+        if (file_in_command_line < 2)
         {
-          buffer = Realpath(argv[index], NULL);
+          buffer = strdup(batch_files[batch_files_count-1]);
           filename = Find_last_separator(buffer);
           if (filename != NULL)
           {
@@ -560,14 +684,15 @@ int Analyze_command_line(int argc, char * argv[], char * filenames[], char * dir
           buffer = NULL;
           file_in_command_line++;
         }
-        else
-        {
-          Error(ERROR_COMMAND_LINE);
-          exit(0);
-        }
         break;
     }
   }
+  if (!Batch_mode && batch_files_count > 2)
+  {
+    // Il y a plus de 2 noms de fichiers
+    Error(ERROR_COMMAND_LINE);
+    exit(0);
+  }
   return file_in_command_line;
 }
 
@@ -736,60 +861,64 @@ int Init_program(int argc,char * argv[])
   Spare.time_of_safety_backup = 0;
 
 
+  // The batch mode doesn't open any window
+  if (!Batch_mode)
+  {
 #if defined(USE_SDL) || defined(USE_SDL2)
-  // SDL
-  if (SDL_Init(SDL_INIT_VIDEO
+    // SDL
+    if (SDL_Init(SDL_INIT_VIDEO
 #if defined(USE_JOYSTICK)
-               | SDL_INIT_JOYSTICK
+                 | SDL_INIT_JOYSTICK
 #endif
-              ) < 0)
-  {
-    // The program can't continue without that anyway
-    printf("Couldn't initialize SDL.\n");
-    return(0);
-  }
+                ) < 0)
+    {
+      // The program can't continue without that anyway
+      printf("Couldn't initialize SDL.\n");
+      return(0);
+    }
 
 #if defined(USE_SDL2)
-  SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_VERBOSE);
+    SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_VERBOSE);
 #endif
 #endif
 #if defined(USE_SDL)
-  SDL_EnableKeyRepeat(250, 32);
-  SDL_EnableUNICODE(SDL_ENABLE);
-  SDL_WM_SetCaption("GrafX2","GrafX2");
+    SDL_EnableKeyRepeat(250, 32);
+    SDL_EnableUNICODE(SDL_ENABLE);
+    SDL_WM_SetCaption("GrafX2","GrafX2");
 #endif
-  Define_icon();
+    Define_icon();
 
-  // Texte
-  Init_text();
+    // Texte
+    Init_text();
 
-  // Initialize all video modes
-  Set_all_video_modes();
+    // Initialize all video modes
+    Set_all_video_modes();
 
 #if defined(USE_JOYSTICK) && (defined(USE_SDL) || defined(USE_SDL2))
-  GFX2_Log(GFX2_DEBUG, "%d joystick(s) attached\n", SDL_NumJoysticks());
-  if (SDL_NumJoysticks() > 0)
-  {
-    Joystick = SDL_JoystickOpen(0);
-    if (Joystick == NULL)
-    {
-      GFX2_Log(GFX2_ERROR, "Failed to open joystick #0 : %s\n", SDL_GetError());
-    }
-    else
+    GFX2_Log(GFX2_DEBUG, "%d joystick(s) attached\n", SDL_NumJoysticks());
+    if (SDL_NumJoysticks() > 0)
     {
-      GFX2_Log(GFX2_DEBUG, "Joystick #0 open : \"%s\" %d axes, %d buttons, %d balls, %d hats\n",
+      Joystick = SDL_JoystickOpen(0);
+      if (Joystick == NULL)
+      {
+        GFX2_Log(GFX2_ERROR, "Failed to open joystick #0 : %s\n", SDL_GetError());
+      }
+      else
+      {
+        GFX2_Log(GFX2_DEBUG, "Joystick #0 open : \"%s\" %d axes, %d buttons, %d balls, %d hats\n",
 #if defined(USE_SDL2)
-               SDL_JoystickName(Joystick),
+                 SDL_JoystickName(Joystick),
 #else
-               SDL_JoystickName(0),
+                 SDL_JoystickName(0),
 #endif
-               SDL_JoystickNumAxes(Joystick),
-               SDL_JoystickNumButtons(Joystick), SDL_JoystickNumBalls(Joystick),
-               SDL_JoystickNumHats(Joystick));
-      SDL_JoystickEventState(SDL_ENABLE);
+                 SDL_JoystickNumAxes(Joystick),
+                 SDL_JoystickNumButtons(Joystick), SDL_JoystickNumBalls(Joystick),
+                 SDL_JoystickNumHats(Joystick));
+        SDL_JoystickEventState(SDL_ENABLE);
+      }
     }
-  }
 #endif
+  }
 
   Pixel_ratio=PIXEL_SIMPLE;
   // On initialise les données sur l'état du programme:
@@ -911,6 +1040,33 @@ int Init_program(int argc,char * argv[])
     Remove_duplicate_shortcuts();
   }
 
+  if (Batch_mode)
+  {
+    // No skin, font nor video mode: only the pages and a brush for scripts
+    Brush = (byte *)GFX2_malloc(1*1);
+    Brush_original_pixels = (byte *)GFX2_malloc(1*1);
+    Smear_brush = (byte *)GFX2_malloc(MAX_PAINTBRUSH_SIZE*MAX_PAINTBRUSH_SIZE);
+    if (!Brush || !Brush_original_pixels || !Smear_brush)
+      Error(ERROR_MEMORY);
+    Brush_width=1;
+    Brush_height=1;
+    *Brush=0;
+    *Brush_original_pixels=0;
+    for (temp=0;temp<256;temp++)
+      Brush_colormap[temp]=temp;
+
+    if (Init_all_backup_lists(IMAGE_MODE_LAYERED, 1, 1)==0)
+      Error(ERROR_MEMORY);
+    Gradient_function=Gradient_basic;
+
+    while (file_in_command_line-- > 0)
+    {
+      free(directories[file_in_command_line]);
+      free(filenames[file_in_command_line]);
+    }
+    return(1);
+  }
+
   Compute_menu_offsets();
 
   Current_help_section=0;
@@ -952,6 +1108,7 @@ int Init_program(int argc,char * argv[])
   Load_Unicode_fonts();
 
   memcpy(Main.palette, Gfx->Default_palette, sizeof(T_Palette));
+  Invalidate_best_color_cache();
 
   Fore_color=Best_color_range(255,255,255,Config.Palette_cells_X*Config.Palette_cells_Y);
   Back_color=Best_color_range(0,0,0,Config.Palette_cells_X*Config.Palette_cells_Y);
@@ -1227,6 +1384,396 @@ int Init_program(int argc,char * argv[])
   return(1);
 }
 
+/// Checks that a format can save pictures without asking for settings in a window
+static int Batch_can_save(const T_Format * format)
+{
+  return format->Save != NULL
+    && format->Identifier != FORMAT_C64
+    && format->Identifier != FORMAT_MOTO;
+}
+
+/**
+ * Run the -script on the picture of an IO context, in batch mode.
+ *
+ * The picture is copied into the main page, and the result (the visible
+ * image and palette) copied back into the context.
+ * @return 0 on success
+ */
+static int Batch_run_script(T_IO_Context * context)
+{
+  int width = context->Width;
+  int height = context->Height;
+
+  if (!Backup_with_new_dimensions(width, height))
+    return 1;
+  memcpy(Main.backups->Pages->Image[0].Pixels, context->Surface->pixels, width*height);
+  memcpy(Main.backups->Pages->Palette, context->Palette, sizeof(T_Palette));
+  memcpy(Main.palette, context->Palette, sizeof(T_Palette));
+  Invalidate_best_color_cache();
+  Main.backups->Pages->Transparent_color = context->Transparent_color;
+  Main.backups->Pages->Background_transparent = context->Background_transparent;
+  // For getfilename()
+  free(Main.backups->Pages->Filename);
+  Main.backups->Pages->Filename = strdup(context->File_name);
+  free(Main.backups->Pages->File_directory);
+  Main.backups->Pages->File_directory = strdup(context->File_directory);
+  Redraw_layered_image();
+  End_of_modification();
+
+  if (Run_script_batch(batch_script))
+    return 1;
+
+  Redraw_layered_image();
+  if (Main.image_width != width || Main.image_height != height)
+  {
+    // The script has resized the picture
+    Free_GFX2_Surface(context->Surface);
+    context->Surface = New_GFX2_Surface(Main.image_width, Main.image_height);
+    if (context->Surface == NULL)
+      return 1;
+    context->Width = Main.image_width;
+    context->Height = Main.image_height;
+  }
+  memcpy(context->Surface->pixels, Main.visible_image.Image, context->Width*context->Height);
+  memcpy(context->Palette, Main.palette, sizeof(T_Palette));
+  return 0;
+}
+
+/**
+ * Add a picture to batch_items[].
+ *
+ * @param full_path absolute path of the picture, freed with the list
+ * @param relative offset of the path to keep under the -output directory
+ */
+static void Batch_add_item(char * full_path, size_t relative)
+{
+  if (batch_items_count >= batch_items_size)
+  {
+    int new_size = batch_items_size > 0 ? batch_items_size * 2 : 64;
+    T_Batch_item * new_items = (T_Batch_item *)realloc(batch_items, new_size * sizeof(T_Batch_item));
+
+    if (new_items == NULL)
+    {
+      GFX2_Log(GFX2_ERROR, "%s: not enough memory\n", full_path);
+      free(full_path);
+      return;
+    }
+    batch_items = new_items;
+    batch_items_size = new_size;
+  }
+  batch_items[batch_items_count].full_path = full_path;
+  batch_items[batch_items_count].relative = relative;
+  batch_items_count++;
+}
+
+/// Data for Batch_scan_callback()
+typedef struct
+{
+  const char * directory;
+  size_t relative;
+  int depth;
+} T_Batch_scan;
+
+static void Batch_scan_directory(const char * directory, size_t relative, int depth);
+
+/// For_each_directory_entry() callback, adds the pictures and scans the subdirectories
+static void Batch_scan_callback(void * pdata, const char * filename, const word * unicode_filename, byte is_file, byte is_directory, byte is_hidden)
+{
+  const T_Batch_scan * scan = (const T_Batch_scan *)pdata;
+  const char * extension;
+  char * full_path;
+
+  (void)unicode_filename;
+  if (is_hidden || !strcmp(filename, ".") || !strcmp(filename, ".."))
+    return;
+  extension = strrchr(filename, '.');
+  if (is_file && (extension == NULL || !Extension_matches(Get_fileformat(FORMAT_ALL_IMAGES), extension + 1)))
+    return;
+
+  full_path = Filepath_append_to_dir(scan->directory, filename);
+  if (full_path == NULL)
+    return;
+  if (is_directory)
+  {
+    Batch_scan_directory(full_path, scan->relative, scan->depth + 1);
+    free(full_path);
+  }
+  else if (is_file)
+    Batch_add_item(full_path, scan->relative);
+  else
+    free(full_path);
+}
+
+/// Adds the pictures of a directory and its subdirectories to batch_items[]
+static void Batch_scan_directory(const char * directory, size_t relative, int depth)
+{
+  T_Batch_scan scan;
+
+  // Stop looping symbolic links
+  if (depth > 32)
+    return;
+  scan.directory = directory;
+  scan.relative = relative;
+  scan.depth = depth;
+  For_each_directory_entry(directory, &scan, Batch_scan_callback);
+}
+
+/**
+ * Create a directory and its missing parents.
+ *
+ * @return 0 on success
+ */
+static int Batch_create_directory(const char * directory)
+{
+  char * path;
+  char * separator;
+  int error = 0;
+
+  if (Directory_exists(directory))
+    return 0;
+  path = strdup(directory);
+  if (path == NULL)
+    return 1;
+  for (separator = path + 1; !error && *separator != '\0'; separator++)
+  {
+    if (*separator != PATH_SEPARATOR[0])
+      continue;
+    *separator = '\0';
+    // Another job may have created it meanwhile
+    if (!Directory_exists(path) && Directory_create(path) && !Directory_exists(path))
+      error = 1;
+    *separator = PATH_SEPARATOR[0];
+  }
+  if (!error && !Directory_exists(path) && Directory_create(path) && !Directory_exists(path))
+    error = 1;
+  free(path);
+  return error;
+}
+
+/**
+ * Load, process and save one picture in batch mode.
+ *
+ * @param item the picture
+ * @param format format to save the picture, NULL to keep its own format
+ * @return 0 on success
+ */
+static int Batch_file(const T_Batch_item * item, const T_Format * format)
+{
+  T_IO_Context context;
+  const char * full_path = item->full_path;
+  const char * name;
+  char * directory;
+  int error = 0;
+
+  directory = Extract_path(NULL, full_path);
+  name = Find_last_separator(full_path);
+  name = (name != NULL) ? name + 1 : full_path;
+  Init_context_surface(&context, name, directory);
+  free(directory);
+
+  Load_image(&context);
+  if (File_error != 0 || context.Surface == NULL)
+  {
+    GFX2_Log(GFX2_ERROR, "%s: unable to load the picture\n", full_path);
+    error = 1;
+  }
+  else if (batch_script != NULL && Batch_run_script(&context))
+  {
+    GFX2_Log(GFX2_ERROR, "%s: the script failed\n", full_path);
+    error = 1;
+  }
+  else if (format != NULL || batch_script != NULL || batch_output != NULL)
+  {
+    if (format == NULL)
+      format = Get_fileformat(context.Format);
+    if (!Batch_can_save(format))
+    {
+      GFX2_Log(GFX2_ERROR, "%s: the%s format cannot be saved in batch mode\n", full_path, format->Label);
+      error = 1;
+    }
+    else
+    {
+      if (batch_format != NULL)
+      {
+        // Replace the extension
+        const char * label = format->Label;
+        const char * extension;
+        char * dot;
+        char * new_name;
+
+        while (*label == ' ')
+          label++;
+        extension = strcasecmp(batch_format, label) ? batch_format : format->Default_extension;
+        new_name = GFX2_malloc(strlen(context.File_name) + 1 + strlen(extension) + 1);
+        if (new_name == NULL)
+          error = 1;
+        else
+        {
+          strcpy(new_name, context.File_name);
+          dot = strrchr(new_name, '.');
+          if (dot != NULL && dot != new_name)
+            *dot = '\0';
+          strcat(new_name, ".");
+          strcat(new_name, extension);
+          free(context.File_name);
+          context.File_name = new_name;
+        }
+      }
+      if (batch_output != NULL)
+      {
+        // Keep the subdirectories of the scanned directories
+        const char * relative_path = full_path + item->relative;
+        size_t length = name - relative_path;
+
+        free(context.File_directory);
+        context.File_directory = GFX2_malloc(strlen(batch_output) + strlen(PATH_SEPARATOR) + length + 1);
+        if (context.File_directory == NULL)
+          error = 1;
+        else
+        {
+          strcpy(context.File_directory, batch_output);
+          if (length > 0)
+          {
+            Append_path(context.File_directory, "", NULL);
+            strncat(context.File_directory, relative_path, length);
+          }
+          if (Batch_create_directory(context.File_directory))
+          {
+            GFX2_Log(GFX2_ERROR, "%s: unable to create %s\n", full_path, context.File_directory);
+            error = 1;
+          }
+        }
+      }
+      if (!error)
+      {
+        context.Format = format->Identifier;
+        context.Target_address = context.Surface->pixels;
+        context.Pitch = context.Surface->w;
+        File_error = 0;
+        Save_image(&context);
+        if (File_error != 0)
+        {
+          GFX2_Log(GFX2_ERROR, "%s: unable to save %s\n", full_path, context.File_name);
+          error = 1;
+        }
+        else
+        {
+          char * output_path = Filepath_append_to_dir(context.File_directory, context.File_name);
+          GFX2_Log(GFX2_INFO, "%s -> %s\n", full_path, output_path);
+          free(output_path);
+        }
+      }
+    }
+  }
+
+  if (context.Surface != NULL)
+    Free_GFX2_Surface(context.Surface);
+  Destroy_context(&context);
+  return error;
+}
+
+/**
+ * Process the pictures of the command line, without opening a window.
+ *
+ * @return the number of pictures that could not be processed
+ */
+static int Batch_process(void)
+{
+  const T_Format * format = NULL;
+  int failures = 0;
+  int i;
+
+  if (batch_format != NULL)
+  {
+    format = Get_fileformat_by_name(batch_format);
+    if (format == NULL || !Batch_can_save(format))
+    {
+      GFX2_Log(GFX2_ERROR, "Cannot save pictures as \"%s\" in batch mode\n", batch_format);
+      return batch_files_count > 0 ? batch_files_count : 1;
+    }
+  }
+
+  for (i = 0; i < batch_files_count; i++)
+  {
+    if (Directory_exists(batch_files[i]))
+    {
+      size_t relative = strlen(batch_files[i]);
+
+      // The pictures are kept relative to the scanned directory
+      if (relative > 0 && batch_files[i][relative-1] != PATH_SEPARATOR[0])
+        relative++;
+      Batch_scan_directory(batch_files[i], relative, 0);
+    }
+    else
+    {
+      const char * name = Find_last_separator(batch_files[i]);
+      char * full_path = strdup(batch_files[i]);
+      if (full_path != NULL)
+        Batch_add_item(full_path, name != NULL ? (size_t)(name + 1 - batch_files[i]) : 0);
+    }
+  }
+
+#if defined(BATCH_CAN_FORK)
+  // The loaders and savers share global state (File_error, Main...),
+  // so the pictures are spread over processes rather than threads.
+  if (batch_jobs == 0)
+    batch_jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (batch_jobs > batch_items_count)
+    batch_jobs = batch_items_count;
+  if (batch_jobs > 1)
+  {
+    pid_t pid = 1;
+    int started = 0;
+    int job;
+
+    fflush(stdout);
+    fflush(stderr);
+    for (job = 1; job < batch_jobs && pid > 0; job++)
+    {
+      pid = fork();
+      if (pid == 0)
+      {
+        // This process handles the pictures job, job+N, job+2N...
+        for (i = job; i < batch_items_count; i += batch_jobs)
+          failures += Batch_file(&batch_items[i], format);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(failures > 0 ? 1 : 0);
+      }
+      if (pid > 0)
+        started++;
+    }
+    // Job 0, and the jobs which could not be started, are done here
+    for (i = 0; i < batch_items_count; i++)
+    {
+      if (i % batch_jobs == 0 || i % batch_jobs > started)
+        failures += Batch_file(&batch_items[i], format);
+    }
+    while (started > 0)
+    {
+      int status;
+      if (wait(&status) < 0)
+        break;
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        failures++;
+      started--;
+    }
+  }
+  else
+#endif
+  {
+    for (i = 0; i < batch_items_count; i++)
+      failures += Batch_file(&batch_items[i], format);
+  }
+
+  for (i = 0; i < batch_items_count; i++)
+    free(batch_items[i].full_path);
+  free(batch_items);
+  batch_items = NULL;
+  batch_items_count = batch_items_size = 0;
+  return failures;
+}
+
 /// Free the memory and make sure the pointer is set to NULL
 #define FREE_POINTER(p) free(p); p = NULL
 
@@ -1258,7 +1805,9 @@ void Program_shutdown(void)
     Config.Window_pos_y = 9999;
   #endif
 
-  // Remove the safety backups, this is normal exit
+  // Remove the history spill file and the safety backups, this is normal exit
+  Close_history_spill_file();
+  Free_preview_cache();
   Delete_safety_backups();
 
   // On libère le buffer de gestion de lignes
@@ -1306,7 +1855,8 @@ void Program_shutdown(void)
   if (Change_directory(Initial_directory)==0)
   {
     // On sauvegarde les données dans le .CFG et dans le .INI
-    if (Config.Auto_save)
+    // (not in batch mode, which may run alongside an interactive session)
+    if (Config.Auto_save && !Batch_mode)
     {
       return_code=Save_CFG();
       if (return_code)
@@ -1354,6 +1904,15 @@ void Program_shutdown(void)
     FREE_POINTER(Bound_script[i]);
   }
 
+  while (batch_files_count > 0)
+  {
+    batch_files_count--;
+    FREE_POINTER(batch_files[batch_files_count]);
+  }
+  FREE_POINTER(batch_files);
+  FREE_POINTER(batch_script);
+  FREE_POINTER(batch_output);
+
   Uninit_text();
 
 #ifdef ENABLE_FILENAMES_ICONV
@@ -1539,6 +2098,14 @@ int main(int argc,char * argv[])
     return 0;
   }
 
+  if (Batch_mode)
+  {
+    int failures = Batch_process();
+
+    Program_shutdown();
+    return failures > 0 ? 1 : 0;
+  }
+
 #ifdef _MSC_VER
   GFX2_Log(GFX2_DEBUG, "built with _MSC_VER=%d   Windows ANSI Code Page=%u\n", _MSC_VER, GetACP());
 #endif
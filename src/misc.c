@@ -171,6 +171,7 @@ void Set_palette(T_Palette palette)
   int i;
 
   memcpy(Current_palette, palette, sizeof(T_Palette));
+  Invalidate_best_color_cache();
   for(i=0;i<256;i++)
   {
     palette[i].R = Round_palette_component(palette[i].R);
@@ -185,6 +186,7 @@ void Set_color(byte color, byte red, byte green, byte blue)
   Current_palette[color].R = red;
   Current_palette[color].G = green;
   Current_palette[color].B = blue;
+  Invalidate_best_color_cache();
   GFX2_SetPalette(Current_palette + color, color, 1);
 }
 
@@ -579,54 +581,151 @@ void Rotate_180_deg_lowlevel(byte *src, short width, short height)
   }
 }
 
+/// Position in the source of a destination line or column, for ::Rescale()
+static int Rescale_position(int index, int src_size, int dst_size, short flipped)
+{
+  if (flipped)
+    return src_size - 1 - index * src_size / dst_size; // Inversion de la brosse
+  else
+    return index * src_size / dst_size;
+}
+
 void Rescale(byte *src_buffer, short src_width, short src_height, byte *dst_buffer, short dst_width, short dst_height, short x_flipped, short y_flipped)
 {
-  int    offset,line,column;
+  int    line,column;
+  int    y_pos_in_brush;   // Position courante dans l'ancienne brosse
+  int    previous_y_pos = -1;
+  int *  column_table;     // Position X dans l'ancienne brosse de chaque colonne
+  byte * dst_line = dst_buffer;
 
-  int    x_pos_in_brush;   // Position courante dans l'ancienne brosse
-  int    y_pos_in_brush;
-  int    initial_x_pos;       // Position X de début de parcours de ligne
-  int    initial_y_pos;       // Position Y de début de parcours de ligne
+  if (dst_width <= 0 || dst_height <= 0)
+    return;
 
-  int	delta_x, delta_y;
+  // The source column of each destination column is the same on every line:
+  // compute them only once.
+  column_table = (int *)malloc(dst_width * sizeof(int));
+  if (column_table != NULL)
+  {
+    for (column=0;column<dst_width;column++)
+      column_table[column] = Rescale_position(column, src_width, dst_width, x_flipped);
+  }
 
-  offset=0;
+  // Pour chaque ligne
+  for (line=0;line<dst_height;line++)
+  {
+    // On passe à la ligne de brosse suivante:
+    y_pos_in_brush = Rescale_position(line, src_height, dst_height, y_flipped);
 
-  // Calcul de la valeur initiale de y_pos:
-  if (y_flipped) {
-    initial_y_pos=(src_height)-1; // Inversion en Y de la brosse
-	delta_y = -1 * src_height;
-  } else {
-    initial_y_pos=0;                // Pas d'inversion en Y de la brosse
-	delta_y = src_height;
+    if (y_pos_in_brush == previous_y_pos)
+    {
+      // Same source line as the previous one (enlargement): copy it
+      memcpy(dst_line, dst_line - dst_width, dst_width);
+    }
+    else
+    {
+      const byte * src_line = src_buffer + y_pos_in_brush * src_width;
+
+      if (column_table != NULL)
+      {
+        for (column=0;column<dst_width;column++)
+          dst_line[column] = src_line[column_table[column]];
+      }
+      else
+      {
+        for (column=0;column<dst_width;column++)
+          dst_line[column] = src_line[Rescale_position(column, src_width, dst_width, x_flipped)];
+      }
+      previous_y_pos = y_pos_in_brush;
+    }
+    dst_line += dst_width;
   }
+  free(column_table);
+}
 
-  // Calcul de la valeur initiale de x_pos pour chaque ligne:
-  if (x_flipped) {
-    initial_x_pos = (src_width)-1; // Inversion en X de la brosse
-	delta_x = -1 * src_width;
-  } else {
-    initial_x_pos = 0;                // Pas d'inversion en X de la brosse
-	delta_x = src_width;
+void Rescale_smooth(const byte *src_buffer, short src_width, short src_height, byte *dst_buffer, short dst_width, short dst_height, const T_Components * palette)
+{
+  word * color_lut;  // Best color for each 15-bit RGB value, 0xFFFF when unknown
+  int line, column;
+
+  if (dst_width <= 0 || dst_height <= 0)
+    return;
+  if (dst_width > src_width || dst_height > src_height)
+  {
+    Rescale((byte *)src_buffer, src_width, src_height, dst_buffer, dst_width, dst_height, 0, 0);
+    return;
+  }
+  color_lut = (word *)malloc(32768 * sizeof(word));
+  if (color_lut == NULL)
+  {
+    Rescale((byte *)src_buffer, src_width, src_height, dst_buffer, dst_width, dst_height, 0, 0);
+    return;
   }
+  memset(color_lut, 0xFF, 32768 * sizeof(word));
 
-  // Pour chaque ligne
-  for (line=0;line<dst_height;line++)
+  for (line = 0; line < dst_height; line++)
   {
-    // On passe à la ligne de brosse suivante:
-    y_pos_in_brush = initial_y_pos + line * delta_y / dst_height;
+    int y_start = line * src_height / dst_height;
+    int y_end = (line + 1) * src_height / dst_height;
 
-    // Pour chaque colonne:
-    for (column=0;column<dst_width;column++)
+    for (column = 0; column < dst_width; column++)
     {
-      // On passe à la colonne de brosse suivante:
-      x_pos_in_brush = initial_x_pos + column * delta_x / dst_width;
-      // On copie le pixel:
-      dst_buffer[offset]=*(src_buffer + x_pos_in_brush + y_pos_in_brush * src_width);
-      // On passe au pixel suivant de la nouvelle brosse:
-      offset++;
+      int x_start = column * src_width / dst_width;
+      int x_end = (column + 1) * src_width / dst_width;
+      dword r = 0, g = 0, b = 0;
+      dword count = (dword)(x_end - x_start) * (y_end - y_start);
+      byte first_color = src_buffer[y_start * src_width + x_start];
+      byte same_color = 1;
+      int x, y;
+
+      for (y = y_start; y < y_end; y++)
+      {
+        const byte * src = src_buffer + y * src_width;
+        for (x = x_start; x < x_end; x++)
+        {
+          r += palette[src[x]].R;
+          g += palette[src[x]].G;
+          b += palette[src[x]].B;
+          if (src[x] != first_color)
+            same_color = 0;
+        }
+      }
+      if (same_color)
+      {
+        // Keep plain areas exactly as they are
+        *dst_buffer++ = first_color;
+      }
+      else
+      {
+        word key;
+
+        r /= count;
+        g /= count;
+        b /= count;
+        key = ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+        if (color_lut[key] == 0xFFFF)
+        {
+          // Search the nearest color in the palette
+          dword best_diff = 0xFFFFFFFF;
+          int index;
+
+          for (index = 0; index < 256; index++)
+          {
+            int dr = palette[index].R - (int)r;
+            int dg = palette[index].G - (int)g;
+            int db = palette[index].B - (int)b;
+            dword diff = dr*dr + dg*dg + db*db;
+            if (diff < best_diff)
+            {
+              best_diff = diff;
+              color_lut[key] = index;
+            }
+          }
+        }
+        *dst_buffer++ = (byte)color_lut[key];
+      }
     }
   }
+  free(color_lut);
 }
 
 
@@ -662,21 +761,72 @@ void Scroll_picture(byte * main_src, byte * main_dest, short x_offset,short y_of
   Update_rect(0,0,0,0);
 }
 
+/// Zoom a line of pixels horizontally, by repeating each pixel @a factor times.
+///
+/// Instead of a memset() per pixel, the color is replicated in a 32 or 64 bits
+/// word, which is stored as a whole. For factors which are not a multiple of
+/// the word size, the last store of a pixel overlaps the previous one, so
+/// nothing is ever written past width*factor bytes.
 void Zoom_a_line(byte* original_line, byte* zoomed_line,
     word factor, word width
     )
 {
-  byte color;
   word x;
 
-  // Pour chaque pixel
-  for(x=0;x<width;x++){
-    color = *original_line;
-
-    memset(zoomed_line,color,factor);
-    zoomed_line+=factor;
-
-    original_line++;
+  switch (factor)
+  {
+    case 1:
+      memcpy(zoomed_line, original_line, width);
+      break;
+    case 2:
+      for (x = 0; x < width; x++)
+      {
+        zoomed_line[0] = zoomed_line[1] = original_line[x];
+        zoomed_line += 2;
+      }
+      break;
+    case 3:
+      for (x = 0; x < width; x++)
+      {
+        zoomed_line[0] = zoomed_line[1] = zoomed_line[2] = original_line[x];
+        zoomed_line += 3;
+      }
+      break;
+    case 4:
+      for (x = 0; x < width; x++)
+      {
+        dword pixels = original_line[x] * 0x01010101u;
+        memcpy(zoomed_line, &pixels, 4);
+        zoomed_line += 4;
+      }
+      break;
+    default:
+      if (factor < 8)
+      {
+        // 5 to 7: two overlapping 32 bits stores
+        for (x = 0; x < width; x++)
+        {
+          dword pixels = original_line[x] * 0x01010101u;
+          memcpy(zoomed_line, &pixels, 4);
+          memcpy(zoomed_line + factor - 4, &pixels, 4);
+          zoomed_line += factor;
+        }
+      }
+      else
+      {
+        for (x = 0; x < width; x++)
+        {
+          qword pixels = 0x0101010101010101ULL * original_line[x];
+          word i;
+
+          for (i = 0; i + 8 <= factor; i += 8)
+            memcpy(zoomed_line + i, &pixels, 8);
+          if (i < factor)
+            memcpy(zoomed_line + factor - 8, &pixels, 8);
+          zoomed_line += factor;
+        }
+      }
+      break;
   }
 }
 
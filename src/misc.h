@@ -117,6 +117,19 @@ void Rotate_180_deg_lowlevel(byte *src, short width, short height);
 /// @param y_flipped  Boolean, true to flip the image vertically
 void Rescale(byte *src_buffer, short src_width, short src_height, byte *dst_buffer, short dst_width, short dst_height, short x_flipped, short y_flipped);
 
+///
+/// Reduces an image, averaging the colors of all the pixels that become
+/// one, and using the nearest color of the palette for the result.
+/// Falls back to ::Rescale() when the image gets larger.
+/// @param src_buffer Original image (address of first byte)
+/// @param src_width  Original image's width in pixels
+/// @param src_height Original image's height in pixels
+/// @param dst_buffer Destination image (address of first byte)
+/// @param dst_width  Destination image's width in pixels
+/// @param dst_height Destination image's height in pixels
+/// @param palette    Palette of both images
+void Rescale_smooth(const byte *src_buffer, short src_width, short src_height, byte *dst_buffer, short dst_width, short dst_height, const T_Components * palette);
+
 void Zoom_a_line(byte * original_line,byte * zoomed_line,word factor,word width);
 void Copy_part_of_image_to_another(byte * source,word source_x,word source_y,word width,word height,word source_width,byte * dest,word dest_x,word dest_y,word destination_width);
 
@@ -289,9 +289,13 @@ void OT_count_occurrences(T_Occurrence_table* t, T_Bitmap24B image, int size)
 {
   T_Bitmap24B ptr;
   int index;
+  // Same as OT_inc(), with the table parameters kept in registers
+  int * table = t->table;
+  int red_r = t->red_r, red_g = t->red_g, red_b = t->red_b;
+  int dec_r = t->dec_r, dec_g = t->dec_g;
 
   for (index = size, ptr = image; index > 0; index--, ptr++)
-    OT_inc(t, ptr->R, ptr->G, ptr->B);
+    table[((ptr->R >> red_r) << dec_r) | ((ptr->G >> red_g) << dec_g) | (ptr->B >> red_b)]++;
 }
 
 
@@ -1334,41 +1338,58 @@ void Convert_24b_bitmap_to_256_Floyd_Steinberg(T_Bitmap256 dest,T_Bitmap24B sour
 }
 
 
+/// Below this number of pixels, Convert_24b_bitmap_to_256_nearest_neighbor()
+/// searches the conversion table for every pixel, instead of allocating
+/// and clearing its lookup table.
+#define NEAREST_LOOKUP_MIN_PIXELS (256*256)
+
 /// Converts from 24b to 256c without dithering, using given conversion table
+///
+/// The conversion table is only walked once for each distinct color of the
+/// picture : the results are kept in a flat 24bit lookup table, which is
+/// filled as colors are met.
 void Convert_24b_bitmap_to_256_nearest_neighbor(T_Bitmap256 dest,
   T_Bitmap24B source, int width, int height, T_Components * palette,
   CT_Tree* tc)
 {
   T_Bitmap24B current;
   T_Bitmap256 d;
-  int x_pos, y_pos;
-  int red, green, blue;
+  long index;
+  dword rgb;
+  byte * lookup = NULL;  // palette index for each RGB value
+  byte * known = NULL;   // one bit for each RGB value : is it set in lookup ?
   (void)palette; // unused
 
-  // On initialise les variables de parcours:
-  current =source; // Le pixel dont on s'occupe
+  current = source;
+  d = dest;
 
-  d =dest;
+  if ((long)width * height >= NEAREST_LOOKUP_MIN_PIXELS)
+  {
+    lookup = (byte *)malloc(1 << 24);
+    known = (byte *)calloc(1 << 21, 1);
+  }
+  if (lookup == NULL || known == NULL)
+  {
+    // Small picture or not enough memory : search the tree for every pixel
+    free(lookup);
+    free(known);
+    for (index = (long)width * height; index > 0; index--, current++, d++)
+      *d = CT_get(tc, current->R, current->G, current->B);
+    return;
+  }
 
-  // On parcours chaque pixel:
-  for (y_pos = 0; y_pos < height; y_pos++)
+  for (index = (long)width * height; index > 0; index--, current++, d++)
   {
-    for (x_pos = 0 ;x_pos < width; x_pos++)
+    rgb = ((dword)current->R << 16) | ((dword)current->G << 8) | current->B;
+    if (!(known[rgb >> 3] & (1 << (rgb & 7))))
     {
-      // On prends la meilleure couleur de la palette qui traduit la couleur
-      // 24 bits de la source:
-      red = current->R;
-      green = current->G;
-      blue = current->B;
-      // Cherche la couleur correspondant dans la palette et la range dans
-      // l'image de destination
-      *d = CT_get(tc, red, green, blue);
-
-      // On passe au pixel suivant :
-      current++;
-      d++;
+      lookup[rgb] = CT_get(tc, current->R, current->G, current->B);
+      known[rgb >> 3] |= 1 << (rgb & 7);
     }
+    *d = lookup[rgb];
   }
+  free(lookup);
+  free(known);
 }
 
 
@@ -69,6 +69,46 @@ int PackBits_unpack_from_file(FILE * f, byte * dest, unsigned int count)
   return PACKBITS_UNPACK_OK;
 }
 
+int PackBits_unpack_from_memory(const byte * src, size_t src_size, byte * dest, unsigned int count)
+{
+  unsigned int i = 0;
+  const byte * end = src + src_size;
+  while (i < count)
+  {
+    byte cmd;
+    if (src >= end)
+      return PACKBITS_UNPACK_READ_ERROR;
+    cmd = *src++;
+    if (cmd > 128)
+    {
+      // cmd > 128 => repeat (257 - cmd) the next byte
+      if (src >= end)
+        return PACKBITS_UNPACK_READ_ERROR;
+      if (count < (i + 257 - cmd))
+        return PACKBITS_UNPACK_OVERFLOW_ERROR;
+      memset(dest + i, *src++, (257 - cmd));
+      i += (257 - cmd);
+    }
+    else if (cmd < 128)
+    {
+      // cmd < 128 => copy (cmd + 1) bytes
+      if (count < (i + cmd + 1))
+        return PACKBITS_UNPACK_OVERFLOW_ERROR;
+      if (end - src < cmd + 1)
+        return PACKBITS_UNPACK_READ_ERROR;
+      memcpy(dest + i, src, (cmd + 1));
+      src += (cmd + 1);
+      i += (cmd + 1);
+    }
+    else
+    {
+      // 128 = NOP
+      GFX2_Log(GFX2_WARNING, "NOP in packbits stream\n");
+    }
+  }
+  return PACKBITS_UNPACK_OK;
+}
+
 void PackBits_pack_init(T_PackBits_data * data, FILE * f)
 {
   memset(data, 0, sizeof(T_PackBits_data));
@@ -163,6 +203,13 @@ int PackBits_pack_flush(T_PackBits_data * data)
             !Write_byte(data->f, data->list[0]))
           return -1;
       }
+      else if (data->output != NULL)
+      {
+        if (data->output_size < (size_t)data->output_count + 2)
+          return -1;
+        data->output[data->output_count] = 257 - data->list_size;
+        data->output[data->output_count + 1] = data->list[0];
+      }
       data->output_count += 2;
     }
     else
@@ -173,6 +220,13 @@ int PackBits_pack_flush(T_PackBits_data * data)
             !Write_bytes(data->f, data->list, data->list_size))
           return -1;
       }
+      else if (data->output != NULL)
+      {
+        if (data->output_size < (size_t)data->output_count + 1 + data->list_size)
+          return -1;
+        data->output[data->output_count] = data->list_size - 1;
+        memcpy(data->output + data->output_count + 1, data->list, data->list_size);
+      }
       data->output_count += 1 + data->list_size;
     }
     data->list_size = 0;
@@ -193,3 +247,18 @@ int PackBits_pack_buffer(FILE * f, const byte * buffer, size_t size)
   }
   return PackBits_pack_flush(&pb_data);
 }
+
+int PackBits_pack_buffer_to_memory(byte * dest, size_t dest_size, const byte * buffer, size_t size)
+{
+  T_PackBits_data pb_data;
+
+  PackBits_pack_init(&pb_data, NULL);
+  pb_data.output = dest;
+  pb_data.output_size = dest_size;
+  while (size-- > 0)
+  {
+    if (PackBits_pack_add(&pb_data, *buffer++))
+      return -1;
+  }
+  return PackBits_pack_flush(&pb_data);
+}
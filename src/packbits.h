@@ -38,11 +38,18 @@
  */
 int PackBits_unpack_from_file(FILE * f, byte * dest, unsigned int count);
 
+/**
+ * @return PACKBITS_UNPACK_OK or PACKBITS_UNPACK_READ_ERROR or PACKBITS_UNPACK_OVERFLOW_ERROR
+ */
+int PackBits_unpack_from_memory(const byte * src, size_t src_size, byte * dest, unsigned int count);
+
 /**
  * Data used by the PackBits packer
  */
 typedef struct {
   FILE * f;
+  byte * output;      ///< memory output, used when f is NULL
+  size_t output_size; ///< size of the memory output buffer
   int output_count;
   byte list_size;
   byte repetition_mode;
@@ -79,4 +86,14 @@ int PackBits_pack_flush(T_PackBits_data * data);
  */
 int PackBits_pack_buffer(FILE * f, const byte * buffer, size_t size);
 
+/**
+ * Pack a full buffer to memory
+ * @param dest output buffer
+ * @param dest_size byte size of output buffer
+ * @param buffer input buffer
+ * @param size byte size of input buffer
+ * @return -1 if the output buffer is too small, or the size of the packed stream
+ */
+int PackBits_pack_buffer_to_memory(byte * dest, size_t dest_size, const byte * buffer, size_t size);
+
 #endif
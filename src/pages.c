@@ -24,6 +24,7 @@
 //////////////////////////////////////////////////////////////////////////
 
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #ifdef _MSC_VER
@@ -41,6 +42,8 @@
 #include "graph.h"
 #include "layers.h"
 #include "unicode.h"
+#include "packbits.h"
+#include "io.h"
 
 // -- Layers data
 
@@ -75,6 +78,7 @@ T_Page * New_page(int nb_layers)
     {
       page->Image[i].Pixels = NULL;
       page->Image[i].Duration = 100;
+      page->Image[i].Tiles = NULL;
     }
     page->Width=0;
     page->Height=0;
@@ -120,10 +124,17 @@ byte * New_layer(long pixel_size)
   return (byte *)(ptr+1);
 }
 
+static void Free_tiled_layer(T_Page * page, int layer);
+
 /// Free a layer
 void Free_layer(T_Page * page, int layer)
 {
   short * ptr;
+  if (page->Image[layer].Tiles!=NULL)
+  {
+    Free_tiled_layer(page, layer);
+    return;
+  }
   if (page->Image[layer].Pixels==NULL)
     return;
     
@@ -151,6 +162,736 @@ byte * Dup_layer(byte * layer)
   return layer;
 }
 
+// ==============================================================
+// Tiled history layers.
+//
+// Only the current page and the one before it (which is read while
+// drawing effects without "feedback") need their layers as a single
+// block of pixels. The layers of older history steps are cut into
+// square tiles of HISTORY_TILE_SIZE pixels. Each tile has its own
+// "number of users", just like whole layers: when two neighbour steps
+// have the same pixels in a tile, they share it. This way a history step
+// where the user only drew a pencil dot costs a single tile.
+// When a tile differs from the same tile in the older step, only the XOR
+// of the two is kept, compressed with PackBits: around a small edit it is
+// almost only zeros. Decoding such a "delta" tile goes down the chain of
+// older tiles it depends on, so the chain is limited to HISTORY_DELTA_DEPTH.
+// The tiles of steps more than HISTORY_PACKED_STEPS behind the current
+// page are also compressed with PackBits.
+// With a memory budget, the tiles of the oldest steps are moved to a
+// "spill" file in the configuration directory before forgetting steps,
+// and read back one by one when they are needed again.
+// ==============================================================
+
+/// Width and height of the tiles used to store old history steps.
+#define HISTORY_TILE_SIZE 64
+/// Distance from the current page after which history tiles are compressed.
+#define HISTORY_PACKED_STEPS 8
+/// Maximum number of delta tiles to decode before reaching a full tile.
+#define HISTORY_DELTA_DEPTH 16
+
+/// Compression state of a ::T_History_tile
+enum HISTORY_TILE_PACKING
+{
+  TILE_RAW = 0,      ///< Not compressed (yet)
+  TILE_PACKED,       ///< Pixels is a PackBits stream
+  TILE_INCOMPRESSIBLE,///< Not compressed, because PackBits would make it bigger
+  TILE_DELTA         ///< Pixels is a PackBits stream of the XOR with the Base tile
+};
+
+/// Part of a layer, in a history step older than the previous one.
+struct T_History_tile
+{
+  short Users;   ///< Number of tiled layers which use this tile
+  short Width;   ///< Less than HISTORY_TILE_SIZE on the right edge
+  short Height;  ///< Less than HISTORY_TILE_SIZE on the bottom edge
+  byte Packing;  ///< One of ::HISTORY_TILE_PACKING
+  byte Depth;    ///< Number of delta tiles in the chain starting at this one
+  int Size;      ///< Number of bytes in Pixels
+  byte * Pixels; ///< Width*Height bytes, or PackBits data. NULL when the tile is in the spill file.
+  long Spill_offset; ///< Position of the data in the spill file, when Pixels is NULL
+  struct T_History_tile * Base; ///< For TILE_DELTA: the tile of the older step (one of its users)
+};
+
+/// Name of the spill file, in the configuration directory
+#define HISTORY_SPILL_FILENAME "history.tmp"
+
+/// Unused area in the middle of the spill file
+typedef struct
+{
+  long Offset;
+  long Size;
+} T_Spill_extent;
+
+static FILE * Spill_file = NULL;
+/// Size of the used part of the spill file
+static long Spill_file_size = 0;
+/// Unused areas of the spill file, sorted by offset
+static T_Spill_extent * Spill_extents = NULL;
+static int Spill_nb_extents = 0;
+static int Spill_max_extents = 0;
+/// Number of bytes of tiles in the spill file
+static long long Stats_spilled_memory = 0;
+
+/// Opens the spill file if needed. Returns 0 if the history can't be
+/// spilled: no disk budget, or another instance of the program owns the
+/// configuration directory.
+static int Open_spill_file(void)
+{
+  char * filename;
+
+  if (Spill_file != NULL)
+    return 1;
+  if (Config.Max_undo_disk == 0 || !Safety_backup_active)
+    return 0;
+  filename = Filepath_append_to_dir(Config_directory, HISTORY_SPILL_FILENAME);
+  Spill_file = fopen(filename, "w+b");
+  if (Spill_file == NULL)
+    GFX2_Log(GFX2_WARNING, "Cannot create history spill file %s\n", filename);
+  free(filename);
+  Spill_file_size = 0;
+  Spill_nb_extents = 0;
+  return Spill_file != NULL;
+}
+
+void Close_history_spill_file(void)
+{
+  char * filename;
+
+  if (Spill_file == NULL)
+    return;
+  fclose(Spill_file);
+  Spill_file = NULL;
+  filename = Filepath_append_to_dir(Config_directory, HISTORY_SPILL_FILENAME);
+  Remove_path(filename);
+  free(filename);
+  free(Spill_extents);
+  Spill_extents = NULL;
+  Spill_nb_extents = Spill_max_extents = 0;
+}
+
+/// Reserves size bytes in the spill file, reusing unused areas first.
+static long Allocate_spill_extent(long size)
+{
+  long offset;
+  int i;
+
+  for (i = 0; i < Spill_nb_extents; i++)
+  {
+    if (Spill_extents[i].Size >= size)
+    {
+      offset = Spill_extents[i].Offset;
+      Spill_extents[i].Offset += size;
+      Spill_extents[i].Size -= size;
+      if (Spill_extents[i].Size == 0)
+      {
+        Spill_nb_extents--;
+        memmove(Spill_extents + i, Spill_extents + i + 1, (Spill_nb_extents - i) * sizeof(T_Spill_extent));
+      }
+      return offset;
+    }
+  }
+  offset = Spill_file_size;
+  Spill_file_size += size;
+  return offset;
+}
+
+/// Marks an area of the spill file as unused, merging it with its neighbours.
+static void Release_spill_extent(long offset, long size)
+{
+  int i;
+
+  // Find the first unused area after this one
+  for (i = 0; i < Spill_nb_extents && Spill_extents[i].Offset < offset; i++)
+    ;
+  if (i > 0 && Spill_extents[i-1].Offset + Spill_extents[i-1].Size == offset)
+  {
+    // Merge with the previous one
+    i--;
+    Spill_extents[i].Size += size;
+    if (i + 1 < Spill_nb_extents && Spill_extents[i].Offset + Spill_extents[i].Size == Spill_extents[i+1].Offset)
+    {
+      Spill_extents[i].Size += Spill_extents[i+1].Size;
+      Spill_nb_extents--;
+      memmove(Spill_extents + i + 1, Spill_extents + i + 2, (Spill_nb_extents - i - 1) * sizeof(T_Spill_extent));
+    }
+  }
+  else if (i < Spill_nb_extents && offset + size == Spill_extents[i].Offset)
+  {
+    // Merge with the next one
+    Spill_extents[i].Offset = offset;
+    Spill_extents[i].Size += size;
+  }
+  else
+  {
+    if (Spill_nb_extents == Spill_max_extents)
+    {
+      int max = Spill_max_extents ? Spill_max_extents * 2 : 64;
+      T_Spill_extent * extents = realloc(Spill_extents, max * sizeof(T_Spill_extent));
+
+      if (extents == NULL)
+        return; // The area is lost until the file is closed
+      Spill_extents = extents;
+      Spill_max_extents = max;
+    }
+    memmove(Spill_extents + i + 1, Spill_extents + i, (Spill_nb_extents - i) * sizeof(T_Spill_extent));
+    Spill_extents[i].Offset = offset;
+    Spill_extents[i].Size = size;
+    Spill_nb_extents++;
+  }
+  // An unused area at the end just makes the file shorter
+  if (Spill_nb_extents > 0
+    && Spill_extents[Spill_nb_extents-1].Offset + Spill_extents[Spill_nb_extents-1].Size == Spill_file_size)
+  {
+    Spill_nb_extents--;
+    Spill_file_size = Spill_extents[Spill_nb_extents].Offset;
+  }
+}
+
+/// Number of tiles of a tiled layer, for a page of the given dimensions
+static int Nb_history_tiles(int width, int height)
+{
+  return ((width+HISTORY_TILE_SIZE-1)/HISTORY_TILE_SIZE)
+       * ((height+HISTORY_TILE_SIZE-1)/HISTORY_TILE_SIZE);
+}
+
+/// Release a reference to a tile, freeing it when nobody uses it anymore.
+static void Free_history_tile(T_History_tile * tile)
+{
+  // A delta tile also releases the tile it was based on
+  while (tile != NULL && --tile->Users == 0)
+  {
+    T_History_tile * base = tile->Base;
+
+    if (tile->Pixels == NULL)
+    {
+      Release_spill_extent(tile->Spill_offset, tile->Size);
+      Stats_spilled_memory -= tile->Size;
+    }
+    else
+      Stats_pages_memory -= tile->Size;
+    free(tile->Pixels);
+    free(tile);
+    tile = base;
+  }
+}
+
+/// Moves the data of a tile to the spill file. Returns 0 on failure.
+static int Spill_history_tile(T_History_tile * tile)
+{
+  long offset;
+
+  if (tile->Pixels == NULL)
+    return 1;
+  offset = Allocate_spill_extent(tile->Size);
+  if (fseek(Spill_file, offset, SEEK_SET)
+    || fwrite(tile->Pixels, 1, tile->Size, Spill_file) != (size_t)tile->Size)
+  {
+    Release_spill_extent(offset, tile->Size);
+    return 0;
+  }
+  free(tile->Pixels);
+  tile->Pixels = NULL;
+  tile->Spill_offset = offset;
+  Stats_pages_memory -= tile->Size;
+  Stats_spilled_memory += tile->Size;
+  return 1;
+}
+
+/// Returns the data of a tile (Size bytes), reading it from the spill
+/// file in buffer if needed. Returns NULL if it cannot be read.
+static const byte * History_tile_data(const T_History_tile * tile, byte * buffer)
+{
+  if (tile->Pixels != NULL)
+    return tile->Pixels;
+  if (fseek(Spill_file, tile->Spill_offset, SEEK_SET)
+    || fread(buffer, 1, tile->Size, Spill_file) != (size_t)tile->Size)
+  {
+    GFX2_Log(GFX2_ERROR, "Cannot read the history spill file\n");
+    return NULL;
+  }
+  return buffer;
+}
+
+/// Returns the pixels of a tile, unpacking them in buffer if needed.
+/// buffer must be HISTORY_TILE_SIZE*HISTORY_TILE_SIZE bytes.
+/// Returns NULL if the data of the tile cannot be read.
+static const byte * History_tile_pixels(const T_History_tile * tile, byte * buffer)
+{
+  byte data_buffer[HISTORY_TILE_SIZE*HISTORY_TILE_SIZE];
+  byte delta[HISTORY_TILE_SIZE*HISTORY_TILE_SIZE];
+  const byte * data;
+  int size = tile->Width*tile->Height;
+  int i;
+
+  if (tile->Packing == TILE_RAW || tile->Packing == TILE_INCOMPRESSIBLE)
+    return History_tile_data(tile, buffer);
+  if (tile->Packing == TILE_PACKED)
+  {
+    data = History_tile_data(tile, data_buffer);
+    if (data == NULL
+      || PackBits_unpack_from_memory(data, tile->Size, buffer, size) != PACKBITS_UNPACK_OK)
+      return NULL;
+    return buffer;
+  }
+  // XOR all the deltas of the chain, then the full tile at its end.
+  memset(buffer, 0, size);
+  for (; tile->Packing == TILE_DELTA; tile = tile->Base)
+  {
+    data = History_tile_data(tile, data_buffer);
+    if (data == NULL
+      || PackBits_unpack_from_memory(data, tile->Size, delta, size) != PACKBITS_UNPACK_OK)
+      return NULL;
+    for (i = 0; i < size; i++)
+      buffer[i] ^= delta[i];
+  }
+  data = History_tile_data(tile, data_buffer);
+  if (data == NULL)
+    return NULL;
+  if (tile->Packing == TILE_PACKED)
+  {
+    if (PackBits_unpack_from_memory(data, tile->Size, delta, size) != PACKBITS_UNPACK_OK)
+      return NULL;
+    data = delta;
+  }
+  for (i = 0; i < size; i++)
+    buffer[i] ^= data[i];
+  return buffer;
+}
+
+/// Compress the pixels of a tile, if it makes it smaller.
+static void Pack_history_tile(T_History_tile * tile)
+{
+  byte buffer[HISTORY_TILE_SIZE*HISTORY_TILE_SIZE];
+  byte * packed;
+  int size;
+
+  if (tile->Packing != TILE_RAW || tile->Pixels == NULL)
+    return;
+  size = PackBits_pack_buffer_to_memory(buffer, tile->Size - 1, tile->Pixels, tile->Size);
+  if (size < 0 || (packed = GFX2_malloc(size)) == NULL)
+  {
+    tile->Packing = TILE_INCOMPRESSIBLE;
+    return;
+  }
+  memcpy(packed, buffer, size);
+  free(tile->Pixels);
+  Stats_pages_memory -= tile->Size - size;
+  tile->Pixels = packed;
+  tile->Size = size;
+  tile->Packing = TILE_PACKED;
+}
+
+/// Allocate a new tile, with a copy of a rectangle of a layer.
+static T_History_tile * New_history_tile(const byte * src, int pitch, int width, int height)
+{
+  T_History_tile * tile;
+  int y;
+
+  tile = GFX2_malloc(sizeof(T_History_tile));
+  if (tile == NULL)
+    return NULL;
+  tile->Pixels = GFX2_malloc(width*height);
+  if (tile->Pixels == NULL)
+  {
+    free(tile);
+    return NULL;
+  }
+  tile->Users = 1;
+  tile->Width = width;
+  tile->Height = height;
+  tile->Packing = TILE_RAW;
+  tile->Depth = 0;
+  tile->Size = width*height;
+  tile->Spill_offset = 0;
+  tile->Base = NULL;
+  for (y = 0; y < height; y++)
+    memcpy(tile->Pixels + y*width, src + y*pitch, width);
+
+  Stats_pages_memory += width*height;
+  return tile;
+}
+
+/// Allocate a new tile which only stores the XOR of a rectangle of a layer
+/// with the tile base. Returns NULL if it would not save at least half of
+/// the memory of a full tile, or if out of memory.
+static T_History_tile * New_delta_history_tile(const byte * src, int pitch, T_History_tile * base)
+{
+  byte buffer[HISTORY_TILE_SIZE*HISTORY_TILE_SIZE];
+  byte delta[HISTORY_TILE_SIZE*HISTORY_TILE_SIZE];
+  const byte * base_pixels;
+  T_History_tile * tile;
+  int x, y;
+  int size;
+
+  if (base->Depth >= HISTORY_DELTA_DEPTH)
+    return NULL;
+  base_pixels = History_tile_pixels(base, buffer);
+  if (base_pixels == NULL)
+    return NULL;
+  for (y = 0; y < base->Height; y++)
+    for (x = 0; x < base->Width; x++)
+      delta[y*base->Width + x] = src[y*pitch + x] ^ base_pixels[y*base->Width + x];
+  // The packed data can go in buffer, base_pixels isn't needed anymore
+  size = PackBits_pack_buffer_to_memory(buffer, base->Width*base->Height/2, delta, base->Width*base->Height);
+  if (size < 0)
+    return NULL;
+
+  tile = GFX2_malloc(sizeof(T_History_tile));
+  if (tile == NULL)
+    return NULL;
+  tile->Pixels = GFX2_malloc(size);
+  if (tile->Pixels == NULL)
+  {
+    free(tile);
+    return NULL;
+  }
+  memcpy(tile->Pixels, buffer, size);
+  tile->Users = 1;
+  tile->Width = base->Width;
+  tile->Height = base->Height;
+  tile->Packing = TILE_DELTA;
+  tile->Depth = base->Depth + 1;
+  tile->Size = size;
+  tile->Spill_offset = 0;
+  tile->Base = base;
+  base->Users++;
+
+  Stats_pages_memory += size;
+  return tile;
+}
+
+/// Checks if a tile has the same pixels as a rectangle of a layer.
+static int History_tile_is_same(const T_History_tile * tile, const byte * src, int pitch)
+{
+  byte buffer[HISTORY_TILE_SIZE*HISTORY_TILE_SIZE];
+  const byte * pixels = History_tile_pixels(tile, buffer);
+  int y;
+
+  if (pixels == NULL)
+    return 0;
+  for (y = 0; y < tile->Height; y++)
+    if (memcmp(pixels + y*tile->Width, src + y*pitch, tile->Width))
+      return 0;
+  return 1;
+}
+
+/// Returns the tiles of the same layer in a neighbour page, if they can be shared.
+static T_History_tile ** Neighbour_tiles(const T_Page * page, const T_Page * neighbour, int layer)
+{
+  if (neighbour == page
+    || neighbour->Width != page->Width
+    || neighbour->Height != page->Height
+    || layer >= neighbour->Nb_layers)
+    return NULL;
+  return neighbour->Image[layer].Tiles;
+}
+
+/// Free the tiles of a tiled layer
+static void Free_tiled_layer(T_Page * page, int layer)
+{
+  int i;
+  int nb_tiles = Nb_history_tiles(page->Width, page->Height);
+
+  for (i = 0; i < nb_tiles; i++)
+    Free_history_tile(page->Image[layer].Tiles[i]);
+  free(page->Image[layer].Tiles);
+  page->Image[layer].Tiles = NULL;
+
+  // Stats
+  Stats_pages_number--;
+}
+
+/// Converts a layer to tiles, sharing all the tiles that are identical
+/// in the neighbour history steps. Returns 0 if out of memory, in which
+/// case the layer is left untouched.
+static int Tile_layer(T_Page * page, int layer)
+{
+  T_History_tile ** tiles;
+  T_History_tile ** older;
+  T_History_tile ** newer;
+  const byte * pixels = page->Image[layer].Pixels;
+  int x, y;
+  int i = 0;
+
+  tiles = calloc(Nb_history_tiles(page->Width, page->Height), sizeof(T_History_tile *));
+  if (tiles == NULL)
+    return 0;
+  older = Neighbour_tiles(page, page->Next, layer);
+  newer = Neighbour_tiles(page, page->Prev, layer);
+
+  for (y = 0; y < page->Height; y += HISTORY_TILE_SIZE)
+  {
+    for (x = 0; x < page->Width; x += HISTORY_TILE_SIZE, i++)
+    {
+      const byte * src = pixels + y*page->Width + x;
+
+      if (older != NULL && History_tile_is_same(older[i], src, page->Width))
+        tiles[i] = older[i];
+      else if (newer != NULL && History_tile_is_same(newer[i], src, page->Width))
+        tiles[i] = newer[i];
+      else
+      {
+        tiles[i] = NULL;
+        if (older != NULL)
+          tiles[i] = New_delta_history_tile(src, page->Width, older[i]);
+        if (tiles[i] == NULL)
+          tiles[i] = New_history_tile(src, page->Width,
+                                      Min(HISTORY_TILE_SIZE, page->Width - x),
+                                      Min(HISTORY_TILE_SIZE, page->Height - y));
+        if (tiles[i] == NULL)
+        {
+          while (i > 0)
+            Free_history_tile(tiles[--i]);
+          free(tiles);
+          return 0;
+        }
+        continue;
+      }
+      tiles[i]->Users++;
+    }
+  }
+  Free_layer(page, layer);
+  page->Image[layer].Pixels = NULL;
+  page->Image[layer].Tiles = tiles;
+
+  // Stats
+  Stats_pages_number++;
+  return 1;
+}
+
+/// Checks if a tiled layer has the same pixels as a (non-tiled) layer
+static int Tiled_layer_is_same(const T_Page * page, int layer, const byte * pixels)
+{
+  int x, y;
+  int i = 0;
+
+  for (y = 0; y < page->Height; y += HISTORY_TILE_SIZE)
+    for (x = 0; x < page->Width; x += HISTORY_TILE_SIZE, i++)
+      if (!History_tile_is_same(page->Image[layer].Tiles[i], pixels + y*page->Width + x, page->Width))
+        return 0;
+  return 1;
+}
+
+/// Converts back a tiled layer to a single block of pixels.
+/// When a neighbour page has a non-tiled layer with the same pixels, it is
+/// shared instead. Returns 0 if out of memory or if the history spill file
+/// cannot be read: the layer then stays tiled.
+static int Untile_layer(T_Page * page, int layer)
+{
+  T_Page * neighbours[2];
+  byte * pixels = NULL;
+  int n;
+
+  neighbours[0] = page->Prev;
+  neighbours[1] = page->Next;
+  for (n = 0; n < 2 && pixels == NULL; n++)
+  {
+    if (neighbours[n] != page
+      && neighbours[n]->Width == page->Width
+      && neighbours[n]->Height == page->Height
+      && layer < neighbours[n]->Nb_layers
+      && neighbours[n]->Image[layer].Pixels != NULL
+      && Tiled_layer_is_same(page, layer, neighbours[n]->Image[layer].Pixels))
+      pixels = Dup_layer(neighbours[n]->Image[layer].Pixels);
+  }
+  if (pixels == NULL)
+  {
+    int x, y;
+    int i = 0;
+
+    pixels = New_layer(page->Width*page->Height);
+    if (pixels == NULL)
+      return 0;
+    for (y = 0; y < page->Height; y += HISTORY_TILE_SIZE)
+    {
+      for (x = 0; x < page->Width; x += HISTORY_TILE_SIZE, i++)
+      {
+        const T_History_tile * tile = page->Image[layer].Tiles[i];
+        byte buffer[HISTORY_TILE_SIZE*HISTORY_TILE_SIZE];
+        const byte * tile_pixels = History_tile_pixels(tile, buffer);
+        int line;
+
+        if (tile_pixels == NULL)
+        {
+          // The spill file cannot be read: keep the layer tiled
+          free((short *)pixels - 1);
+          Stats_pages_number--;
+          Stats_pages_memory -= page->Width*page->Height;
+          return 0;
+        }
+        for (line = 0; line < tile->Height; line++)
+          memcpy(pixels + (y+line)*page->Width + x, tile_pixels + line*tile->Width, tile->Width);
+      }
+    }
+  }
+  Free_tiled_layer(page, layer);
+  page->Image[layer].Pixels = pixels;
+  return 1;
+}
+
+/// Makes sure all layers of a page are single blocks of pixels.
+/// Returns 0 on failure (see Untile_layer()): the layers that could not be
+/// converted stay tiled, and the page is still valid.
+static int Untile_page(T_Page * page)
+{
+  int i;
+
+  for (i = 0; i < page->Nb_layers; i++)
+  {
+    if (page->Image[i].Tiles != NULL && !Untile_layer(page, i))
+      return 0;
+  }
+  return 1;
+}
+
+/// Converts the layers of a page to tiles.
+static void Tile_page(T_Page * page)
+{
+  int i;
+
+  for (i = 0; i < page->Nb_layers; i++)
+  {
+    // Layers that are still shared with another page are left alone:
+    // tiling them would use more memory, not less.
+    if (page->Image[i].Pixels != NULL && *((short *)(page->Image[i].Pixels)-1) == 1)
+      Tile_layer(page, i);
+  }
+}
+
+/// Compress the tiles of a page.
+static void Pack_page(T_Page * page)
+{
+  int i;
+  int nb_tiles = Nb_history_tiles(page->Width, page->Height);
+
+  for (i = 0; i < page->Nb_layers; i++)
+  {
+    int t;
+
+    if (page->Image[i].Tiles == NULL)
+      continue;
+    for (t = 0; t < nb_tiles; t++)
+      Pack_history_tile(page->Image[i].Tiles[t]);
+  }
+}
+
+void Compact_list_of_pages(T_List_of_pages * list)
+{
+  T_Page * page;
+  int distance;
+
+  // The current page and the previous one are used while drawing
+  if (list == NULL || list->Pages == NULL || list->List_size < 3)
+    return;
+  // A backup or a redo only moves one page to distance 2: the previous
+  // "previous page". An undo moves the current page to the end of the list.
+  Tile_page(list->Pages->Next->Next);
+  Tile_page(list->Pages->Prev);
+  if (list->List_size - 1 > HISTORY_PACKED_STEPS)
+    Pack_page(list->Pages->Prev);
+
+  // Likewise, only one page crosses HISTORY_PACKED_STEPS in each step.
+  // (Pack_history_tile() does nothing on tiles that are already packed)
+  if (list->List_size - 1 <= HISTORY_PACKED_STEPS)
+    return;
+  page = list->Pages;
+  for (distance = 0; distance <= HISTORY_PACKED_STEPS; distance++)
+    page = page->Next;
+  Pack_page(page);
+}
+
+/// Returns the memory of a tile and of the tiles it is based on, shared
+/// between their users.
+static double History_tile_memory(const T_History_tile * tile)
+{
+  double memory = 0;
+  double share = 1;
+
+  // Each tile in the delta chain is shared between its users,
+  // which include the delta tiles based on it
+  for (; tile != NULL; tile = tile->Base)
+  {
+    share /= tile->Users;
+    if (tile->Pixels != NULL)
+      memory += share * tile->Size;
+  }
+  return memory;
+}
+
+/// Returns the memory used by the bitmaps of a list of pages, in bytes.
+/// A layer or a tile shared by several pages is split between them, so
+/// the result is exact as long as the list doesn't share them with another
+/// one.
+static long long History_memory(const T_List_of_pages * list)
+{
+  const T_Page * page = list->Pages;
+  double memory = 0;
+  int n;
+
+  for (n = 0; n < list->List_size; n++, page = page->Next)
+  {
+    int layer;
+
+    for (layer = 0; layer < page->Nb_layers; layer++)
+    {
+      const T_Image * image = &page->Image[layer];
+
+      if (image->Pixels != NULL)
+        memory += (double)page->Width*page->Height / *((short *)(image->Pixels)-1);
+      else if (image->Tiles != NULL)
+      {
+        int i;
+        int nb_tiles = Nb_history_tiles(page->Width, page->Height);
+
+        for (i = 0; i < nb_tiles; i++)
+          memory += History_tile_memory(image->Tiles[i]);
+      }
+    }
+  }
+  return (long long)(memory + 0.5);
+}
+
+/// Moves the tiles of the oldest history steps to the spill file, until
+/// size bytes of memory are freed. Returns 0 if it stopped before: no spill
+/// file, disk budget reached, or no more tiles to spill.
+static int Spill_oldest_pages(T_List_of_pages * list, long long size)
+{
+  long long target = Stats_pages_memory - size;
+  long long disk_budget = (long long)Config.Max_undo_disk*1024*1024;
+  T_Page * page;
+
+  if (!Open_spill_file())
+    return 0;
+  // The last page of the list is the oldest one
+  for (page = list->Pages->Prev; page != list->Pages && page != list->Pages->Next; page = page->Prev)
+  {
+    int layer;
+
+    for (layer = 0; layer < page->Nb_layers; layer++)
+    {
+      int i;
+      int nb_tiles;
+
+      if (page->Image[layer].Tiles == NULL)
+        continue;
+      nb_tiles = Nb_history_tiles(page->Width, page->Height);
+      for (i = 0; i < nb_tiles; i++)
+      {
+        T_History_tile * tile = page->Image[layer].Tiles[i];
+
+        if (Stats_pages_memory <= target)
+          return 1;
+        if (tile->Pixels == NULL)
+          continue;
+        if (Stats_spilled_memory + tile->Size > disk_budget || !Spill_history_tile(tile))
+          return 0;
+      }
+    }
+  }
+  return Stats_pages_memory <= target;
+}
+
 // ==============================================================
 
 /// Adds a shared reference to the gradient data of another page. Pass NULL for new.
@@ -185,6 +926,7 @@ void Download_infos_page_main(T_Page * page)
     Main.image_width=page->Width;
     Main.image_height=page->Height;
     memcpy(Main.palette,page->Palette,sizeof(T_Palette));
+    Invalidate_best_color_cache();
     Main.fileformat=page->File_format;
 
     if (size_is_modified)
@@ -203,77 +945,170 @@ void Download_infos_page_main(T_Page * page)
   
 }
 
-void Redraw_layered_image(void)
+/// Merge the non-transparent pixels of a span of a layer over the
+/// visible image (if dest isn't NULL) and the depth buffer (if depth isn't
+/// NULL). Pixels are compared 8 at a time, as a 64-bit word.
+static void Merge_layer_span(byte * dest, byte * depth, const byte * src, long count, byte transparent, byte layer)
 {
-  if (Main.backups->Pages->Image_mode != IMAGE_MODE_ANIMATION)
+  const qword ones = 0x0101010101010101ULL;
+  const qword high = ones * 0x80;
+  const qword key = ones * transparent;
+  const qword layer_word = ones * layer;
+  long i;
+
+  for (i = 0; i + 8 <= count; i += 8)
   {
-    // Re-construct the image with the visible layers
-    byte layer=0;  
-    // First layer
-    if ((Main.backups->Pages->Image_mode == IMAGE_MODE_MODE5
-		|| Main.backups->Pages->Image_mode == IMAGE_MODE_RASTER) && Main.layers_visible & (1<<4))
+    qword pixels, mask, word;
+
+    memcpy(&pixels, src + i, 8);
+    word = pixels ^ key;
+    // High bit of each byte set when that pixel isn't transparent
+    mask = (((word & ~high) + ~high) | word) & high;
+    if (mask == 0)
+      continue;
+    if (mask == high)
     {
-      // The raster result layer is visible: start there
-      // Copy it in Main_visible_image
-      int i;
-      for (i=0; i< Main.image_width*Main.image_height; i++)
-      {
-        layer = *(Main.backups->Pages->Image[4].Pixels+i);
-        if (Main.layers_visible & (1 << layer))
-          Main.visible_image.Image[i]=*(Main.backups->Pages->Image[layer].Pixels+i);
-        else
-          Main.visible_image.Image[i] = layer;
-      }
-        
-      // Copy it to the depth buffer
-      memcpy(Main_visible_image_depth_buffer.Image,
-        Main.backups->Pages->Image[4].Pixels,
-        Main.image_width*Main.image_height);
-        
-      // Next
-      layer= (1<<4)+1;
+      if (dest != NULL)
+        memcpy(dest + i, src + i, 8);
+      if (depth != NULL)
+        memset(depth + i, layer, 8);
+      continue;
     }
-    else
+    mask = (mask >> 7) * 0xFF;
+    if (dest != NULL)
     {
-      for (layer=0; layer<Main.backups->Pages->Nb_layers; layer++)
-      {
-        if ((1<<layer) & Main.layers_visible)
-        {
-           // Copy it in Main_visible_image
-           memcpy(Main.visible_image.Image,
-             Main.backups->Pages->Image[layer].Pixels,
-             Main.image_width*Main.image_height);
-           
-           // Initialize the depth buffer
-           memset(Main_visible_image_depth_buffer.Image,
-             layer,
-             Main.image_width*Main.image_height);
-           
-           // skip all other layers
-           layer++;
-           break;
-        }
-      }
+      memcpy(&word, dest + i, 8);
+      word = (word & ~mask) | (pixels & mask);
+      memcpy(dest + i, &word, 8);
     }
-    // subsequent layer(s)
-    for (; layer<Main.backups->Pages->Nb_layers; layer++)
+    if (depth != NULL)
+    {
+      memcpy(&word, depth + i, 8);
+      word = (word & ~mask) | (layer_word & mask);
+      memcpy(depth + i, &word, 8);
+    }
+  }
+  for (; i < count; i++)
+  {
+    if (src[i] != transparent)
+    {
+      if (dest != NULL)
+        dest[i] = src[i];
+      if (depth != NULL)
+        depth[i] = layer;
+    }
+  }
+}
+
+/// Checks if a span of a layer has at least one non-transparent pixel.
+static int Span_is_opaque(const byte * src, long count, byte transparent)
+{
+  const qword key = 0x0101010101010101ULL * transparent;
+  long i;
+
+  for (i = 0; i + 8 <= count; i += 8)
+  {
+    qword pixels;
+
+    memcpy(&pixels, src + i, 8);
+    if (pixels != key)
+      return 1;
+  }
+  for (; i < count; i++)
+    if (src[i] != transparent)
+      return 1;
+  return 0;
+}
+
+/// Re-construct some rows of the visible image and of the depth buffer
+/// with the visible layers.
+static void Composite_layered_rows(int first_row, int nb_rows)
+{
+  T_Page * page = Main.backups->Pages;
+  long offset = (long)first_row * Main.image_width;
+  long count = (long)nb_rows * Main.image_width;
+  byte * visible = Main.visible_image.Image + offset;
+  byte * depth = Main_visible_image_depth_buffer.Image + offset;
+  int layer=0;
+
+  // First layer
+  if ((page->Image_mode == IMAGE_MODE_MODE5
+    || page->Image_mode == IMAGE_MODE_RASTER) && Main.layers_visible & (1<<4))
+  {
+    // The raster result layer is visible: start there
+    // Copy it in Main_visible_image
+    long i;
+    for (i=0; i<count; i++)
+    {
+      byte source = page->Image[4].Pixels[offset+i];
+      if (Main.layers_visible & (1 << source))
+        visible[i] = page->Image[source].Pixels[offset+i];
+      else
+        visible[i] = source;
+    }
+
+    // Copy it to the depth buffer
+    memcpy(depth, page->Image[4].Pixels + offset, count);
+
+    // Next
+    layer= (1<<4)+1;
+  }
+  else
+  {
+    for (layer=0; layer<page->Nb_layers; layer++)
     {
       if ((1<<layer) & Main.layers_visible)
       {
-        int i;
-        for (i=0; i<Main.image_width*Main.image_height; i++)
-        {
-          byte color = *(Main.backups->Pages->Image[layer].Pixels+i);
-          if (color != Main.backups->Pages->Transparent_color) // transparent color
-          {
-            *(Main.visible_image.Image+i) = color;
-            if (layer != Main.current_layer)
-              *(Main_visible_image_depth_buffer.Image+i) = layer;
-          }
-        }
+         // Copy it in Main_visible_image
+         memcpy(visible, page->Image[layer].Pixels + offset, count);
+
+         // Initialize the depth buffer
+         memset(depth, layer, count);
+
+         // skip all other layers
+         layer++;
+         break;
       }
     }
   }
+  // subsequent layer(s)
+  for (; layer<page->Nb_layers; layer++)
+  {
+    if ((1<<layer) & Main.layers_visible)
+      Merge_layer_span(visible, layer != Main.current_layer ? depth : NULL,
+        page->Image[layer].Pixels + offset, count, page->Transparent_color, layer);
+  }
+}
+
+/// Re-construct the rows of the visible image marked in dirty_rows
+/// (one byte per row of the image), merging consecutive rows.
+static void Composite_dirty_rows(const byte * dirty_rows)
+{
+  int y = 0;
+
+  while (y < Main.image_height)
+  {
+    int first_row;
+
+    if (!dirty_rows[y])
+    {
+      y++;
+      continue;
+    }
+    first_row = y;
+    while (y < Main.image_height && dirty_rows[y])
+      y++;
+    Composite_layered_rows(first_row, y - first_row);
+  }
+}
+
+void Redraw_layered_image(void)
+{
+  if (Main.backups->Pages->Image_mode != IMAGE_MODE_ANIMATION)
+  {
+    // Re-construct the image with the visible layers
+    Composite_layered_rows(0, Main.image_height);
+  }
   else
   {
     Update_screen_targets();
@@ -281,6 +1116,77 @@ void Redraw_layered_image(void)
   Update_FX_feedback(Config.FX_Feedback);
 }
 
+void Redraw_layered_image_for_layers(dword layers)
+{
+  T_Page * page = Main.backups->Pages;
+  byte * dirty_rows;
+  int layer;
+  int y;
+
+  // In MODE5 and RASTER modes, the layer 4 tells which layer is seen,
+  // so any layer can change any pixel.
+  if (page->Image_mode == IMAGE_MODE_ANIMATION
+    || page->Image_mode == IMAGE_MODE_MODE5
+    || page->Image_mode == IMAGE_MODE_RASTER
+    || (dirty_rows = calloc(Main.image_height, 1)) == NULL)
+  {
+    Redraw_layered_image();
+    return;
+  }
+  for (layer=0; layer<page->Nb_layers; layer++)
+  {
+    if (!((1<<layer) & layers))
+      continue;
+    for (y=0; y<Main.image_height; y++)
+      if (!dirty_rows[y] && Span_is_opaque(page->Image[layer].Pixels + (long)y*Main.image_width, Main.image_width, page->Transparent_color))
+        dirty_rows[y] = 1;
+  }
+  Composite_dirty_rows(dirty_rows);
+  free(dirty_rows);
+  Update_FX_feedback(Config.FX_Feedback);
+}
+
+/// Re-construct the visible image after Undo or Redo, when the layers
+/// of the old page are still the ones shown: only the rows where a
+/// visible layer has changed are done again.
+static void Redraw_changed_rows(const T_Page * old_page, dword old_layers_visible, int old_current_layer)
+{
+  T_Page * page = Main.backups->Pages;
+  byte * dirty_rows;
+  int layer;
+  int y;
+
+  if (old_page == NULL
+    || page->Image_mode == IMAGE_MODE_ANIMATION
+    || page->Image_mode != old_page->Image_mode
+    || page->Width != old_page->Width
+    || page->Height != old_page->Height
+    || page->Nb_layers != old_page->Nb_layers
+    || page->Transparent_color != old_page->Transparent_color
+    || Main.layers_visible != old_layers_visible
+    || Main.current_layer != old_current_layer
+    || (dirty_rows = calloc(Main.image_height, 1)) == NULL)
+  {
+    Redraw_layered_image();
+    return;
+  }
+  for (layer=0; layer<page->Nb_layers; layer++)
+  {
+    const byte * pixels = page->Image[layer].Pixels;
+    const byte * old_pixels = old_page->Image[layer].Pixels;
+
+    // Layers shared by both pages are identical
+    if (!((1<<layer) & Main.layers_visible) || pixels == old_pixels)
+      continue;
+    for (y=0; y<Main.image_height; y++)
+      if (!dirty_rows[y] && memcmp(pixels + (long)y*Main.image_width, old_pixels + (long)y*Main.image_width, Main.image_width))
+        dirty_rows[y] = 1;
+  }
+  Composite_dirty_rows(dirty_rows);
+  free(dirty_rows);
+  Update_FX_feedback(Config.FX_Feedback);
+}
+
 void Update_depth_buffer(void)
 {
   if (Main.backups->Pages->Image_mode != IMAGE_MODE_ANIMATION)
@@ -313,17 +1219,10 @@ void Update_depth_buffer(void)
         continue;
         
       if ((1<<layer) & Main.layers_visible)
-      {
-        int i;
-        for (i=0; i<Main.image_width*Main.image_height; i++)
-        {
-          byte color = *(Main.backups->Pages->Image[layer].Pixels+i);
-          if (color != Main.backups->Pages->Transparent_color) // transparent color
-          {
-            *(Main_visible_image_depth_buffer.Image+i) = layer;
-          }
-        }
-      }
+        Merge_layer_span(NULL, Main_visible_image_depth_buffer.Image,
+          Main.backups->Pages->Image[layer].Pixels,
+          (long)Main.image_width*Main.image_height,
+          Main.backups->Pages->Transparent_color, layer);
     }
   }
   Update_FX_feedback(Config.FX_Feedback);
@@ -359,19 +1258,10 @@ void Redraw_spare_image(void)
     for (; layer<Spare.backups->Pages->Nb_layers; layer++)
     {
       if ((1<<layer) & Spare.layers_visible)
-      {
-        int i;
-        for (i=0; i<Spare.image_width*Spare.image_height; i++)
-        {
-          byte color = *(Spare.backups->Pages->Image[layer].Pixels+i);
-          if (color != Spare.backups->Pages->Transparent_color) // transparent color
-          {
-            *(Spare.visible_image.Image+i) = color;
-            //if (layer != Spare.current_layer)
-            //  *(Spare_visible_image_depth_buffer.Image+i) = layer;
-          }
-        }
-      }
+        Merge_layer_span(Spare.visible_image.Image, NULL,
+          Spare.backups->Pages->Image[layer].Pixels,
+          (long)Spare.image_width*Spare.image_height,
+          Spare.backups->Pages->Transparent_color, layer);
     }
   }
 }
@@ -511,7 +1401,7 @@ int Allocate_list_of_pages(T_List_of_pages * list)
 }
 
 
-void Backward_in_list_of_pages(T_List_of_pages * list)
+int Backward_in_list_of_pages(T_List_of_pages * list)
 {
   // Cette fonction fait l'équivalent d'un "Undo" dans la liste de pages.
   // Elle effectue une sorte de ROL (Rotation Left) sur la liste:
@@ -529,6 +1419,12 @@ void Backward_in_list_of_pages(T_List_of_pages * list)
   // sortie, ainsi que celles relatives à la plus récente page d'undo (1ère
   // page de la liste).
 
+  // The new current and previous pages may be stored as tiles: convert
+  // them before touching the list, so it is unchanged if this fails.
+  // (Pages 0 and 1 are never tiled)
+  if (!Untile_page(list->Pages->Next->Next))
+    return 0;
+
   if (Last_backed_up_layers)
   {
     // First page contains a ready-made backup of its ->Next.
@@ -546,12 +1442,13 @@ void Backward_in_list_of_pages(T_List_of_pages * list)
       page0->Prev = page1;
       page1->Next = page0;
       list->Pages = page0;
-      return;
   }
-  list->Pages = list->Pages->Next;
+  else
+    list->Pages = list->Pages->Next;
+  return 1;
 }
 
-void Advance_in_list_of_pages(T_List_of_pages * list)
+int Advance_in_list_of_pages(T_List_of_pages * list)
 {
   // Cette fonction fait l'équivalent d'un "Redo" dans la liste de pages.
   // Elle effectue une sorte de ROR (Rotation Right) sur la liste:
@@ -568,6 +1465,12 @@ void Advance_in_list_of_pages(T_List_of_pages * list)
   // de page courante à jour avant l'appel, puis en réextraire les infos en
   // sortie, ainsi que celles relatives à la plus récente page d'undo (1ère
   // page de la liste).
+
+  // The new current page may be stored as tiles: convert it before
+  // touching the list, so it is unchanged if this fails.
+  if (!Untile_page(list->Pages->Prev))
+    return 0;
+
   if (Last_backed_up_layers)
   {
     // First page contains a ready-made backup of its ->Next.
@@ -585,9 +1488,10 @@ void Advance_in_list_of_pages(T_List_of_pages * list)
       page0->Next = page1;
       page1->Prev = page0;
       list->Pages = page1;
-      return;
   }
-  list->Pages = list->Pages->Prev;
+  else
+    list->Pages = list->Pages->Prev;
+  return 1;
 }
 
 void Free_last_page_of_list(T_List_of_pages * list)
@@ -622,14 +1526,31 @@ int Create_new_page(T_Page * new_page, T_List_of_pages * list, int layer)
 // based on the pages's attributes (width,height,...)
 // then pushes it on front of a Page list.
 
-  if (list->List_size >= (Config.Max_undo_pages+1))
+  if (Config.Max_undo_memory != 0)
+  {
+    long long budget = (long long)Config.Max_undo_memory*1024*1024;
+    long long size = 0;
+    long long others;
+
+    if (layer == LAYER_ALL)
+      size = (long long)new_page->Nb_layers*new_page->Width*new_page->Height;
+    else if (layer >= 0)
+      size = (long long)new_page->Width*new_page->Height;
+    // Memory budget, for each list of pages: Stats_pages_memory is the sum
+    // of all bitmaps in use (in bytes), including the ones of the other
+    // picture, which don't change while this list is trimmed. Move the oldest
+    // pages to the spill file, or destroy them when it is full, until the
+    // history fits. But always keep one step to undo.
+    others = Stats_pages_memory - History_memory(list);
+    while (list->List_size > 1 && Stats_pages_memory - others + size > budget)
+    {
+      if (!Spill_oldest_pages(list, Stats_pages_memory - others + size - budget))
+        Free_last_page_of_list(list);
+    }
+  }
+  else if (list->List_size >= (Config.Max_undo_pages+1))
   {
     // List is full.
-    // If some other memory-limit was to be implemented, here would
-    // be the right place to do it.
-    // For example, we could rely on Stats_pages_memory, 
-    // because it's the sum of all bitmaps in use (in bytes).
-    
     // Destroy the latest page
     Free_last_page_of_list(list);
   }
@@ -674,7 +1595,11 @@ void Free_page_of_a_list(T_List_of_pages * list)
   {
     // On fait faire un undo à la liste, comme ça, la nouvelle page courante
     // est la page précédente
-    Backward_in_list_of_pages(Main.backups);
+    if (!Backward_in_list_of_pages(Main.backups))
+    {
+      Error(0);
+      return;
+    }
 
     // Puis on détruit la dernière page, qui est l'ancienne page courante
     Free_last_page_of_list(list);
@@ -1085,7 +2010,8 @@ int Backup_and_resize_the_spare(int width,int height)
     
     // Light up the 'has unsaved changes' indicator
     Spare.image_is_modified=1;
-    
+
+    Compact_list_of_pages(Spare.backups);
     return_code=1;
   }
   return return_code;
@@ -1197,6 +2123,7 @@ void Backup_the_spare(int layer)
   // Light up the 'has unsaved changes' indicator
   Spare.image_is_modified=1;
 
+  Compact_list_of_pages(Spare.backups);
 }
 
 void Check_layers_limits()
@@ -1212,11 +2139,28 @@ void Undo(void)
 {
   int width = Main.image_width;
   int height = Main.image_height;
+  dword layers_visible = Main.layers_visible;
+  int current_layer = Main.current_layer;
+  // The page shown until now, while its layers are still the visible ones
+  const T_Page * old_page = Main.backups->Pages;
+  T_Page * new_page;
+
+  // The pages that will be the current and the previous one may be stored
+  // as tiles. Convert them first, so nothing changes if memory is missing.
+  new_page = Main.backups->Pages->Next;
+  if (Last_backed_up_layers)
+    new_page = new_page->Next;
+  if (!Untile_page(new_page) || !Untile_page(new_page->Next))
+  {
+    Error(0);
+    return;
+  }
 
   if (Last_backed_up_layers)
   {
     Free_page_of_a_list(Main.backups);
     Last_backed_up_layers=0;
+    old_page = NULL;
   }
 
   // On remet à jour l'état des infos de la page courante (pour pouvoir les
@@ -1235,7 +2179,7 @@ void Undo(void)
   //       poser de problèmes.
   
   Check_layers_limits();
-  Redraw_layered_image();
+  Redraw_changed_rows(old_page, layers_visible, current_layer);
   End_of_modification();
 
   if (width != Main.image_width || height != Main.image_height)
@@ -1246,11 +2190,26 @@ void Redo(void)
 {
   int width = Main.image_width;
   int height = Main.image_height;
+  dword layers_visible = Main.layers_visible;
+  int current_layer = Main.current_layer;
+  // The page shown until now, while its layers are still the visible ones
+  const T_Page * old_page = Main.backups->Pages;
+
+  // The page that will be the current one may be stored as tiles. Convert
+  // it first, so nothing changes if memory is missing. Dropping the
+  // ready-made backup goes backward once, which needs page 2 untiled too.
+  if (!Untile_page(Main.backups->Pages->Prev)
+    || (Last_backed_up_layers && !Untile_page(Main.backups->Pages->Next->Next)))
+  {
+    Error(0);
+    return;
+  }
 
   if (Last_backed_up_layers)
   {
     Free_page_of_a_list(Main.backups);
     Last_backed_up_layers=0;
+    old_page = NULL;
   }
   // On remet à jour l'état des infos de la page courante (pour pouvoir les
   // retrouver plus tard)
@@ -1268,7 +2227,7 @@ void Redo(void)
   //       poser de problèmes.
   
   Check_layers_limits();
-  Redraw_layered_image();
+  Redraw_changed_rows(old_page, layers_visible, current_layer);
   End_of_modification();
 
   if (width != Main.image_width || height != Main.image_height)
@@ -1314,6 +2273,8 @@ void End_of_modification(void)
     Update_screen_targets();
   }
   Update_FX_feedback(Config.FX_Feedback);
+  // Older history steps only keep the tiles they don't share
+  Compact_list_of_pages(Main.backups);
 /*  
   Last_backed_up_layers = 0;
   Backup();
@@ -1373,6 +2334,7 @@ byte Add_layer(T_List_of_pages *list, int layer)
     new_page->Image[i]=new_page->Image[i-1];
   }
   new_page->Image[layer].Pixels=new_image;
+  new_page->Image[layer].Tiles=NULL;
   if (list->Pages->Nb_layers==0)
     duration=100;
   else if (layer>0)
@@ -72,11 +72,15 @@ void Upload_infos_page(T_Document * doc);
 void Init_list_of_pages(T_List_of_pages * list);
 // private
 int Allocate_list_of_pages(T_List_of_pages * list);
-void Backward_in_list_of_pages(T_List_of_pages * list);
-void Advance_in_list_of_pages(T_List_of_pages * list);
+int Backward_in_list_of_pages(T_List_of_pages * list);
+int Advance_in_list_of_pages(T_List_of_pages * list);
 void Free_last_page_of_list(T_List_of_pages * list);
 int Create_new_page(T_Page * new_page,T_List_of_pages * current_list, int layer);
 void Change_page_number_of_list(T_List_of_pages * list,int number);
+/// Stores the layers of the old history steps as shared tiles.
+/// The current page and the one before it are not modified. It only
+/// looks at the pages that one step moves, so call it after every step.
+void Compact_list_of_pages(T_List_of_pages * list);
 void Free_page_of_a_list(T_List_of_pages * list);
 
 
@@ -111,6 +115,10 @@ void End_of_modification(void);
 
 void Update_depth_buffer(void);
 void Redraw_layered_image(void);
+/// Re-construct the visible image and the depth buffer only on the rows
+/// where one of the given layers (bitfield) has non-transparent pixels.
+/// Use it after toggling the visibility of layers, or changing the current layer.
+void Redraw_layered_image_for_layers(dword layers);
 void Redraw_current_layer(void);
 
 void Update_screen_targets(void);
@@ -118,6 +126,9 @@ void Update_screen_targets(void);
 int Update_buffers(int width, int height);
 int Update_spare_buffers(int width, int height);
 void Redraw_spare_image(void);
+/// Closes and deletes the file where old history steps are moved when
+/// they don't fit in the Undo memory budget. Call on program exit.
+void Close_history_spill_file(void);
 ///
 /// Must be called after changing the head of Main_backups list, or
 /// Main_current_layer
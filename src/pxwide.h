@@ -41,10 +41,8 @@
   void Display_part_of_screen_wide (word width,word height,word image_width);
   void Display_line_on_screen_wide   (word x_pos,word y_pos,word width,byte * line);
   void Read_line_screen_wide       (word x_pos,word y_pos,word width,byte * line);
-  void Display_part_of_screen_scaled_wide(word width,word height,word image_width,byte * buffer);
   void Display_brush_color_zoom_wide   (word x_pos,word y_pos,word x_offset,word y_offset,word width,word end_y_pos,byte transp_color,word brush_width,byte * buffer);
   void Display_brush_mono_zoom_wide    (word x_pos,word y_pos,word x_offset,word y_offset,word width,word end_y_pos,byte transp_color,byte color,word brush_width,byte * buffer);
-  void Clear_brush_scaled_wide           (word x_pos,word y_pos,word x_offset,word y_offset,word width,word end_y_pos,byte transp_color,word image_width,byte * buffer);
   void Display_brush_wide             (byte * brush, word x_pos,word y_pos,word x_offset,word y_offset,word width,word height,byte transp_color,word brush_width);
 
   void Display_line_on_screen_fast_wide   (word x_pos,word y_pos,word width,byte * line);
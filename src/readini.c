@@ -27,6 +27,8 @@
 #include <ctype.h>
 #if defined(_MSC_VER)
 #define strdup _strdup
+#else
+#include <strings.h>
 #endif
 
 #include "const.h"
@@ -57,32 +59,33 @@
 void Load_INI_clear_string(char * str, byte keep_comments)
 {
   int index;
+  int length=0;
   int equal_found=0;
 
-  for (index=0;str[index]!='\0';)
+  // The characters are moved in place, in a single pass
+  for (index=0;str[index]!='\0';index++)
   {
     if (str[index]=='=')
     {
       equal_found=1;
-      index++;
+      str[length++]='=';
       // On enleve les espaces après le '='
-      while (str[index]==' ' || str[index]=='\t')
-        memmove(str+index,str+index+1,strlen(str+index));
+      while (str[index+1]==' ' || str[index+1]=='\t')
+        index++;
     }
     else if ((str[index]==' ' && !equal_found) || (str[index]=='\t'))
     {
-      // Suppression d'un espace ou d'un tab:
-      memmove(str+index,str+index+1,strlen(str+index));
+      // Suppression d'un espace ou d'un tab
     }
     else if (!keep_comments && ((str[index]==';') || (str[index]=='#')))
     {
       // Comment
-      str[index]='\0';
+      break;
     }
     else if ((str[index]=='\r') || (str[index]=='\n'))
     {
       // Line break
-      str[index]='\0';
+      break;
     }
     else
     {
@@ -90,18 +93,20 @@ void Load_INI_clear_string(char * str, byte keep_comments)
       {
         // Passage en majuscule d'un caractère:
 #ifndef GCWZERO  //this causes gcw to crash
-        str[index]=toupper((int)str[index]);
+        str[length]=toupper((int)str[index]);
+#else
+        str[length]=str[index];
 #endif
       }
-      index++;
+      else
+        str[length]=str[index];
+      length++;
     }
   }
   // On enlève les espaces avant la fin de chaine
-  while (index>0 && (str[index-1]==' ' || str[index-1]=='\t'))
-  {
-    index--;
-    str[index]='\0';
-  }
+  while (length>0 && (str[length-1]==' ' || str[length-1]=='\t'))
+    length--;
+  str[length]='\0';
 }
 
 /**
@@ -137,110 +142,233 @@ int Load_INI_seek_pattern(const char * buffer,const char * pattern)
 }
 
 /**
- * Read lines until a group is found
+ * Hash a group and option name, ignoring case.
  *
- * @return 0 when the group is reached
- * @return @ref ERROR_INI_CORRUPTED if the group is not found
+ * @param group the group name, with its brackets, or NULL for group headers
+ * @param key the option name
+ * @return the bucket index in T_INI_file::Hash
  */
-static int Load_INI_reach_group(FILE * file,char * buffer,const char * group)
+static unsigned int INI_hash(const char * group, const char * key)
 {
-  int    stop_seek;
-  char * group_upper;
-  char * upper_buffer;
+  unsigned int hash = 5381;
 
-  // On alloue les zones de mémoire:
-  group_upper=(char *)malloc(1024);
-  upper_buffer=(char *)malloc(1024);
+  if (group != NULL)
+  {
+    for (; *group != '\0'; group++)
+      hash = hash * 33 + (*group & 0xDF);
+  }
+  hash = hash * 33 + '/';
+  for (; *key != '\0'; key++)
+    hash = hash * 33 + (*key & 0xDF);
+  return hash % INI_HASH_SIZE;
+}
 
-  // On commence par se faire une version majuscule du groupe à rechercher:
-  strcpy(group_upper,group);
-  Load_INI_clear_string(group_upper, 0);
+/**
+ * Read a whole .INI file in memory, and index its groups and options.
+ *
+ * Each line is cleaned once with Load_INI_clear_string() to extract
+ * the option name or the group header, so that all later lookups
+ * are done with Load_INI_find() without scanning the file again.
+ *
+ * @param filename the file to read
+ * @return the file contents, to be freed with Free_INI_file()
+ * @return NULL if the file cannot be read
+ */
+T_INI_file * Load_INI_file(const char * filename)
+{
+  FILE * file;
+  T_INI_file * ini;
+  char buffer[1024];
+  char key[1024];
+  int lines_size = 0;
+  int group = -1;
+  int index;
+
+  file = fopen(filename, "r");
+  if (file == NULL)
+    return NULL;
+  ini = (T_INI_file *)GFX2_malloc(sizeof(T_INI_file));
+  if (ini == NULL)
+  {
+    fclose(file);
+    return NULL;
+  }
+  ini->Lines = NULL;
+  ini->Nb_lines = 0;
 
-  stop_seek=0;
-  do
+  while (fgets(buffer, sizeof(buffer), file) != NULL)
   {
-    // On lit une ligne dans le fichier:
-    if (fgets(buffer,1024,file)==0)
+    T_INI_line * line;
+    char * end;
+
+    if (ini->Nb_lines >= lines_size)
     {
-      free(upper_buffer);
-      free(group_upper);
-      return ERROR_INI_CORRUPTED;
+      T_INI_line * lines;
+
+      lines_size = lines_size ? lines_size * 2 : 256;
+      lines = (T_INI_line *)realloc(ini->Lines, lines_size * sizeof(T_INI_line));
+      if (lines == NULL)
+      {
+        GFX2_Log(GFX2_ERROR, "Load_INI_file() cannot allocate %d lines\n", lines_size);
+        break;
+      }
+      ini->Lines = lines;
     }
+    line = ini->Lines + ini->Nb_lines;
+    line->Key = NULL;
+    line->Value = NULL;
+    line->Group = group;
+    line->Hash_next = -1;
+    line->Text = strdup(buffer);
+    if (line->Text == NULL)
+      break;
 
-    Line_number_in_INI_file++;
+    strcpy(key, buffer);
+    Load_INI_clear_string(key, 0);
+    if (key[0] == '[' && (end = strchr(key, ']')) != NULL)
+    {
+      // Group header
+      end[1] = '\0';
+      line->Group = -1;
+      group = ini->Nb_lines;
+      line->Key = strdup(key);
+    }
+    else if ((end = strchr(key, '=')) != NULL && end != key)
+    {
+      // Option: the value is kept after the name, in the same allocation
+      *end = '\0';
+      line->Key = (char *)malloc(strlen(key) + strlen(end + 1) + 2);
+      if (line->Key != NULL)
+      {
+        strcpy(line->Key, key);
+        line->Value = strcpy(line->Key + (end - key) + 1, end + 1);
+      }
+    }
+    ini->Nb_lines++;
+  }
+  fclose(file);
+
+  // Fill the buckets from the end, so each one lists its lines in file order
+  for (index = 0; index < INI_HASH_SIZE; index++)
+    ini->Hash[index] = -1;
+  for (index = ini->Nb_lines - 1; index >= 0; index--)
+  {
+    T_INI_line * line = ini->Lines + index;
+
+    if (line->Key != NULL)
+    {
+      unsigned int bucket = INI_hash(line->Group < 0 ? NULL : ini->Lines[line->Group].Key, line->Key);
+      line->Hash_next = ini->Hash[bucket];
+      ini->Hash[bucket] = index;
+    }
+  }
+  return ini;
+}
+
+/**
+ * Free a .INI file read by Load_INI_file()
+ */
+void Free_INI_file(T_INI_file * ini)
+{
+  int index;
+
+  if (ini == NULL)
+    return;
+  for (index = 0; index < ini->Nb_lines; index++)
+  {
+    free(ini->Lines[index].Text);
+    free(ini->Lines[index].Key);
+  }
+  free(ini->Lines);
+  free(ini);
+}
+
+/**
+ * Find an option or a group header in a .INI file
+ *
+ * The names are compared without case.
+ *
+ * @param ini the file read by Load_INI_file()
+ * @param group the group of the option, "[GROUP]", or NULL to find a group header
+ * @param key the option name, or the group header "[GROUP]"
+ * @param occurrence 0 for the first line with this option, 1 for the second, etc.
+ * @return the line index
+ * @return -1 if the option is not found
+ */
+int Load_INI_find(const T_INI_file * ini, const char * group, const char * key, int occurrence)
+{
+  int index;
 
-    // On s'en fait une version en majuscule:
-    strcpy(upper_buffer,buffer);
-    Load_INI_clear_string(upper_buffer, 0);
+  for (index = ini->Hash[INI_hash(group, key)]; index >= 0; index = ini->Lines[index].Hash_next)
+  {
+    const T_INI_line * line = ini->Lines + index;
 
-    // On compare la chaîne avec le groupe recherché:
-    stop_seek=Load_INI_seek_pattern(upper_buffer,group_upper);
+    if (strcasecmp(line->Key, key) != 0)
+      continue;
+    if (group == NULL)
+    {
+      if (line->Group >= 0)
+        continue;
+    }
+    else if (line->Group < 0 || strcasecmp(ini->Lines[line->Group].Key, group) != 0)
+      continue;
+    if (occurrence-- == 0)
+      return index;
   }
-  while (!stop_seek);
+  return -1;
+}
 
-  free(upper_buffer);
-  free(group_upper);
+/**
+ * Check that a group is present
+ *
+ * @return 0 when the group is found
+ * @return @ref ERROR_INI_CORRUPTED if the group is not found
+ */
+static int Load_INI_reach_group(const T_INI_file * ini, const char * group)
+{
+  int index = Load_INI_find(ini, NULL, group, 0);
 
+  if (index < 0)
+  {
+    Line_number_in_INI_file = ini->Nb_lines;
+    return ERROR_INI_CORRUPTED;
+  }
+  Line_number_in_INI_file = index + 1;
   return 0;
 }
 
 ///
-/// Find the next string in the .INI file.
-/// @param file INI file currently opened
-/// @param buffer Current text buffer, preserved from one call to the next
+/// Read a string option in the .INI file.
+/// @param ini the file read by Load_INI_file()
+/// @param group the group of the option
 /// @param option_name string to search
+/// @param occurrence 0 for the first line with this option, 1 for the second, etc.
 /// @param return_code the found value will be copied there. (must be allocaed)
 /// @param raw_text Boolean: true to return the raw value (up to end-of-line), false to strip comments.
 /// @return 0 when OK
 /// @return @ref ERROR_INI_CORRUPTED if the option is not found
-static int Load_INI_get_string(FILE * file,char * buffer,const char * option_name,char * return_code, byte raw_text)
+static int Load_INI_get_string(const T_INI_file * ini,const char * group,const char * option_name,int occurrence,char * return_code, byte raw_text)
 {
-  int    stop_seek;
-  char * option_upper;
-  char * upper_buffer;
-  int    buffer_index;
+  char upper_buffer[1024];
+  int  index;
 
-  // On alloue les zones de mémoire:
-  option_upper=(char *)malloc(1024);
-  upper_buffer=(char *)malloc(1024);
-
-  // On commence par se faire une version majuscule de l'option à rechercher:
-  strcpy(option_upper,option_name);
-  Load_INI_clear_string(option_upper, 0);
-
-  stop_seek=0;
-  do
+  index = Load_INI_find(ini, group, option_name, occurrence);
+  if (index < 0)
   {
-    // On lit une ligne dans le fichier:
-    if (fgets(buffer,1024,file)==NULL)
-    {
-      free(upper_buffer);
-      free(option_upper);
-      return ERROR_INI_CORRUPTED;
-    }
-
-    Line_number_in_INI_file++;
-
-    // On s'en fait une version en majuscule:
-    strcpy(upper_buffer,buffer);
-    Load_INI_clear_string(upper_buffer, raw_text);
-
-    // On compare la chaîne avec l'option recherchée:
-    stop_seek=Load_INI_seek_pattern(upper_buffer,option_upper);
-
-    // Si on l'a trouvée:
-    if (stop_seek)
-    {
-      // On se positionne juste après la chaîne "="
-      buffer_index=Load_INI_seek_pattern(upper_buffer,"=");
-
-      strcpy(return_code, upper_buffer + buffer_index);
-    }
+    Line_number_in_INI_file = ini->Nb_lines;
+    return ERROR_INI_CORRUPTED;
   }
-  while (!stop_seek);
+  Line_number_in_INI_file = index + 1;
 
-  free(upper_buffer);
-  free(option_upper);
+  if (!raw_text)
+  {
+    strcpy(return_code, ini->Lines[index].Value);
+    return 0;
+  }
+  // Clean the line again, this time keeping the comments
+  strcpy(upper_buffer, ini->Lines[index].Text);
+  Load_INI_clear_string(upper_buffer, 1);
+  strcpy(return_code, upper_buffer + Load_INI_seek_pattern(upper_buffer, "="));
 
   return 0;
 }
@@ -388,91 +516,52 @@ static int Load_INI_get_value(const char * str,int * index,int * value)
  *
  * The values are comma separated
  *
- * @param file handle to gfx2.ini
- * @param buffer Current text buffer, preserved from one call to the next
+ * @param ini gfx2.ini, read by Load_INI_file()
+ * @param group the group of the option
  * @param option_name name of the option to read
  * @param nb_expected_values number of values to read from the line
  * @param[out] values the values will be put there
  * @return 0 when OK
  * @return @ref ERROR_INI_CORRUPTED if no value was found, or not enough
  */
-static int Load_INI_get_values(FILE * file,char * buffer,const char * option_name,int nb_expected_values,int * values)
+static int Load_INI_get_values(const T_INI_file * ini,const char * group,const char * option_name,int nb_expected_values,int * values)
 {
-  int    stop_seek;
-  char * option_upper;
-  char * upper_buffer;
-  int    buffer_index;
-  int    nb_values;
-
-  // On alloue les zones de mémoire:
-  option_upper=(char *)malloc(1024);
-  upper_buffer=(char *)malloc(1024);
-
-  // On commence par se faire une version majuscule de l'option à rechercher:
-  strcpy(option_upper,option_name);
-  Load_INI_clear_string(option_upper, 0);
-
-  stop_seek=0;
-  do
-  {
-    // On lit une ligne dans le fichier:
-    if (fgets(buffer,1024,file)==0)
-    {
-      free(upper_buffer);
-      free(option_upper);
-      return ERROR_INI_CORRUPTED;
-    }
+  const char * value;
+  int  buffer_index;
+  int  nb_values;
+  int  index;
 
-    Line_number_in_INI_file++;
+  index = Load_INI_find(ini, group, option_name, 0);
+  if (index < 0)
+  {
+    Line_number_in_INI_file = ini->Nb_lines;
+    return ERROR_INI_CORRUPTED;
+  }
+  Line_number_in_INI_file = index + 1;
+  value = ini->Lines[index].Value;
 
-    // On s'en fait une version en majuscule:
-    strcpy(upper_buffer,buffer);
-    Load_INI_clear_string(upper_buffer, 0);
+  nb_values=0;
+  buffer_index=0;
 
-    // On compare la chaîne avec l'option recherchée:
-    stop_seek=Load_INI_seek_pattern(upper_buffer,option_upper);
+  // Tant qu'on a pas atteint la fin de la ligne
+  while (value[buffer_index]!='\0')
+  {
+    if (Load_INI_get_value(value,&buffer_index,values+nb_values))
+      return ERROR_INI_CORRUPTED;
 
-    // Si on l'a trouvée:
-    if (stop_seek)
+    if ( ((++nb_values) == nb_expected_values) &&
+         (value[buffer_index]!='\0') )
     {
-      nb_values=0;
-
-      // On se positionne juste après la chaîne "="
-      buffer_index=Load_INI_seek_pattern(upper_buffer,"=");
-
-      // Tant qu'on a pas atteint la fin de la ligne
-      while (upper_buffer[buffer_index]!='\0')
-      {
-        if (Load_INI_get_value(upper_buffer,&buffer_index,values+nb_values))
-        {
-          free(upper_buffer);
-          free(option_upper);
-          return ERROR_INI_CORRUPTED;
-        }
-
-        if ( ((++nb_values) == nb_expected_values) &&
-             (upper_buffer[buffer_index]!='\0') )
-        {
-          // Too many values !
-          free(upper_buffer);
-          free(option_upper);
-          return ERROR_INI_CORRUPTED;
-        }
-      }
-
-      if (nb_values<nb_expected_values)
-      {
-        // Not enough values !
-        free(upper_buffer);
-        free(option_upper);
-        return ERROR_INI_CORRUPTED;
-      }
+      // Too many values !
+      return ERROR_INI_CORRUPTED;
     }
   }
-  while (!stop_seek);
 
-  free(upper_buffer);
-  free(option_upper);
+  if (nb_values<nb_expected_values)
+  {
+    // Not enough values !
+    return ERROR_INI_CORRUPTED;
+  }
 
   return 0;
 }
@@ -487,8 +576,8 @@ static int Load_INI_get_values(FILE * file,char * buffer,const char * option_nam
  */
 int Load_INI(T_Config * conf)
 {
-  FILE * file;
-  char * buffer;
+  T_INI_file * ini;
+  const char * group;
   int    values[3];
   int    index;
   char * filename;
@@ -503,64 +592,62 @@ int Load_INI(T_Config * conf)
   conf->Stylus_mode = 0;
 #endif
 
-  // allocate buffer
-  buffer = (char *)GFX2_malloc(1024);
-
   filename = Filepath_append_to_dir(Config_directory, INI_FILENAME);
-  file = fopen(filename, "r");
-  if (file == NULL)
+  ini = Load_INI_file(filename);
+  if (ini == NULL)
   {
     free(filename);
     // Si le fichier ini est absent on le relit depuis gfx2def.ini
     filename = Filepath_append_to_dir(Data_directory, INIDEF_FILENAME);
-    file = fopen(filename, "r");
-    if (file == NULL)
+    ini = Load_INI_file(filename);
+    if (ini == NULL)
     {
       GFX2_Log(GFX2_ERROR, "Load_INI() cannot open %s\n", filename);
       free(filename);
-      free(buffer);
       return ERROR_INI_MISSING;
     }
   }
   GFX2_Log(GFX2_DEBUG, "Load_INI() loading %s\n", filename);
   free(filename);
   
-  if ((return_code=Load_INI_reach_group(file,buffer,"[MOUSE]")))
+  group = "[MOUSE]";
+  if ((return_code=Load_INI_reach_group(ini,group)))
     goto Erreur_Retour;
 
-  if ((return_code=Load_INI_get_values (file,buffer,"X_sensitivity",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"X_sensitivity",1,values)))
     goto Erreur_Retour;
   if ((values[0]<1) || (values[0]>4))
     conf->Mouse_sensitivity_index_x=1;
   else
     conf->Mouse_sensitivity_index_x=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Y_sensitivity",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Y_sensitivity",1,values)))
     goto Erreur_Retour;
   if ((values[0]<1) || (values[0]>4))
     conf->Mouse_sensitivity_index_y=1;
   else
     conf->Mouse_sensitivity_index_y=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"X_correction_factor",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"X_correction_factor",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>4))
     goto Erreur_ERREUR_INI_CORROMPU;
   // Deprecated setting, unused
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Y_correction_factor",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Y_correction_factor",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>4))
     goto Erreur_ERREUR_INI_CORROMPU;
   // Deprecated setting, unused
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Cursor_aspect",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Cursor_aspect",1,values)))
     goto Erreur_Retour;
   if ((values[0]<1) || (values[0]>3))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Cursor=values[0]-1;
 
-  if ((return_code=Load_INI_reach_group(file,buffer,"[MENU]")))
+  group = "[MENU]";
+  if ((return_code=Load_INI_reach_group(ini,group)))
     goto Erreur_Retour;
 
   conf->Fav_menu_colors[0].R=0;
@@ -570,7 +657,7 @@ int Load_INI(T_Config * conf)
   conf->Fav_menu_colors[3].G=255;
   conf->Fav_menu_colors[3].B=255;
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Light_color",3,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Light_color",3,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>63))
     goto Erreur_ERREUR_INI_CORROMPU;
@@ -582,7 +669,7 @@ int Load_INI(T_Config * conf)
   conf->Fav_menu_colors[2].G=(values[1]<<2)|(values[1]>>4);
   conf->Fav_menu_colors[2].B=(values[2]<<2)|(values[2]>>4);
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Dark_color",3,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Dark_color",3,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>63))
     goto Erreur_ERREUR_INI_CORROMPU;
@@ -594,180 +681,183 @@ int Load_INI(T_Config * conf)
   conf->Fav_menu_colors[1].G=(values[1]<<2)|(values[1]>>4);
   conf->Fav_menu_colors[1].B=(values[2]<<2)|(values[2]>>4);
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Menu_ratio",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Menu_ratio",1,values)))
     goto Erreur_Retour;
   if ((values[0]<-4) || (values[0]>2))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Ratio=values[0];
 
-  if ((return_code=Load_INI_reach_group(file,buffer,"[FILE_SELECTOR]")))
+  group = "[FILE_SELECTOR]";
+  if ((return_code=Load_INI_reach_group(ini,group)))
     goto Erreur_Retour;
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Show_hidden_files",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Show_hidden_files",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Show_hidden_files=values[0]?1:0;
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Show_hidden_directories",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Show_hidden_directories",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Show_hidden_directories=values[0]?1:0;
 
-/*  if ((return_code=Load_INI_get_values (file,buffer,"Show_system_directories",1,values)))
+/*  if ((return_code=Load_INI_get_values (ini,group,"Show_system_directories",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Show_system_directories=values[0]?1:0;
 */
-  if ((return_code=Load_INI_get_values (file,buffer,"Preview_delay",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Preview_delay",1,values)))
     goto Erreur_Retour;
   if ((values[0]<1) || (values[0]>256))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Timer_delay=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Maximize_preview",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Maximize_preview",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Maximize_preview=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Find_file_fast",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Find_file_fast",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>2))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Find_file_fast=values[0];
 
 
-  if ((return_code=Load_INI_reach_group(file,buffer,"[LOADING]")))
+  group = "[LOADING]";
+  if ((return_code=Load_INI_reach_group(ini,group)))
     goto Erreur_Retour;
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Auto_set_resolution",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Auto_set_resolution",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Auto_set_res=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Set_resolution_according_to",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Set_resolution_according_to",1,values)))
     goto Erreur_Retour;
   if ((values[0]<1) || (values[0]>2))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Set_resolution_according_to=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Clear_palette",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Clear_palette",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Clear_palette=values[0];
 
 
-  if ((return_code=Load_INI_reach_group(file,buffer,"[MISCELLANEOUS]")))
+  group = "[MISCELLANEOUS]";
+  if ((return_code=Load_INI_reach_group(ini,group)))
     goto Erreur_Retour;
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Draw_limits",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Draw_limits",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Display_image_limits=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Adjust_brush_pick",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Adjust_brush_pick",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Adjust_brush_pick=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Coordinates",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Coordinates",1,values)))
     goto Erreur_Retour;
   if ((values[0]<1) || (values[0]>2))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Coords_rel=2-values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Backup",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Backup",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Backup=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Undo_pages",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Undo_pages",1,values)))
     goto Erreur_Retour;
   if ((values[0]<1) || (values[0]>99))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Max_undo_pages=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Gauges_scrolling_speed_Left",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Gauges_scrolling_speed_Left",1,values)))
     goto Erreur_Retour;
   if ((values[0]<1) || (values[0]>255))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Delay_left_click_on_slider=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Gauges_scrolling_speed_Right",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Gauges_scrolling_speed_Right",1,values)))
     goto Erreur_Retour;
   if ((values[0]<1) || (values[0]>255))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Delay_right_click_on_slider=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Auto_save",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Auto_save",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Auto_save=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Vertices_per_polygon",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Vertices_per_polygon",1,values)))
     goto Erreur_Retour;
   if ((values[0]<2) || (values[0]>16384))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Nb_max_vertices_per_polygon=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Fast_zoom",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Fast_zoom",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Fast_zoom=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Separate_colors",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Separate_colors",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Separate_colors=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"FX_feedback",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"FX_feedback",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->FX_Feedback=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Safety_colors",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Safety_colors",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Safety_colors=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Opening_message",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Opening_message",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Opening_message=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Clear_with_stencil",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Clear_with_stencil",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Clear_with_stencil=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Auto_discontinuous",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Auto_discontinuous",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Auto_discontinuous=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Save_screen_size_in_GIF",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Save_screen_size_in_GIF",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
   conf->Screen_size_in_GIF=values[0];
 
-  if ((return_code=Load_INI_get_values (file,buffer,"Auto_nb_colors_used",1,values)))
+  if ((return_code=Load_INI_get_values (ini,group,"Auto_nb_colors_used",1,values)))
     goto Erreur_Retour;
   if ((values[0]<0) || (values[0]>1))
     goto Erreur_ERREUR_INI_CORROMPU;
@@ -775,7 +865,7 @@ int Load_INI(T_Config * conf)
 
   // Optionnel, le mode video par défaut (à partir de beta 97.0%)
   conf->Default_resolution=0;
-  if (!Load_INI_get_string (file,buffer,"Default_video_mode",value_label, 0))
+  if (!Load_INI_get_string (ini,group,"Default_video_mode",0,value_label, 0))
   {
     int mode = Convert_videomode_arg(value_label);
     if (mode>=0)
@@ -788,7 +878,7 @@ int Load_INI(T_Config * conf)
   {
     Video_mode[0].Width = 640;
     Video_mode[0].Height = 480;
-    if (!Load_INI_get_values (file,buffer,"Default_window_size",2,values))
+    if (!Load_INI_get_values (ini,group,"Default_window_size",2,values))
     {
       if ((values[0]>=320))
         Default_window_width = Video_mode[0].Width = values[0];
@@ -799,7 +889,7 @@ int Load_INI(T_Config * conf)
 
   conf->Mouse_merge_movement=100;
   // Optionnel, paramètre pour grouper les mouvements souris (>98.0%)
-  if (!Load_INI_get_values (file,buffer,"Merge_movement",1,values))
+  if (!Load_INI_get_values (ini,group,"Merge_movement",1,values))
   {
     if ((values[0]<0) || (values[0]>1000))
       goto Erreur_ERREUR_INI_CORROMPU;
@@ -808,7 +898,7 @@ int Load_INI(T_Config * conf)
 
   conf->Palette_cells_X=16;
   // Optionnel, nombre de colonnes dans la palette (>98.0%)
-  if (!Load_INI_get_values (file,buffer,"Palette_cells_X",1,values))
+  if (!Load_INI_get_values (ini,group,"Palette_cells_X",1,values))
   {
     if ((values[0]<1) || (values[0]>256))
       goto Erreur_ERREUR_INI_CORROMPU;
@@ -816,7 +906,7 @@ int Load_INI(T_Config * conf)
   }
   conf->Palette_cells_Y=4;
   // Optionnel, nombre de lignes dans la palette (>98.0%)
-  if (!Load_INI_get_values (file,buffer,"Palette_cells_Y",1,values))
+  if (!Load_INI_get_values (ini,group,"Palette_cells_Y",1,values))
   {
     if (values[0]<1 || values[0]>16)
       goto Erreur_ERREUR_INI_CORROMPU;
@@ -830,7 +920,7 @@ int Load_INI(T_Config * conf)
   }
   for (index=0;index<NB_BOOKMARKS;index++)
   {
-    if (!Load_INI_get_string (file,buffer,"Bookmark_label",value_label, 1))
+    if (!Load_INI_get_string (ini,group,"Bookmark_label",index,value_label, 1))
     {
       size_t size = strlen(value_label);
       if (size!=0)
@@ -846,7 +936,7 @@ int Load_INI(T_Config * conf)
     }
     else
       break;
-    if (!Load_INI_get_string (file,buffer,"Bookmark_directory",value_label, 1))
+    if (!Load_INI_get_string (ini,group,"Bookmark_directory",index,value_label, 1))
     {
       size_t size = strlen(value_label);
       if (size!=0)
@@ -860,7 +950,7 @@ int Load_INI(T_Config * conf)
   }
   conf->Palette_vertical=1;
   // Optional, vertical palette option (>98.0%)
-  if (!Load_INI_get_values (file,buffer,"Palette_vertical",1,values))
+  if (!Load_INI_get_values (ini,group,"Palette_vertical",1,values))
   {
     if ((values[0]<0) || (values[0]>1))
       goto Erreur_ERREUR_INI_CORROMPU;
@@ -870,7 +960,7 @@ int Load_INI(T_Config * conf)
   // Optional, the window position (>98.0%)
   conf->Window_pos_x=9999;
   conf->Window_pos_y=9999;
-  if (!Load_INI_get_values (file,buffer,"Window_position",2,values))
+  if (!Load_INI_get_values (ini,group,"Window_position",2,values))
   {
     conf->Window_pos_x = values[0];
     conf->Window_pos_y = values[1];
@@ -878,7 +968,7 @@ int Load_INI(T_Config * conf)
   
   conf->Double_click_speed=500;
   // Optional, speed of double-click (>2.0)
-  if (!Load_INI_get_values (file,buffer,"Double_click_speed",1,values))
+  if (!Load_INI_get_values (ini,group,"Double_click_speed",1,values))
   {
     if ((values[0]>0) || (values[0]<=2000))
       conf->Double_click_speed=values[0];
@@ -886,14 +976,14 @@ int Load_INI(T_Config * conf)
 
   conf->Double_key_speed=500;
   // Optional, speed of double-keypress (>2.0)
-  if (!Load_INI_get_values (file,buffer,"Double_key_speed",1,values))
+  if (!Load_INI_get_values (ini,group,"Double_key_speed",1,values))
   {
     if ((values[0]>0) || (values[0]<=2000))
       conf->Double_key_speed=values[0];
   }
 
   // Optional, name of skin file. (>2.0)
-  if(!Load_INI_get_string(file,buffer,"Skin_file",value_label,1))
+  if(!Load_INI_get_string(ini,group,"Skin_file",0,value_label,1))
   {
     conf->Skin_file = strdup(value_label);
   }
@@ -901,13 +991,13 @@ int Load_INI(T_Config * conf)
     conf->Skin_file = strdup(DEFAULT_SKIN_FILENAME);
 
   // Optional, name of font file. (>2.0)
-  if(!Load_INI_get_string(file,buffer,"Font_file",value_label,1))
+  if(!Load_INI_get_string(ini,group,"Font_file",0,value_label,1))
     conf->Font_file = strdup(value_label);
   else
     conf->Font_file = strdup(DEFAULT_FONT_FILENAME);
 
   // Optional, "fake hardware zoom" factor (>2.1)
-  if (!Load_INI_get_values (file, buffer,"Pixel_ratio",1,values))
+  if (!Load_INI_get_values (ini, group,"Pixel_ratio",1,values))
   {
     Pixel_ratio = values[0];
     switch(Pixel_ratio) {
@@ -951,7 +1041,7 @@ int Load_INI(T_Config * conf)
   }
   
   // Optional, Menu bars visibility (> 2.1)
-  if (!Load_INI_get_values (file, buffer,"Menubars_visible",1,values))
+  if (!Load_INI_get_values (ini, group,"Menubars_visible",1,values))
   {
     byte anim_visible = (values[0] & 2)!=0;
     byte tools_visible = (values[0] & 4)!=0;
@@ -964,21 +1054,21 @@ int Load_INI(T_Config * conf)
   
   conf->Right_click_colorpick=0;
   // Optional, right mouse button to pick colors (>=2.3)
-  if (!Load_INI_get_values (file,buffer,"Right_click_colorpick",1,values))
+  if (!Load_INI_get_values (ini,group,"Right_click_colorpick",1,values))
   {
     conf->Right_click_colorpick=(values[0]!=0);
   }
   
   conf->Sync_views=1;
   // Optional, synced view of main and spare (>=2.3)
-  if (!Load_INI_get_values (file,buffer,"Sync_views",1,values))
+  if (!Load_INI_get_values (ini,group,"Sync_views",1,values))
   {
     conf->Sync_views=(values[0]!=0);
   }
   
   conf->Swap_buttons=0;
   // Optional, key for swap buttons (>=2.3)
-  if (!Load_INI_get_values (file,buffer,"Swap_buttons",1,values))
+  if (!Load_INI_get_values (ini,group,"Swap_buttons",1,values))
   {
     switch(values[0])
     {
@@ -994,7 +1084,7 @@ int Load_INI(T_Config * conf)
   // Optional, Location of last directory used for Lua scripts browsing (>=2.3)
   free(conf->Scripts_directory);
   conf->Scripts_directory = NULL;
-  if (!Load_INI_get_string (file,buffer,"Scripts_directory",value_label, 1))
+  if (!Load_INI_get_string (ini,group,"Scripts_directory",0,value_label, 1))
   {
     if (value_label[0] != '\0')
       conf->Scripts_directory = strdup(value_label);
@@ -1009,35 +1099,35 @@ int Load_INI(T_Config * conf)
   
   conf->Allow_multi_shortcuts=0;
   // Optional, allow or disallow multiple shortcuts on same key (>=2.3)
-  if (!Load_INI_get_values (file,buffer,"Allow_multi_shortcuts",1,values))
+  if (!Load_INI_get_values (ini,group,"Allow_multi_shortcuts",1,values))
   {
     conf->Allow_multi_shortcuts=(values[0]!=0);
   }
   
   conf->Tilemap_allow_flipped_x=0;
   // Optional, makes tilemap effect detect x-flipped tiles (>=2.4)
-  if (!Load_INI_get_values (file,buffer,"Tilemap_detect_mirrored_x",1,values))
+  if (!Load_INI_get_values (ini,group,"Tilemap_detect_mirrored_x",1,values))
   {
     conf->Tilemap_allow_flipped_x=(values[0]!=0);
   }
   
   conf->Tilemap_allow_flipped_y=0;
   // Optional, makes tilemap effect detect y-flipped tiles (>=2.4)
-  if (!Load_INI_get_values (file,buffer,"Tilemap_detect_mirrored_y",1,values))
+  if (!Load_INI_get_values (ini,group,"Tilemap_detect_mirrored_y",1,values))
   {
     conf->Tilemap_allow_flipped_y=(values[0]!=0);
   }
   
   conf->Tilemap_show_count=0;
   // Optional, makes tilemap effect display tile count (>=2.4)
-  if (!Load_INI_get_values (file,buffer,"Tilemap_count",1,values))
+  if (!Load_INI_get_values (ini,group,"Tilemap_count",1,values))
   {
     conf->Tilemap_show_count=(values[0]!=0);
   }
   
   conf->Use_virtual_keyboard=0;
   // Optional, enables virtual keyboard (>=2.4)
-  if (!Load_INI_get_values (file,buffer,"Use_virtual_keyboard",1,values))
+  if (!Load_INI_get_values (ini,group,"Use_virtual_keyboard",1,values))
   {
     if (values[0]>=0 && values[0]<=2)
       conf->Use_virtual_keyboard=values[0];
@@ -1045,35 +1135,47 @@ int Load_INI(T_Config * conf)
 
   conf->Default_mode_layers=0;
   // Optional, remembers if the user last chose layers or anim (>=2.4)
-  if (!Load_INI_get_values (file,buffer,"Default_mode_layers",1,values))
+  if (!Load_INI_get_values (ini,group,"Default_mode_layers",1,values))
   {
     conf->Default_mode_layers=(values[0]!=0);
   }
 
   conf->MOTO_gamma=28;
   // Optional, gamma value used for palette of load/save Thomson MO/TO pictures (>=2.6)
-  if (!Load_INI_get_values (file,buffer,"MOTO_gamma",1,values))
+  if (!Load_INI_get_values (ini,group,"MOTO_gamma",1,values))
   {
     conf->MOTO_gamma=(byte)values[0];
   }
+
+  conf->Max_undo_memory=0;
+  // Optional, memory budget for Undo/Redo, replacing Undo_pages (>=2.9)
+  if (!Load_INI_get_values (ini,group,"Undo_memory",1,values))
+  {
+    if (values[0]>=0 && values[0]<=65535)
+      conf->Max_undo_memory=(word)values[0];
+  }
+
+  conf->Max_undo_disk=0;
+  // Optional, disk space for the Undo/Redo steps over Undo_memory (>=2.9)
+  if (!Load_INI_get_values (ini,group,"Undo_disk",1,values))
+  {
+    if (values[0]>=0 && values[0]<=2047)
+      conf->Max_undo_disk=(word)values[0];
+  }
   
   // Insert new values here
 
-  fclose(file);
-
-  free(buffer);
+  Free_INI_file(ini);
   return 0;
 
   // Gestion des erreurs:
 
   Erreur_Retour:
-    fclose(file);
-    free(buffer);
+    Free_INI_file(ini);
     return return_code;
 
   Erreur_ERREUR_INI_CORROMPU:
 
-    fclose(file);
-    free(buffer);
+    Free_INI_file(ini);
     return ERROR_INI_CORRUPTED;
 }
@@ -24,6 +24,30 @@
 /// Reading settings in gfx2.ini
 //////////////////////////////////////////////////////////////////////////////
 
+/// Number of hash buckets in a ::T_INI_file
+#define INI_HASH_SIZE 256
+
+/// One line of a .INI file
+typedef struct
+{
+  char * Text;    ///< The line as read from the file, with its end of line
+  char * Key;     ///< Upper case option name, or "[GROUP]" header. NULL for other lines
+  char * Value;   ///< Option value, without comments. NULL if the line is not an option
+  int Group;      ///< Index of the line of the group header, -1 for group headers and lines before them
+  int Hash_next;  ///< Next line in the same hash bucket, -1 for the last one
+} T_INI_line;
+
+/// A .INI file read in memory, with its options indexed by group and name
+typedef struct
+{
+  T_INI_line * Lines;       ///< All lines of the file
+  int Nb_lines;             ///< Number of lines
+  int Hash[INI_HASH_SIZE];  ///< First line of each hash bucket, -1 when empty
+} T_INI_file;
+
 int Load_INI(T_Config * conf);
+T_INI_file * Load_INI_file(const char * filename);
+void Free_INI_file(T_INI_file * ini);
+int Load_INI_find(const T_INI_file * ini, const char * group, const char * key, int occurrence);
 int Load_INI_seek_pattern(const char * buffer, const char * pattern);
 void Load_INI_clear_string(char * str, byte keep_comments);
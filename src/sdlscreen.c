@@ -191,46 +191,74 @@ void GFX2_Set_mode(int *width, int *height, int fullscreen)
 }
 
 #if defined(USE_SDL2)
+/// ARGB8888 value of each color of ::Screen_SDL, see GFX2_SetPalette()
+static dword Screen_ARGB_palette[256];
+
+/// Convert a line of 8-bit pixels to ARGB8888 through ::Screen_ARGB_palette
+static void Palette_expand_line(dword * dest, const byte * source, int width)
+{
+  const dword * lut = Screen_ARGB_palette;
+
+  while (width >= 4)
+  {
+    dest[0] = lut[source[0]];
+    dest[1] = lut[source[1]];
+    dest[2] = lut[source[2]];
+    dest[3] = lut[source[3]];
+    dest += 4;
+    source += 4;
+    width -= 4;
+  }
+  while (width-- > 0)
+    *dest++ = lut[*source++];
+}
+
+/// Upload a rectangle of ::Screen_SDL to the texture, (0,0,0,0) for the whole screen
 static void GFX2_UpdateRect(int x, int y, int width, int height)
 {
   byte * pixels;
   int pitch;
   int line;
-  static SDL_Surface *RGBcopy = NULL;
-  SDL_Rect source_rect;
+  SDL_Rect rect;
 
-  source_rect.x = x;
-  source_rect.y = y;
-  if (width == 0 && height == 0) {
-    source_rect.w = Screen_SDL->w;
-    source_rect.h = Screen_SDL->h;
-  } else {
-    source_rect.w = width;
-    source_rect.h = height;
+  if (width == 0 && height == 0)
+  {
+    x = y = 0;
+    width = Screen_SDL->w;
+    height = Screen_SDL->h;
   }
-
-  if (RGBcopy != NULL && (Screen_SDL->w > RGBcopy->w || Screen_SDL->h > RGBcopy->h))
+  if (x < 0)
   {
-    SDL_FreeSurface(RGBcopy);
-    RGBcopy = NULL;
+    width += x;
+    x = 0;
   }
-
-  if (RGBcopy == NULL)
+  if (y < 0)
   {
-    RGBcopy = SDL_CreateRGBSurface(0,
-    Screen_SDL->w, Screen_SDL->h,
-    32, 0, 0, 0, 0);
+    height += y;
+    y = 0;
   }
-  // conversion ARGB
-  SDL_BlitSurface(Screen_SDL, &source_rect, RGBcopy, &source_rect);
-  // upload texture
-  SDL_LockTexture(Texture_SDL, &source_rect, (void **)(&pixels), &pitch );
-  for (line = 0; line < source_rect.h; line++)
+  if (x + width > Screen_SDL->w)
+    width = Screen_SDL->w - x;
+  if (y + height > Screen_SDL->h)
+    height = Screen_SDL->h - y;
+  if (width <= 0 || height <= 0)
+    return;
+
+  rect.x = x;
+  rect.y = y;
+  rect.w = width;
+  rect.h = height;
+  // 8-bit => ARGB conversion straight into the texture
+  if (SDL_LockTexture(Texture_SDL, &rect, (void **)(&pixels), &pitch) < 0)
   {
-     memcpy(pixels + line * pitch, (const byte *)RGBcopy->pixels + source_rect.x * 4 + (source_rect.y+line)* RGBcopy->pitch, source_rect.w * 4 );
+    GFX2_Log(GFX2_WARNING, "SDL_LockTexture failed: %s\n", SDL_GetError());
+    return;
   }
+  for (line = 0; line < height; line++)
+    Palette_expand_line((dword *)(pixels + line * pitch),
+                        (const byte *)Screen_SDL->pixels + x + (y + line) * Screen_SDL->pitch,
+                        width);
   SDL_UnlockTexture(Texture_SDL);
-  //SDL_RenderCopy(Renderer_SDL, Texture_SDL, &source_rect, &source_rect);
 }
 
 void GFX2_UpdateScreen(void)
@@ -241,10 +269,19 @@ void GFX2_UpdateScreen(void)
 #endif
 
 #if (UPDATE_METHOD == UPDATE_METHOD_CUMULATED)
-short Min_X=0;
-short Min_Y=0;
-short Max_X=10000;
-short Max_Y=10000;
+/// Maximum number of separate rectangles updated by Flush_update()
+#define MAX_DIRTY_RECTS 16
+
+/// A modified part of the screen, in screen pixels (before Pixel_width/Pixel_height)
+typedef struct
+{
+  short x1, y1; ///< top-left corner
+  short x2, y2; ///< bottom-right corner, excluded
+} T_Dirty_rect;
+
+/// Parts of the screen modified since the last Flush_update(). Initially the whole screen.
+static T_Dirty_rect Dirty_rects[MAX_DIRTY_RECTS] = { { 0, 0, 10000, 10000 } };
+static int Dirty_rects_count = 1;
 short Status_line_dirty_begin=0;
 short Status_line_dirty_end=0;
 #endif
@@ -253,6 +290,61 @@ short Status_line_dirty_end=0;
   int update_is_required=0;
 #endif
 
+#if (UPDATE_METHOD == UPDATE_METHOD_CUMULATED)
+static long Dirty_rect_area(const T_Dirty_rect * rect)
+{
+  return (long)(rect->x2 - rect->x1) * (rect->y2 - rect->y1);
+}
+
+static void Dirty_rect_union(const T_Dirty_rect * a, const T_Dirty_rect * b, T_Dirty_rect * result)
+{
+  result->x1 = Min(a->x1, b->x1);
+  result->y1 = Min(a->y1, b->y1);
+  result->x2 = Max(a->x2, b->x2);
+  result->y2 = Max(a->y2, b->y2);
+}
+
+///
+/// Add a rectangle to ::Dirty_rects.
+///
+/// It is merged with a rectangle of the list when their bounding box is not
+/// larger than both of them, and with the one that grows the least when the
+/// list is full. A merged rectangle is added again, as it can now overlap
+/// other ones.
+static void Add_dirty_rect(T_Dirty_rect rect)
+{
+  int i;
+  int best;
+  long best_growth;
+  T_Dirty_rect merged;
+
+  for (;;)
+  {
+    best = -1;
+    best_growth = 0;
+    for (i = 0; i < Dirty_rects_count; i++)
+    {
+      long growth;
+
+      Dirty_rect_union(&Dirty_rects[i], &rect, &merged);
+      growth = Dirty_rect_area(&merged) - Dirty_rect_area(&Dirty_rects[i]) - Dirty_rect_area(&rect);
+      if (growth <= 0 || (Dirty_rects_count == MAX_DIRTY_RECTS && (best < 0 || growth < best_growth)))
+      {
+        best = i;
+        best_growth = growth;
+        if (growth <= 0)
+          break;
+      }
+    }
+    if (best < 0)
+      break;
+    Dirty_rect_union(&Dirty_rects[best], &rect, &rect);
+    Dirty_rects[best] = Dirty_rects[--Dirty_rects_count];
+  }
+  Dirty_rects[Dirty_rects_count++] = rect;
+}
+#endif
+
 void Flush_update(void)
 {
 #if (UPDATE_METHOD == UPDATE_METHOD_FULL_PAGE)
@@ -270,25 +362,24 @@ void Flush_update(void)
   }
 #endif
   #if (UPDATE_METHOD == UPDATE_METHOD_CUMULATED)
-  if (Min_X>=Max_X || Min_Y>=Max_Y)
-  {
-    ; // Nothing to do
-  }
-  else
+  int i;
+
+  for (i = 0; i < Dirty_rects_count; i++)
   {
-    if (Min_X<0)
-      Min_X=0;
-    if (Min_Y<0)
-      Min_Y=0;
+    short x1 = Max(Dirty_rects[i].x1, 0);
+    short y1 = Max(Dirty_rects[i].y1, 0);
+    short x2 = Min(Dirty_rects[i].x2, Screen_width);
+    short y2 = Min(Dirty_rects[i].y2, Screen_height);
+
+    if (x1 >= x2 || y1 >= y2)
+      continue; // Nothing to do
 #if defined(USE_SDL)
-    SDL_UpdateRect(Screen_SDL, Min_X*Pixel_width, Min_Y*Pixel_height, Min(Screen_width-Min_X, Max_X-Min_X)*Pixel_width, Min(Screen_height-Min_Y, Max_Y-Min_Y)*Pixel_height);
+    SDL_UpdateRect(Screen_SDL, x1*Pixel_width, y1*Pixel_height, (x2-x1)*Pixel_width, (y2-y1)*Pixel_height);
 #else
-    GFX2_UpdateRect(Min_X*Pixel_width, Min_Y*Pixel_height, Min(Screen_width-Min_X, Max_X-Min_X)*Pixel_width, Min(Screen_height-Min_Y, Max_Y-Min_Y)*Pixel_height);
+    GFX2_UpdateRect(x1*Pixel_width, y1*Pixel_height, (x2-x1)*Pixel_width, (y2-y1)*Pixel_height);
 #endif
-
-    Min_X=Min_Y=10000;
-    Max_X=Max_Y=0;
   }
+  Dirty_rects_count = 0;
   if (Status_line_dirty_end)
   {
 #if defined(USE_SDL)
@@ -317,19 +408,19 @@ void Update_rect(short x, short y, unsigned short width, unsigned short height)
   #if (UPDATE_METHOD == UPDATE_METHOD_CUMULATED)
   if (width==0 || height==0)
   {
-    Min_X=Min_Y=0;
-    Max_X=Max_Y=10000;
+    Dirty_rects[0].x1 = Dirty_rects[0].y1 = 0;
+    Dirty_rects[0].x2 = Dirty_rects[0].y2 = 10000;
+    Dirty_rects_count = 1;
   }
   else
   {
-    if (x < Min_X)
-      Min_X = x;
-    if (y < Min_Y)
-      Min_Y = y;
-    if (x+width>Max_X)
-      Max_X=x+width;
-    if (y+height>Max_Y)
-      Max_Y=y+height;
+    T_Dirty_rect rect;
+
+    rect.x1 = x;
+    rect.y1 = y;
+    rect.x2 = Min(x + width, 10000);
+    rect.y2 = Min(y + height, 10000);
+    Add_dirty_rect(rect);
   }
   #endif
 
@@ -472,6 +563,66 @@ void Get_SDL_Palette(const SDL_Palette * sdl_palette, T_Palette palette)
 
 }
 
+#if defined(USE_SDL2)
+///
+/// Mark for update the parts of the screen that use some colors.
+///
+/// Consecutive lines holding such colors are grouped in a rectangle which
+/// spans from their leftmost to their rightmost pixel of these colors.
+/// This is used when only a few colors change, as with color cycling.
+/// @param changed boolean for each of the 256 colors
+static void Update_colors_rect(const byte * changed)
+{
+  int x, y;
+  int band_top = -1; // first line of the current group of lines
+  int band_left = 0;
+  int band_right = 0;
+
+  for (y = 0; y <= Screen_SDL->h; y++)
+  {
+    int left = -1;
+    int right = -1;
+
+    if (y < Screen_SDL->h)
+    {
+      const byte * line = (const byte *)Screen_SDL->pixels + y * Screen_SDL->pitch;
+
+      for (x = 0; x < Screen_SDL->w; x++)
+        if (changed[line[x]])
+        {
+          left = x;
+          break;
+        }
+      if (left >= 0)
+        for (right = Screen_SDL->w - 1; !changed[line[right]]; right--)
+          ;
+    }
+    if (left >= 0)
+    {
+      if (band_top < 0)
+      {
+        band_top = y;
+        band_left = left;
+        band_right = right;
+      }
+      else
+      {
+        band_left = Min(band_left, left);
+        band_right = Max(band_right, right);
+      }
+    }
+    else if (band_top >= 0)
+    {
+      // Update_rect() works in screen pixels, round outwards
+      Update_rect(band_left / Pixel_width, band_top / Pixel_height,
+        band_right / Pixel_width - band_left / Pixel_width + 1,
+        (y + Pixel_height - 1) / Pixel_height - band_top / Pixel_height);
+      band_top = -1;
+    }
+  }
+}
+#endif
+
 int GFX2_SetPalette(const T_Components * colors, int firstcolor, int ncolors)
 {
   int i;
@@ -489,7 +640,29 @@ int GFX2_SetPalette(const T_Components * colors, int firstcolor, int ncolors)
   // 8bit => True color conversion will be performed
   i = SDL_SetPaletteColors(Screen_SDL->format->palette, PaletteSDL, firstcolor, ncolors);
   if (i == 0)
-    Update_rect(0, 0, Screen_SDL->w, Screen_SDL->h);
+  {
+    byte changed[256];
+    int count = 0;
+    int index;
+
+    // Only the pixels of the modified colors need a conversion
+    memset(changed, 0, sizeof(changed));
+    for (index = 0; index < ncolors; index++)
+    {
+      dword argb = 0xff000000
+        | ((dword)colors[index].R << 16) | ((dword)colors[index].G << 8) | colors[index].B;
+      if (Screen_ARGB_palette[firstcolor + index] != argb)
+      {
+        Screen_ARGB_palette[firstcolor + index] = argb;
+        changed[firstcolor + index] = 1;
+        count++;
+      }
+    }
+    if (count == 256)
+      Update_rect(0, 0, 0, 0);
+    else if (count > 0)
+      Update_colors_rect(changed);
+  }
   return i;
 #endif
 }
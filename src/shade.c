@@ -48,6 +48,7 @@ void Button_Shade_mode(void)
     Smear_mode=0;
   }
   Shade_mode=!Shade_mode;
+  Update_pixel_renderer();
 }
 
 
@@ -65,6 +66,7 @@ void Button_Quick_shade_mode(void)
     Smear_mode=0;
   }
   Quick_shade_mode=!Quick_shade_mode;
+  Update_pixel_renderer();
 }
 
 
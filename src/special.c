@@ -427,6 +427,7 @@ void Transparency_set(byte amount)
     Tiling_mode=0;
 
     Colorize_mode=1;
+    Update_pixel_renderer();
   }
 
   time_previous = time_click;
@@ -340,6 +340,8 @@ typedef struct
   byte Adjust_brush_pick;                ///< Boolean, true to omit the right and bottom edges when grabbing a brush in Grid mode.
   byte Auto_save;                        ///< Boolean, true to save configuration when exiting program.
   byte Max_undo_pages;                   ///< Number of steps to memorize for Undo/Redo.
+  word Max_undo_memory;                  ///< Memory budget for the Undo/Redo of each picture, in Mb. 0 means Max_undo_pages is the limit instead.
+  word Max_undo_disk;                    ///< Disk space for Undo/Redo steps that don't fit in Max_undo_memory, in Mb. 0 to disable.
   byte Mouse_sensitivity_index_x;        ///< Mouse sensitivity in X axis
   byte Mouse_sensitivity_index_y;        ///< Mouse sensitivity in Y axis
   byte Mouse_merge_movement;             ///< Number of SDL mouse events that are merged into a single change of mouse coordinates.
@@ -393,16 +395,21 @@ typedef struct
 // Ces structures sont manipulées à travers des fonctions de gestion du
 // backup dans "graph.c".
 
+/// Block of pixels of a history layer, see pages.c
+typedef struct T_History_tile T_History_tile;
+
 typedef struct T_Image
 {
   byte * Pixels;
   int Duration;
+  T_History_tile ** Tiles; ///< When not NULL, Pixels is NULL and the layer is stored as a grid of tiles.
 } T_Image;
 
 /// This is the data for one step of Undo/Redo, for one image.
 /// This structure is resized dynamically to hold pointers to all of the layers in the picture.
 /// The pointed layers are just byte* holding the raw pixel data. But at Image[0]-1 you will find a short that is used as a reference counter for each layer.
 /// This way we can use the same pixel data in many undo pages when the user edit only one of the layers (which is what they usually do).
+/// Older steps (all but the current page and the one before it) store their layers as grids of reference-counted tiles instead, see Compact_list_of_pages().
 typedef struct T_Page
 {
   int       Width;   ///< Image width in pixels.
@@ -613,6 +620,8 @@ typedef struct
   long edits_since_safety_backup;
   /// SDL Time of the previous safety backup
   dword time_of_safety_backup;
+  /// Boolean, true when a safety backup is due and waits for the user to be idle
+  byte safety_backup_pending;
   /// Letter prefix for the filenames of safety backups. a or b
   byte safety_backup_prefix;
   /// Tilemap mode
@@ -59,6 +59,14 @@ byte Get_pixel(T_IO_Context *context, short x, short y)
   return context->Target_address[y*context->Pitch + x];
 }
 
+void Get_pixel_row(T_IO_Context *context, short x, short y, short width, byte * colors)
+{
+  short i;
+
+  for (i = 0; i < width; i++)
+    colors[i] = Get_pixel(context, x + i, y);
+}
+
 void Pixel_in_layer(int layer, word x, word y, byte color)
 {
   (void)layer;
@@ -85,6 +93,16 @@ void Set_pixel(T_IO_Context *context, short x, short y, byte c)
   }
 }
 
+void Set_pixel_row(T_IO_Context *context, short x, short y, short width, const byte * colors)
+{
+  short i;
+
+  if (y >= context->Height)
+    return;
+  for (i = 0; i < width && x + i < context->Width; i++)
+    Set_pixel(context, x + i, y, colors[i]);
+}
+
 void Set_pixel_24b(T_IO_Context *context, short x, short y, byte r, byte g, byte b)
 {
   (void)context;
@@ -138,3 +156,9 @@ int Get_palette_RGB_scale(void)
 {
   return 256;
 }
+
+byte Safety_backup_active = 0;
+
+void Rotate_safety_backups(void)
+{
+}
@@ -125,3 +125,34 @@ word Count_used_colors_area(dword* usage, word start_x, word start_y, word width
 {
   return 256;
 }
+
+void Compute_limits(void)
+{
+}
+
+void Compute_paintbrush_coordinates(void)
+{
+}
+
+void Invalidate_best_color_cache(void)
+{
+}
+
+void Update_pixel_renderer(void)
+{
+}
+
+void Tilemap_update(void)
+{
+}
+
+int Layers_max(enum IMAGE_MODES mode)
+{
+  (void)mode;
+  return MAX_NB_LAYERS;
+}
+
+int Min(int a,int b)
+{
+  return (a<b)?a:b;
+}
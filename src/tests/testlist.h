@@ -12,6 +12,10 @@ TEST(Calculate_relative_path)
 TEST(MOTO_MAP_pack)
 TEST(CPC_compare_colors)
 TEST(Packbits)
+TEST(Packbits_memory)
+TEST(Fill_GFX2_Surface)
+TEST(Span_kernels)
+TEST(History_memory_budget)
 TEST(Convert_24b_bitmap_to_256)
 TEST(Formats)
 TEST(Load)
@@ -78,6 +78,10 @@ T_Document Main;
 T_Document Spare;
 byte * Screen_backup;
 byte * Main_Screen;
+byte * Main_screen;
+char * Config_directory;
+Func_pixel Pixel_preview;
+Func_pixel Pixel_preview_normal;
 short Screen_width;
 short Screen_height;
 short Original_screen_X;
@@ -27,6 +27,7 @@
 /// Unit tests.
 ///
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "tests.h"
 #include "../op_c.h"
@@ -56,6 +57,54 @@ int Test_Convert_24b_bitmap_to_256(char * msg)
     if (memcmp(&source[i], &palette[dest[i]], sizeof(T_Components)) != 0)
       return 0;
   }
-  // TODO: test a real reduction
-  return 1;
+
+  // then a real reduction, of a picture with 65536 colors.
+  // The bottom half has the same colors as the top half, in reverse order.
+  {
+    T_Components * big_source;
+    byte * big_dest;
+    int x, y;
+    long error = 0;
+    int ok = 1;
+
+    big_source = (T_Components *)malloc(256 * 512 * sizeof(T_Components));
+    big_dest = (byte *)malloc(256 * 512);
+    if (big_source == NULL || big_dest == NULL)
+    {
+      free(big_source);
+      free(big_dest);
+      snprintf(msg, ERRMSG_LENGTH, "malloc failed");
+      return 0;
+    }
+    for (y = 0; y < 256; y++)
+      for (x = 0; x < 256; x++)
+      {
+        big_source[y * 256 + x].R = x;
+        big_source[y * 256 + x].G = y;
+        big_source[y * 256 + x].B = (x + y) / 2;
+        big_source[256 * 512 - 1 - (y * 256 + x)] = big_source[y * 256 + x];
+      }
+    if (Convert_24b_bitmap_to_256(big_dest, big_source, 256, 512, palette) != 0)
+    {
+      snprintf(msg, ERRMSG_LENGTH, "Convert_24b_bitmap_to_256 failed");
+      ok = 0;
+    }
+    for (i = 0; ok && i < 256 * 256; i++)
+    {
+      if (big_dest[i] != big_dest[256 * 512 - 1 - i])
+      {
+        snprintf(msg, ERRMSG_LENGTH, "pixel %d converted to %d and %d", i, big_dest[i], big_dest[256 * 512 - 1 - i]);
+        ok = 0;
+      }
+      error += abs(palette[big_dest[i]].R - (i & 255)) + abs(palette[big_dest[i]].G - (i >> 8));
+    }
+    if (ok && error / (256 * 256) > 16)
+    {
+      snprintf(msg, ERRMSG_LENGTH, "average error %ld too high", error / (256 * 256));
+      ok = 0;
+    }
+    free(big_source);
+    free(big_dest);
+    return ok;
+  }
 }
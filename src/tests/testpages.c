@@ -0,0 +1,158 @@
+/* vim:expandtab:ts=2 sw=2:
+*/
+/*  Grafx2 - The Ultimate 256-color bitmap paint program
+
+    Copyright 2018-2019 Thomas Bernard
+    Copyright 1996-2001 Sunset Design (Guillaume Dorme & Karl Maritaud)
+
+    Grafx2 is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; version 2
+    of the License.
+
+    Grafx2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Grafx2; if not, see <http://www.gnu.org/licenses/>
+*/
+///@file testpages.c
+/// Unit tests for the history (lists of pages).
+///
+#include <stdio.h>
+#include <string.h>
+#include "tests.h"
+#include "../struct.h"
+#include "../global.h"
+#include "../pages.h"
+#include "../gfx2log.h"
+
+T_Page * New_page(int nb_layers);
+byte * New_layer(long pixel_size);
+
+/**
+ * Make a list of pages with a single page of blank layers
+ */
+static int Init_test_list(T_List_of_pages * list, int nb_layers, int width, int height)
+{
+  T_Page * page;
+  int i;
+
+  page = New_page(nb_layers);
+  if (page == NULL)
+    return 0;
+  page->Width = width;
+  page->Height = height;
+  page->Next = page->Prev = page;
+  list->Pages = page;
+  list->List_size = 1;
+  for (i = 0; i < nb_layers; i++)
+  {
+    page->Image[i].Pixels = New_layer(width*height);
+    if (page->Image[i].Pixels == NULL)
+      return 0;
+    memset(page->Image[i].Pixels, 0, width*height);
+  }
+  return 1;
+}
+
+/**
+ * Add a step to a list of pages, like Backup_layers() does
+ */
+static int Test_backup(T_List_of_pages * list, int layer)
+{
+  T_Page * page = New_page(list->Pages->Nb_layers);
+
+  if (page == NULL)
+    return 0;
+  page->Width = list->Pages->Width;
+  page->Height = list->Pages->Height;
+  return Create_new_page(page, list, layer);
+}
+
+static void Free_test_list(T_List_of_pages * list)
+{
+  while (list->List_size > 0)
+    Free_last_page_of_list(list);
+}
+
+/**
+ * Tests for the Undo memory budget of Create_new_page()
+ *
+ * The spare page is just under the budget: it must not shrink the history
+ * of the main page, and each backup of all layers must count all of them.
+ */
+int Test_History_memory_budget(char * errmsg)
+{
+  T_List_of_pages main_list;
+  T_List_of_pages spare_list;
+  const long long budget = 1024*1024;
+  const long long step_size = 3*256*256;
+  const long long spare_size = 1000*1000;
+  long long memory = Stats_pages_memory;
+  word max_undo_memory = Config.Max_undo_memory;
+  word max_undo_disk = Config.Max_undo_disk;
+  int result = 0;
+  int i;
+
+  Config.Max_undo_memory = 1;
+  Config.Max_undo_disk = 0;
+  Init_list_of_pages(&main_list);
+  Init_list_of_pages(&spare_list);
+  if (!Init_test_list(&spare_list, 1, 1000, 1000) || !Init_test_list(&main_list, 3, 256, 256))
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "Failed to allocate the pages");
+    goto end;
+  }
+  for (i = 0; i < 20; i++)
+  {
+    if (!Test_backup(&main_list, LAYER_ALL))
+    {
+      snprintf(errmsg, ERRMSG_LENGTH, "Create_new_page() failed");
+      goto end;
+    }
+    if (Stats_pages_memory - memory - spare_size > budget)
+    {
+      snprintf(errmsg, ERRMSG_LENGTH, "Main history uses %lld bytes after %d steps, more than the budget",
+               Stats_pages_memory - memory - spare_size, i + 1);
+      goto end;
+    }
+  }
+  GFX2_Log(GFX2_DEBUG, "Main history: %d steps\n", main_list.List_size);
+  if (main_list.List_size != (int)(budget / step_size))
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "Main history has %d steps, %d expected",
+             main_list.List_size, (int)(budget / step_size));
+    goto end;
+  }
+  // The spare history is trimmed to its own budget, not the main one
+  for (i = 0; i < 3; i++)
+  {
+    if (!Test_backup(&spare_list, 0))
+    {
+      snprintf(errmsg, ERRMSG_LENGTH, "Create_new_page() failed");
+      goto end;
+    }
+  }
+  if (spare_list.List_size != 2 || main_list.List_size != (int)(budget / step_size))
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "Spare backups left %d spare and %d main steps",
+             spare_list.List_size, main_list.List_size);
+    goto end;
+  }
+  result = 1;
+
+end:
+  Free_test_list(&main_list);
+  Free_test_list(&spare_list);
+  Config.Max_undo_memory = max_undo_memory;
+  Config.Max_undo_disk = max_undo_disk;
+  if (result && Stats_pages_memory != memory)
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "%lld bytes of pages leaked", Stats_pages_memory - memory);
+    result = 0;
+  }
+  return result;
+}
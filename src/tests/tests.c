@@ -31,12 +31,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include "tests.h"
 #include "../struct.h"
 #include "../oldies.h"
 #include "../packbits.h"
 #include "../io.h"
 #include "../gfx2log.h"
+#include "../gfx2surface.h"
+#include "../drawspan.h"
 
 // random()/srandom() not available with mingw32
 #if defined(WIN32)
@@ -252,3 +255,262 @@ int Test_Packbits(char * errmsg)
   unlink(tempfilename);
   return 1; // test OK
 }
+
+/**
+ * Tests for the packbits compression to/from memory buffers
+ */
+int Test_Packbits_memory(char * errmsg)
+{
+  byte original[4096];
+  byte packed[4096 + 4096/128 + 1];
+  byte unpacked[4096];
+  int packed_size;
+  int i;
+
+  // some runs, some noise
+  for (i = 0; i < (int)sizeof(original); i++)
+    original[i] = (i & 512) ? (byte)(i / 100) : (byte)random();
+
+  packed_size = PackBits_pack_buffer_to_memory(packed, sizeof(packed), original, sizeof(original));
+  if (packed_size < 0)
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "PackBits_pack_buffer_to_memory() failed");
+    return 0;
+  }
+  GFX2_Log(GFX2_DEBUG, "Compressed %lu bytes to %d\n", (unsigned long)sizeof(original), packed_size);
+  if (PackBits_unpack_from_memory(packed, packed_size, unpacked, sizeof(unpacked)) != PACKBITS_UNPACK_OK)
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "PackBits_unpack_from_memory() failed");
+    return 0;
+  }
+  if (memcmp(original, unpacked, sizeof(original)) != 0)
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "uncompressed buffer mismatch");
+    return 0;
+  }
+  // truncated input must be detected
+  if (PackBits_unpack_from_memory(packed, packed_size - 1, unpacked, sizeof(unpacked)) != PACKBITS_UNPACK_READ_ERROR)
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "PackBits_unpack_from_memory() didn't detect truncated input");
+    return 0;
+  }
+  // too small output buffer must be detected
+  if (PackBits_pack_buffer_to_memory(packed, packed_size - 1, original, sizeof(original)) >= 0)
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "PackBits_pack_buffer_to_memory() didn't detect overflow");
+    return 0;
+  }
+  return 1; // test OK
+}
+
+/**
+ * Reference flood fill : fill pixel by pixel until nothing changes
+ */
+static void Reference_fill(T_GFX2_Surface * s, int x, int y, byte old_color, byte new_color)
+{
+  int changes = 1;
+
+  s->pixels[x + y * s->w] = new_color;
+  while (changes)
+  {
+    changes = 0;
+    for (y = 0; y < s->h; y++)
+      for (x = 0; x < s->w; x++)
+        if (s->pixels[x + y * s->w] == old_color &&
+            ((x > 0 && s->pixels[x - 1 + y * s->w] == new_color) ||
+             (x < s->w - 1 && s->pixels[x + 1 + y * s->w] == new_color) ||
+             (y > 0 && s->pixels[x + (y - 1) * s->w] == new_color) ||
+             (y < s->h - 1 && s->pixels[x + (y + 1) * s->w] == new_color)))
+        {
+          s->pixels[x + y * s->w] = new_color;
+          changes = 1;
+        }
+  }
+}
+
+/**
+ * Tests for Fill_GFX2_Surface()
+ *
+ * Compares with a naive fill on random mazes, then fills a worst-case
+ * serpentine at 8K resolution.
+ */
+int Test_Fill_GFX2_Surface(char * errmsg)
+{
+  T_GFX2_Surface * surface;
+  T_GFX2_Surface * reference;
+  int pass;
+  int x, y;
+  int left, top, right, bottom;
+  clock_t start;
+
+  surface = New_GFX2_Surface(67, 41);
+  reference = New_GFX2_Surface(67, 41);
+  if (surface == NULL || reference == NULL)
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "New_GFX2_Surface() failed");
+    if (surface != NULL)
+      Free_GFX2_Surface(surface);
+    if (reference != NULL)
+      Free_GFX2_Surface(reference);
+    return 0;
+  }
+  for (pass = 0; pass < 20; pass++)
+  {
+    for (x = 0; x < 67 * 41; x++)
+      surface->pixels[x] = (random() % 100) < 40;
+    surface->pixels[33 + 20 * 67] = 0;
+    memcpy(reference->pixels, surface->pixels, 67 * 41);
+    Reference_fill(reference, 33, 20, 0, 2);
+    left = 0;
+    top = 0;
+    right = 66;
+    bottom = 40;
+    if (Fill_GFX2_Surface(surface, 33, 20, 0, 2, &left, &top, &right, &bottom) < 0)
+    {
+      snprintf(errmsg, ERRMSG_LENGTH, "Fill_GFX2_Surface() failed");
+      Free_GFX2_Surface(surface);
+      Free_GFX2_Surface(reference);
+      return 0;
+    }
+    if (memcmp(surface->pixels, reference->pixels, 67 * 41) != 0)
+    {
+      snprintf(errmsg, ERRMSG_LENGTH, "Fill_GFX2_Surface() result differs from reference (pass %d)", pass);
+      Free_GFX2_Surface(surface);
+      Free_GFX2_Surface(reference);
+      return 0;
+    }
+    for (y = 0; y < 41; y++)
+      for (x = 0; x < 67; x++)
+        if (surface->pixels[x + y * 67] == 2 && (x < left || x > right || y < top || y > bottom))
+        {
+          snprintf(errmsg, ERRMSG_LENGTH, "(%d,%d) filled outside of (%d,%d)-(%d,%d)", x, y, left, top, right, bottom);
+          Free_GFX2_Surface(surface);
+          Free_GFX2_Surface(reference);
+          return 0;
+        }
+  }
+  Free_GFX2_Surface(surface);
+  Free_GFX2_Surface(reference);
+
+  // Serpentine : one wall every other line, with a gap alternating left and right
+  surface = New_GFX2_Surface(7680, 4320);
+  if (surface == NULL)
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "New_GFX2_Surface() failed");
+    return 0;
+  }
+  memset(surface->pixels, 0, 7680 * 4320);
+  for (y = 1; y < 4320; y += 2)
+  {
+    memset(surface->pixels + y * 7680, 1, 7680);
+    surface->pixels[y * 7680 + ((y & 2) ? 0 : 7679)] = 0;
+  }
+  left = 0;
+  top = 0;
+  right = 7679;
+  bottom = 4319;
+  start = clock();
+  if (Fill_GFX2_Surface(surface, 0, 0, 0, 2, &left, &top, &right, &bottom) < 0)
+  {
+    snprintf(errmsg, ERRMSG_LENGTH, "Fill_GFX2_Surface() failed");
+    Free_GFX2_Surface(surface);
+    return 0;
+  }
+  GFX2_Log(GFX2_INFO, "Serpentine 7680x4320 filled in %.3fs\n", (double)(clock() - start) / CLOCKS_PER_SEC);
+  for (x = 0; x < 7680 * 4320; x++)
+  {
+    if (surface->pixels[x] == 0)
+    {
+      snprintf(errmsg, ERRMSG_LENGTH, "pixel (%d,%d) not filled", x % 7680, x / 7680);
+      Free_GFX2_Surface(surface);
+      return 0;
+    }
+  }
+  Free_GFX2_Surface(surface);
+  return 1; // test OK
+}
+
+static const byte * Test_span_feedback;
+static const byte * Test_span_shade_table;
+
+static byte Test_span_no_effect(word x, word y, byte color)
+{
+  (void)x;
+  (void)y;
+  return color;
+}
+
+static byte Test_span_shade(word x, word y, byte color)
+{
+  (void)y;
+  (void)color;
+  return Test_span_shade_table[Test_span_feedback[x]];
+}
+
+/**
+ * Tests for the span kernels of drawspan.c
+ *
+ * The kernels with an inlined effect must give the same result as the
+ * generic kernel calling the effect function.
+ */
+int Test_Span_kernels(char * errmsg)
+{
+  byte colors[SPAN_CHUNK];
+  byte drawable[SPAN_CHUNK];
+  byte depth[SPAN_CHUNK];
+  byte feedback[SPAN_CHUNK];
+  byte shade_table[256];
+  byte under[SPAN_CHUNK];
+  byte layer[2][SPAN_CHUNK];
+  byte screen[2][SPAN_CHUNK];
+  T_Image images[1];
+  T_Span span;
+  int layered, tested, effect;
+  int i;
+
+  for (i = 0; i < SPAN_CHUNK; i++)
+  {
+    colors[i] = (i & 64) ? 3 : (byte)random(); // 3 is the transparent color
+    drawable[i] = random() & 1;
+    depth[i] = (random() & 1) ? 0 : 2;
+    feedback[i] = (byte)random();
+    under[i] = (byte)random();
+  }
+  for (i = 0; i < 256; i++)
+    shade_table[i] = (byte)(i * 7);
+  Test_span_feedback = feedback;
+  Test_span_shade_table = shade_table;
+  images[0].Pixels = under;
+
+  memset(&span, 0, sizeof(span));
+  span.width = SPAN_CHUNK;
+  span.colors = colors;
+  span.images = images;
+  span.current_layer = 1;
+  span.transparent_color = 3;
+  span.shade_table = shade_table;
+  span.feedback = feedback;
+  for (layered = 0; layered < 2; layered++)
+    for (tested = 0; tested < 2; tested++)
+      for (effect = SPAN_REPLACE; effect <= SPAN_SHADE; effect++)
+      {
+        span.drawable = tested ? drawable : NULL;
+        span.depth = layered ? depth : NULL;
+        for (i = 0; i < 2; i++)
+        {
+          memset(layer[i], 1, SPAN_CHUNK);
+          memset(screen[i], 2, SPAN_CHUNK);
+          span.layer = layer[i];
+          span.screen = screen[i];
+          span.effect = (effect == SPAN_SHADE) ? Test_span_shade : Test_span_no_effect;
+          Get_span_kernel(layered, i == 0 ? (enum SPAN_EFFECT)effect : SPAN_ANY_EFFECT, tested)(&span);
+        }
+        if (memcmp(layer[0], layer[1], SPAN_CHUNK) != 0 || memcmp(screen[0], screen[1], SPAN_CHUNK) != 0)
+        {
+          snprintf(errmsg, ERRMSG_LENGTH, "span kernel (layered=%d, effect=%d, tested=%d) differs from the generic one",
+                   layered, effect, tested);
+          return 0;
+        }
+      }
+  return 1; // test OK
+}
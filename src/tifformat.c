@@ -189,22 +189,15 @@ static void Load_TIFF_image(T_IO_Context * context, TIFF * tif, word spp, word b
       {
         for (x = 0; x < context->Width; x += tile_width)
         {
-          dword x2, y2;
+          dword y2;
           if (TIFFReadTile(tif, buffer, x, y, 0, 0) == -1)
           {
             free(buffer);
             File_error = 2;
             return;
           }
-          j = 0;
           for (y2 = 0; y2 < tile_height; y2++)
-          {
-            for (x2 = 0; x2 < tile_width ; x2++)
-            {
-              Set_pixel(context, x + x2, y + y2, buffer[j]);
-              j++;
-            }
-          }
+            Set_pixel_row(context, x, y + y2, tile_width, buffer + y2 * tile_width);
         }
       }
       free(buffer);
@@ -277,13 +270,16 @@ static void Load_TIFF_image(T_IO_Context * context, TIFF * tif, word spp, word b
         }
         for (i = 0, j = 0; i < rows_per_strip && y < context->Height; i++, y++)
         {
+          if (bps == 8)
+          {
+            Set_pixel_row(context, 0, y, context->Width, buffer + j);
+            j += context->Width;
+            continue;
+          }
           for (x = 0; x < context->Width; x++)
           {
             switch (bps)
             {
-              case 8:
-                Set_pixel(context, x, y, buffer[j++]);
-                break;
               case 6: // 3 bytes => 4 pixels
                 Set_pixel(context, x++, y, buffer[j] >> 2);
                 if (x < context->Width)
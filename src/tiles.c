@@ -172,6 +172,68 @@ int Tile_is_same_flipped_xy(int t1, int t2)
   return 1;
 }
 
+/// Hash of the pixels of a tile, read in the given orientation.
+/// Tile_hash(t2,f) equals Tile_hash(t1,0) whenever the matching
+/// Tile_is_same*(t1,t2) returns true.
+static dword Tile_hash(int t, byte flipped)
+{
+  const byte *bmp;
+  int x_step=1, y_step=Main.image_width;
+  int x, y;
+  dword hash=2166136261u; // FNV-1a
+
+  bmp = Main.backups->Pages->Image[Main.current_layer].Pixels+(TILE_Y(t))*Main.image_width+(TILE_X(t));
+  if (flipped & TILE_FLIPPED_X)
+  {
+    bmp += Snap_width-1;
+    x_step = -1;
+  }
+  if (flipped & TILE_FLIPPED_Y)
+  {
+    bmp += (Snap_height-1)*Main.image_width;
+    y_step = -Main.image_width;
+  }
+  for (y=0; y < Snap_height; y++, bmp+=y_step)
+    for (x=0; x < Snap_width; x++)
+      hash = (hash ^ bmp[x*x_step]) * 16777619u;
+  return hash;
+}
+
+/// Look for an earlier unique tile whose pixels are the ones of @p tile
+/// in the given orientation. Returns -1 if there is none.
+static int Tilemap_find(const int * table, dword mask, const dword * hashes, int tile, byte flipped)
+{
+  dword hash = flipped ? Tile_hash(tile, flipped) : hashes[tile];
+  dword slot;
+
+  for (slot = hash & mask; table[slot] >= 0; slot = (slot+1) & mask)
+  {
+    int ref_tile = table[slot];
+    if (hashes[ref_tile] != hash)
+      continue;
+    switch (flipped)
+    {
+      case 0:
+        if (Tile_is_same(ref_tile, tile))
+          return ref_tile;
+        break;
+      case TILE_FLIPPED_X:
+        if (Tile_is_same_flipped_x(ref_tile, tile))
+          return ref_tile;
+        break;
+      case TILE_FLIPPED_Y:
+        if (Tile_is_same_flipped_y(ref_tile, tile))
+          return ref_tile;
+        break;
+      default:
+        if (Tile_is_same_flipped_xy(ref_tile, tile))
+          return ref_tile;
+        break;
+    }
+  }
+  return -1;
+}
+
 /// Create or update a tilemap based on current screen (layer)'s pixels.
 void Tilemap_update(void)
 {
@@ -180,6 +242,9 @@ void Tilemap_update(void)
   int tile;
   int count=1;
   T_Tile * tile_ptr;
+  dword * hashes;
+  int * table;
+  dword mask;
   
   int wait_window=0;
   byte old_cursor=0;
@@ -202,6 +267,23 @@ void Tilemap_update(void)
     return;
   }
   
+  // Hash table of the unique tiles found so far: open addressing,
+  // at most half full.
+  for (mask=1; mask < (dword)(width*height)*2; mask<<=1)
+    ;
+  hashes=(dword *)malloc(width*height*sizeof(dword));
+  table=(int *)malloc(mask*sizeof(int));
+  if (hashes == NULL || table == NULL)
+  {
+    free(hashes);
+    free(table);
+    free(tile_ptr);
+    Disable_tilemap(&Main);
+    return;
+  }
+  memset(table, -1, mask*sizeof(int));
+  mask--;
+  
   if (Main.tilemap)
   {
     // Recycle existing tilemap
@@ -213,7 +295,7 @@ void Tilemap_update(void)
   Main.tilemap_width=width;
   Main.tilemap_height=height;
 
-  if (width*height > 1000 || Config.Tilemap_show_count)
+  if (width*height > 100000 || Config.Tilemap_show_count)
   {
     wait_window=1;
     old_cursor=Cursor_shape;
@@ -231,113 +313,72 @@ void Tilemap_update(void)
     Main.tilemap[tile].Previous = tile;
     Main.tilemap[tile].Next = tile;
     Main.tilemap[tile].Flipped = 0;
+    hashes[tile] = Tile_hash(tile, 0);
   }
+  table[hashes[0] & mask] = 0;
   
   // Now find similar tiles and link them in circular linked list
   //It will be used to modify all tiles whenever you draw on one.
+  // Only the unique tiles are in the hash table, and full comparisons
+  // are only made with the tiles that have the same hash.
   for (tile=1; tile<width*height; tile++)
   {
     int ref_tile;
+    byte flipped=0;
+    dword slot;
     
     // Try normal comparison
+    ref_tile = Tilemap_find(table, mask, hashes, tile, 0);
     
-    for (ref_tile=0; ref_tile<tile; ref_tile++)
+    // Try flipped-y comparison
+    if (ref_tile<0 && Config.Tilemap_allow_flipped_y)
     {
-      if (Main.tilemap[ref_tile].Previous<=ref_tile && Tile_is_same(ref_tile, tile))
-      {
-        break; // stop loop on ref_tile
-      }
+      flipped = TILE_FLIPPED_Y;
+      ref_tile = Tilemap_find(table, mask, hashes, tile, flipped);
     }
-    if (ref_tile<tile)
+    
+    // Try flipped-x comparison
+    if (ref_tile<0 && Config.Tilemap_allow_flipped_x)
+    {
+      flipped = TILE_FLIPPED_X;
+      ref_tile = Tilemap_find(table, mask, hashes, tile, flipped);
+    }
+    
+    // Try flipped-xy comparison
+    if (ref_tile<0 && Config.Tilemap_allow_flipped_x && Config.Tilemap_allow_flipped_y)
+    {
+      flipped = TILE_FLIPPED_XY;
+      ref_tile = Tilemap_find(table, mask, hashes, tile, flipped);
+    }
+    
+    if (ref_tile>=0)
     {
       // New occurrence of a known tile
       // Insert at the end. classic doubly-linked-list.
       int last_tile=Main.tilemap[ref_tile].Previous;
       Main.tilemap[tile].Previous=last_tile;
       Main.tilemap[tile].Next=ref_tile;
-      Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped;
+      Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped ^ flipped;
       Main.tilemap[ref_tile].Previous=tile;
       Main.tilemap[last_tile].Next=tile;
-      continue; // next tile
-    }
-    
-    // Try flipped-y comparison
-    if (Config.Tilemap_allow_flipped_y)
-    {
-      for (ref_tile=0; ref_tile<tile; ref_tile++)
-      {
-        if (Main.tilemap[ref_tile].Previous<=ref_tile && Tile_is_same_flipped_y(ref_tile, tile))
-        {
-          break; // stop loop on ref_tile
-        }
-      }
-      if (ref_tile<tile)
-      {
-        // New occurrence of a known tile
-        // Insert at the end. classic doubly-linked-list.
-        int last_tile=Main.tilemap[ref_tile].Previous;
-        Main.tilemap[tile].Previous=last_tile;
-        Main.tilemap[tile].Next=ref_tile;
-        Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped ^ TILE_FLIPPED_Y;
-        Main.tilemap[ref_tile].Previous=tile;
-        Main.tilemap[last_tile].Next=tile;
+      if (flipped == 0)
         continue; // next tile
-      }
     }
-    
-    // Try flipped-x comparison
-    if (Config.Tilemap_allow_flipped_x)
-    {
-      for (ref_tile=0; ref_tile<tile; ref_tile++)
-      {
-        if (Main.tilemap[ref_tile].Previous<=ref_tile && Tile_is_same_flipped_x(ref_tile, tile))
-        {
-          break; // stop loop on ref_tile
-        }
-      }
-      if (ref_tile<tile)
-      {
-        // New occurrence of a known tile
-        // Insert at the end. classic doubly-linked-list.
-        int last_tile=Main.tilemap[ref_tile].Previous;
-        Main.tilemap[tile].Previous=last_tile;
-        Main.tilemap[tile].Next=ref_tile;
-        Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped ^ TILE_FLIPPED_X;
-        Main.tilemap[ref_tile].Previous=tile;
-        Main.tilemap[last_tile].Next=tile;
-        continue; // next tile
-      }
-    }
-    
-    // Try flipped-xy comparison
-    if (Config.Tilemap_allow_flipped_x && Config.Tilemap_allow_flipped_y)
+    else
     {
-      for (ref_tile=0; ref_tile<tile; ref_tile++)
-      {
-        if (Main.tilemap[ref_tile].Previous<=ref_tile && Tile_is_same_flipped_xy(ref_tile, tile))
-        {
-          break; // stop loop on ref_tile
-        }
-      }
-      if (ref_tile<tile)
-      {
-        // New occurrence of a known tile
-        // Insert at the end. classic doubly-linked-list.
-        int last_tile=Main.tilemap[ref_tile].Previous;
-        Main.tilemap[tile].Previous=last_tile;
-        Main.tilemap[tile].Next=ref_tile;
-        Main.tilemap[tile].Flipped=Main.tilemap[ref_tile].Flipped ^ TILE_FLIPPED_XY;
-        Main.tilemap[ref_tile].Previous=tile;
-        Main.tilemap[last_tile].Next=tile;
-        continue; // next tile
-      }
+      // This tile is really unique.
+      // The initialization has already set the right data
+      // for Main.tilemap[tile].
+      count++;
     }
-    
-    // This tile is really unique.
-    // Nothing to do at this time: the initialization
-    // has already set the right data for Main.tilemap[tile].
-    count++;
+    // First occurrence of these pixels in normal orientation:
+    // later tiles will be compared to this one.
+    for (slot = hashes[tile] & mask; table[slot] >= 0; slot = (slot+1) & mask)
+      ;
+    table[slot] = tile;
   }
+  free(hashes);
+  free(table);
   
   if (wait_window)
   {
@@ -1359,6 +1359,13 @@ byte Confirmation_box(const char * message)
   short current_length=0;
   short current_line;
 
+  if (Batch_mode)
+  {
+    // Nobody to answer: the action is cancelled
+    GFX2_Log(GFX2_WARNING, "%s\n", message);
+    return 0;
+  }
+
   // Count lines, and measure max line length
   for (c=message; *c != '\0'; c++)
   {
@@ -1564,6 +1571,12 @@ void Warning_message(const char * message)
   short clicked_button;
   word  window_width;
 
+  if (Batch_mode)
+  {
+    GFX2_Log(GFX2_WARNING, "Warning: %s\n", message);
+    return;
+  }
+
   window_width=(strlen(message)<<3)+20;
   if (window_width<120)
     window_width=120;
@@ -1610,6 +1623,8 @@ void Verbose_message(const char *caption, const char * message )
   byte original_cursor_shape = Cursor_shape;
 
   GFX2_Log(GFX2_INFO, "* USER MSG * %s : %s\n", caption, message);
+  if (Batch_mode)
+    return;
 
   Open_window(300,160,caption);
 
@@ -3099,7 +3114,40 @@ void Display_all_screen(void)
 
 
 
-byte Best_color(byte r,byte g,byte b)
+/// Size of the ::Best_color() caches, must be a power of 2
+#define BEST_COLOR_CACHE_SIZE 32768
+
+/// One remembered result of ::Best_color() or ::Best_color_nonexcluded()
+typedef struct
+{
+  dword Rgb_color; ///< Requested RGB in the upper 24 bits, result in the lower 8
+  dword Generation; ///< Value of ::Best_color_generation when it was stored
+} T_Best_color_cache;
+
+static T_Best_color_cache Best_color_cache[BEST_COLOR_CACHE_SIZE];
+static T_Best_color_cache Best_color_nonexcluded_cache[BEST_COLOR_CACHE_SIZE];
+/// Current generation of the caches. 0 is never a valid generation.
+static dword Best_color_generation = 1;
+
+void Invalidate_best_color_cache(void)
+{
+  Best_color_generation++;
+  if (Best_color_generation == 0)
+  {
+    // Wrapped around: really clear the caches
+    memset(Best_color_cache, 0, sizeof(Best_color_cache));
+    memset(Best_color_nonexcluded_cache, 0, sizeof(Best_color_nonexcluded_cache));
+    Best_color_generation = 1;
+  }
+}
+
+/// Cache entry where the result for an RGB value is (or will be) stored
+static T_Best_color_cache * Best_color_cache_entry(T_Best_color_cache * cache, dword rgb)
+{
+  return cache + (((rgb * 2654435761u) >> 16) & (BEST_COLOR_CACHE_SIZE-1));
+}
+
+static byte Best_color_uncached(byte r,byte g,byte b)
 {
   int col;
   int   delta_r,delta_g,delta_b;
@@ -3133,7 +3181,7 @@ byte Best_color(byte r,byte g,byte b)
   return best_color;
 }
 
-byte Best_color_nonexcluded(byte red,byte green,byte blue)
+static byte Best_color_nonexcluded_uncached(byte red,byte green,byte blue)
 {
   int   col;
   int   delta_r,delta_g,delta_b;
@@ -3164,6 +3212,36 @@ byte Best_color_nonexcluded(byte red,byte green,byte blue)
   return best_color;
 }
 
+/// Nearest color in the palette, ignoring the colors tagged in ::Exclude_color.
+/// Results are cached until ::Invalidate_best_color_cache() is called.
+byte Best_color(byte r,byte g,byte b)
+{
+  dword rgb = ((dword)r<<16) | ((dword)g<<8) | b;
+  T_Best_color_cache * entry = Best_color_cache_entry(Best_color_cache, rgb);
+
+  if (entry->Generation != Best_color_generation || (entry->Rgb_color>>8) != rgb)
+  {
+    entry->Rgb_color = (rgb<<8) | Best_color_uncached(r, g, b);
+    entry->Generation = Best_color_generation;
+  }
+  return (byte)entry->Rgb_color;
+}
+
+/// Nearest color in the whole palette.
+/// Results are cached until ::Invalidate_best_color_cache() is called.
+byte Best_color_nonexcluded(byte red,byte green,byte blue)
+{
+  dword rgb = ((dword)red<<16) | ((dword)green<<8) | blue;
+  T_Best_color_cache * entry = Best_color_cache_entry(Best_color_nonexcluded_cache, rgb);
+
+  if (entry->Generation != Best_color_generation || (entry->Rgb_color>>8) != rgb)
+  {
+    entry->Rgb_color = (rgb<<8) | Best_color_nonexcluded_uncached(red, green, blue);
+    entry->Generation = Best_color_generation;
+  }
+  return (byte)entry->Rgb_color;
+}
+
 byte Best_color_range(byte r, byte g, byte b, byte max)
 {
 
@@ -113,6 +113,9 @@ void Window_display_icon_sprite(word x_pos,word y_pos,byte type);
 
 byte Best_color(byte red,byte green,byte blue);
 byte Best_color_nonexcluded(byte red,byte green,byte blue);
+/// Forget the results of ::Best_color() and ::Best_color_nonexcluded().
+/// Must be called whenever Main.palette or ::Exclude_color change.
+void Invalidate_best_color_cache(void);
 byte Best_color_range(byte red,byte green,byte blue,byte max);
 byte Best_color_perceptual(byte r,byte g,byte b);
 byte Best_color_perceptual_except(byte r,byte g,byte b, byte except);